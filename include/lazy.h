@@ -25,16 +25,30 @@
 #define _LAZY_H_
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef struct lazy_object_s * lz_obj;
 typedef struct lazy_database_s * lz_db;
 typedef struct lazy_root_s *lz_root;
+typedef struct lazy_prefetch_s * lz_prefetch;
+typedef struct lazy_writer_s * lz_writer;
+
+// What is stored on disk, when the handler of a root update is called:
+// FLUSH - everything has been handed over to the operating system (default)
+// SYNC  - the data file and then the journal of the roots have been synced
+// GROUP - like SYNC, but concurrent root updates share the syncs
+typedef enum {
+    LZ_DURABILITY_FLUSH = 1,
+    LZ_DURABILITY_SYNC,
+    LZ_DURABILITY_GROUP
+} lz_durability;
 
 typedef union {
     struct lazy_base_s * base;
     struct lazy_object_s * obj;
     struct lazy_database_s * db;
     struct lazy_root_s * root;
+    struct lazy_prefetch_s * prefetch;
 } lz_base __attribute__((transparent_union));
 
 #pragma mark -
@@ -48,8 +62,18 @@ void lz_wait_for_completion();
 void * lz_retain(lz_base obj);
 void * lz_release(lz_base obj);
 
+// Releases the handle and, if this was the last reference, deallocates
+// the handle and everything only reachable through it before returning.
+void lz_release_sync(lz_base obj);
+
+// Limits the reclaim worker to 'batch_size' handles per batch and waits
+// 'interval' nanoseconds between two batches (0 for no delay).
+void lz_reclaim_set_limit(size_t batch_size, uint64_t interval);
+
 int lz_rc(lz_base obj);
 
+void lz_slab_stats(uint64_t * live_slabs, uint64_t * retained_bytes);
+
 #pragma mark -
 #pragma mark Object Livecycle
 
@@ -64,6 +88,10 @@ lz_obj lz_obj_new_v(void * data,
                     uint16_t num_ref,
                     lz_obj * refs);
 
+// Overrides the compression setting of the database for the payload of a
+// new object.
+void lz_obj_set_compression(lz_obj obj, int enabled);
+
 #pragma mark -
 #pragma mark Check if objects are the same
 
@@ -75,6 +103,15 @@ int lz_obj_same(lz_obj obj1, lz_obj obj2);
 void lz_obj_sync(lz_obj, void(^)(void * data, uint32_t length));
 void lz_obj_async(lz_obj, void(^)(void * data, uint32_t length));
 
+// The length of the payload or the content of a large object.
+uint64_t lz_obj_length(lz_obj obj);
+
+// Calls the handler with 'length' bytes of the payload or the content of a
+// large object (less at the end) starting at 'offset'. Only the chunks of
+// a large object, which contain the range, are read. Returns the number of
+// bytes or -1 on error.
+int64_t lz_obj_read_range(lz_obj obj, uint64_t offset, size_t length, void(^handler)(void * data, size_t length));
+
 #pragma mark -
 #pragma mark Access Object References
 
@@ -83,11 +120,107 @@ uint16_t lz_obj_num_ref(lz_obj obj);
 lz_obj lz_obj_weak_ref(lz_obj obj, uint16_t pos);
 lz_obj lz_obj_ref(lz_obj obj, uint16_t pos);
 
+// The references are read on the I/O queue of the database, if needed.
+// The handler is called with retained objects on the queue of 'obj'.
+void lz_obj_ref_async(lz_obj obj, uint16_t pos, void(^result_handler)(lz_obj ref));
+void lz_obj_refs_async(lz_obj obj, const uint16_t * positions, uint16_t count, void(^result_handler)(lz_obj * refs));
+
+#pragma mark -
+#pragma mark Prefetch References
+
+// Faults the references of the object up to 'depth' levels in the
+// background, until 'max_bytes' have been read (0 for no limit). A read
+// only starts, if the size of the object (estimated by the size of the
+// object referencing it) fits into the remaining bytes.
+lz_prefetch lz_obj_prefetch(lz_obj obj, uint16_t depth, uint64_t max_bytes);
+
+void lz_prefetch_cancel(lz_prefetch prefetch);
+void lz_prefetch_wait(lz_prefetch prefetch);
+
+// Maximum number of reads of all prefetches at the same time.
+void lz_prefetch_set_limit(long num_reads);
+
 #pragma mark -
 #pragma mark Database Livecycle
 
 lz_db lz_db_open(const char * path);
 
+#pragma mark -
+#pragma mark Database Options
+
+// Payloads of objects read from the database point directly into
+// a read-only mapping of the data file.
+void lz_db_set_mmap(lz_db db, int enabled);
+
+// Payloads and references of persisted objects are evicted, if the
+// resident payloads exceed 'max_bytes' (0 for no limit), and read again
+// on the next access. Should be set before objects are read. With a limit,
+// a reference returned by lz_obj_weak_ref() may be evicted at any time,
+// use lz_obj_ref() instead. The payloads of objects created with
+// lz_obj_new() are not evicted.
+void lz_db_set_cache_limit(lz_db db, uint64_t max_bytes);
+uint64_t lz_db_cache_size(lz_db db);
+
+// Concurrent writes are combined into batches. The writer of a batch waits
+// up to 'delay' nanoseconds for other records, until the batch contains
+// 'batch_size' bytes (default: no delay).
+void lz_db_set_group_commit(lz_db db, size_t batch_size, uint64_t delay);
+
+// Maximum number of threads writing the objects of a graph (default: the
+// number of processors).
+void lz_db_set_write_parallelism(lz_db db, long num_writers);
+
+void lz_db_set_durability(lz_db db, lz_durability durability);
+
+// Compresses the payloads of new records, which are at least 'threshold'
+// bytes long (default: disabled, 512 bytes).
+void lz_db_set_compression(lz_db db, int enabled, uint32_t threshold);
+
+// Stores equal objects (same payload and references) only once. The index
+// of the stored objects is kept in the database. Should be enabled before
+// objects are written.
+void lz_db_set_dedup(lz_db db, int enabled);
+
+// Stores a CRC32C checksum in each new record (default: disabled).
+void lz_db_set_checksums(lz_db db, int enabled);
+
+// Verifies the checksums of records, when they are read (default: enabled).
+void lz_db_set_verify(lz_db db, int enabled);
+
+// Number of previous ids of each root, which are kept, when the journal of
+// the roots is compacted (default: 8).
+void lz_db_set_root_history(lz_db db, uint32_t num_ids);
+
+// Checks all records of the data file (on all processors). Calls the
+// handler (which can be 0) concurrently with the offset of each invalid
+// record. Returns the number of invalid records or -1 on error.
+int64_t lz_db_scrub(lz_db db, void(^handler)(uint64_t offset));
+
+// Writes the temporary objects reachable from 'obj' in one sequential pass.
+// The objects are persisted when the function returns.
+void lz_db_import(lz_db db, lz_obj obj);
+
+// Like lz_db_import(), but the objects are passed to 'emit' by the producer,
+// children before their parents.
+void lz_db_import_stream(lz_db db, void(^producer)(void(^emit)(lz_obj obj)));
+
+#pragma mark -
+#pragma mark Large Objects
+
+// The content of a large object is written to the database in chunks, while
+// it is streamed into the writer. Returns 0 for databases of version 1,
+// which can't store large objects (see lz_db_version()).
+lz_writer lz_writer_new(lz_db db);
+
+// Does nothing, if 'writer' is 0.
+void lz_writer_write(lz_writer writer, const void * data, size_t length);
+
+// Persists the large object and releases the writer. Large objects have no
+// references, but can be referenced by other objects and roots. Their
+// content is read with lz_obj_read_range(), lz_obj_sync() and lz_obj_async()
+// pass no payload. Returns 0, if 'writer' is 0.
+lz_obj lz_writer_finish(lz_writer writer);
+
 #pragma mark -
 #pragma mark Database Version
 
@@ -104,10 +237,14 @@ lz_root lz_db_root(lz_db db, const char * name);
 void lz_root_get_sync(lz_root root, void(^result_handler)(lz_obj obj));
 void lz_root_get_async(lz_root root, void(^result_handler)(lz_obj obj));
 
-void lz_root_set_sync(lz_root root, lz_obj obj, void(^result_handler)());
+// The handler is called on the queue of the root, after the other calls on
+// the root, which have been made before. It is not called, if the update
+// could not be synced (SYNC and GROUP durability). The synchronous functions
+// return 0 in this case.
+int lz_root_set_sync(lz_root root, lz_obj obj, void(^result_handler)());
 void lz_root_set_async(lz_root root, lz_obj obj, void(^result_handler)());
 
-void lz_root_del_sync(lz_root root, void(^result_handler)());
+int lz_root_del_sync(lz_root root, void(^result_handler)());
 void lz_root_del_async(lz_root root, void(^result_handler)());
 
 #endif // _LAZY_H_
@@ -27,47 +27,212 @@
 
 #include <Block.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#pragma mark -
+#pragma mark Reclamation
+
+// Handles with a retain count of 0 are not deallocated one by one. They are
+// put on a worklist, which is processed in batches by a worker on a serial
+// queue. If a dealloc function releases the last reference of another handle
+// (e.g., an object its references), the handle is added to the worklist
+// of the current thread instead of being dispatched again. Thus dropping a
+// large graph neither floods the global queue nor recurses.
+
+struct lazy_worklist_s {
+    struct lazy_base_s ** items;
+    size_t count;
+    size_t size;
+};
+
+static pthread_key_t lazy_reclaim_key;
+static pthread_once_t lazy_reclaim_once = PTHREAD_ONCE_INIT;
+
+static OSSpinLock lazy_reclaim_lock = OS_SPINLOCK_INIT;
+static struct lazy_worklist_s lazy_reclaim_pending = {0, 0, 0};
+static int lazy_reclaim_scheduled = 0;
+
+// only used on the reclaim queue
+static struct lazy_worklist_s lazy_reclaim_work = {0, 0, 0};
+
+static volatile size_t lazy_reclaim_batch_size = 4096;
+static volatile uint64_t lazy_reclaim_interval = 0;
+
+static void lazy_reclaim_init() {
+    int err = pthread_key_create(&lazy_reclaim_key, 0);
+    assert(err == 0);
+}
+
+static dispatch_queue_t lazy_reclaim_get_queue() {
+    static dispatch_queue_t queue = 0;
+    static dispatch_once_t predicate = 0;
+    dispatch_once(&predicate, ^{
+        queue = dispatch_queue_create(0, 0);
+    });
+    return queue;
+}
+
+static void lazy_worklist_reserve(struct lazy_worklist_s * list, size_t count) {
+    if (list->size < count) {
+        size_t size = list->size ? list->size : 1024;
+        while (size < count) {
+            size *= 2;
+        }
+        list->items = realloc(list->items, size * sizeof(struct lazy_base_s *));
+        assert(list->items);
+        list->size = size;
+    }
+}
+
+static void lazy_worklist_push(struct lazy_worklist_s * list, struct lazy_base_s * obj) {
+    lazy_worklist_reserve(list, list->count + 1);
+    list->items[list->count++] = obj;
+}
+
+static void lazy_worklist_drain(struct lazy_worklist_s * list, size_t limit) {
+    struct lazy_worklist_s * previous = pthread_getspecific(lazy_reclaim_key);
+    pthread_setspecific(lazy_reclaim_key, list);
+    for (size_t loop = 0; loop < limit && list->count > 0; loop++) {
+        struct lazy_base_s * obj = list->items[--(list->count)];
+        obj->dealloc(obj);
+    }
+    pthread_setspecific(lazy_reclaim_key, previous);
+}
+
+static void lazy_reclaim_run() {
+    
+    // take over the pending handles
+    OSSpinLockLock(&lazy_reclaim_lock);
+    if (lazy_reclaim_pending.count > 0) {
+        lazy_worklist_reserve(&lazy_reclaim_work, lazy_reclaim_work.count + lazy_reclaim_pending.count);
+        memcpy(lazy_reclaim_work.items + lazy_reclaim_work.count,
+               lazy_reclaim_pending.items,
+               lazy_reclaim_pending.count * sizeof(struct lazy_base_s *));
+        lazy_reclaim_work.count += lazy_reclaim_pending.count;
+        lazy_reclaim_pending.count = 0;
+    }
+    OSSpinLockUnlock(&lazy_reclaim_lock);
+    
+    lazy_worklist_drain(&lazy_reclaim_work, lazy_reclaim_batch_size);
+    
+    // schedule the next batch
+    OSSpinLockLock(&lazy_reclaim_lock);
+    int more = lazy_reclaim_work.count > 0 || lazy_reclaim_pending.count > 0;
+    if (!more) {
+        lazy_reclaim_scheduled = 0;
+    }
+    OSSpinLockUnlock(&lazy_reclaim_lock);
+    
+    if (more) {
+        uint64_t interval = lazy_reclaim_interval;
+        if (interval > 0) {
+            dispatch_group_enter(lazy_object_get_dispatch_group());
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, interval), lazy_reclaim_get_queue(), ^{
+                lazy_reclaim_run();
+                dispatch_group_leave(lazy_object_get_dispatch_group());
+            });
+        } else {
+            dispatch_group_async(lazy_object_get_dispatch_group(), lazy_reclaim_get_queue(), ^{
+                lazy_reclaim_run();
+            });
+        }
+    }
+}
+
+static void lazy_reclaim(struct lazy_base_s * obj) {
+    pthread_once(&lazy_reclaim_once, lazy_reclaim_init);
+    
+    // already reclaiming on this thread
+    struct lazy_worklist_s * active = pthread_getspecific(lazy_reclaim_key);
+    if (active) {
+        lazy_worklist_push(active, obj);
+        return;
+    }
+    
+    OSSpinLockLock(&lazy_reclaim_lock);
+    lazy_worklist_push(&lazy_reclaim_pending, obj);
+    int schedule = !lazy_reclaim_scheduled;
+    lazy_reclaim_scheduled = 1;
+    OSSpinLockUnlock(&lazy_reclaim_lock);
+    
+    if (schedule) {
+        dispatch_group_async(lazy_object_get_dispatch_group(), lazy_reclaim_get_queue(), ^{
+            lazy_reclaim_run();
+        });
+    }
+}
+
+void lz_reclaim_set_limit(size_t batch_size, uint64_t interval) {
+    lazy_reclaim_batch_size = batch_size > 0 ? batch_size : 1;
+    lazy_reclaim_interval = interval;
+}
 
 #pragma mark -
 #pragma mark Memory Management
 
+// The retain count is changed atomically on the calling thread. Handles are
+// deallocated by the reclaim worker (within the lazy object dispatch group).
+// The dealloc function also frees the memory of the handle.
+
 void * lz_retain(lz_base obj) {
     if (obj.base) {
-        dispatch_group_async(lazy_object_get_dispatch_group(), obj.base->queue, ^{
-            obj.base->rc++;
-            VERBOSE("<%i> Retain count increased.", obj);
-        });
+        OSAtomicIncrement32(&(obj.base->rc));
+        VERBOSE("<%i> Retain count increased.", obj);
     }
     return obj.base;
 }
 
+int lazy_base_try_retain(struct lazy_base_s * obj) {
+    int32_t rc;
+    do {
+        rc = obj->rc;
+        if (rc <= 0) {
+            return 0;
+        }
+    } while (!OSAtomicCompareAndSwap32Barrier(rc, rc + 1, &(obj->rc)));
+    VERBOSE("<%i> Retain count increased.", obj);
+    return 1;
+}
+
 void * lz_release(lz_base obj) {
     if (obj.base) {
-        dispatch_group_async(lazy_object_get_dispatch_group(), obj.base->queue, ^{
-            if (obj.base->rc > 1) {
-                obj.base->rc--;
-                VERBOSE("<%d> Retain count decreased.", obj);
-            } else {
-                VERBOSE("<%i> Retain count reaches 0.", obj);
-                dispatch_group_async(lazy_object_get_dispatch_group(), dispatch_get_global_queue(0, 0), ^{
-                    obj.base->dealloc();
-                    Block_release(obj.base->dealloc);
-                    dispatch_release(obj.base->queue);
-                    free(obj.base);
-                });
-            };
-        });
+        int32_t rc = OSAtomicDecrement32Barrier(&(obj.base->rc));
+        if (rc > 0) {
+            VERBOSE("<%d> Retain count decreased.", obj);
+        } else {
+            assert(rc == 0);
+            VERBOSE("<%i> Retain count reaches 0.", obj);
+            lazy_reclaim(obj.base);
+        }
     }
     return obj.base;
 }
 
+void lz_release_sync(lz_base obj) {
+    if (obj.base) {
+        int32_t rc = OSAtomicDecrement32Barrier(&(obj.base->rc));
+        if (rc > 0) {
+            VERBOSE("<%d> Retain count decreased.", obj);
+        } else {
+            assert(rc == 0);
+            VERBOSE("<%i> Retain count reaches 0, reclaiming synchronously.", obj);
+            pthread_once(&lazy_reclaim_once, lazy_reclaim_init);
+            
+            // reclaim everything which becomes unreferenced on this thread
+            struct lazy_worklist_s list = {0, 0, 0};
+            lazy_worklist_push(&list, obj.base);
+            lazy_worklist_drain(&list, SIZE_MAX);
+            free(list.items);
+        }
+    }
+}
+
 int lz_rc(lz_base obj) {
 	if (obj.base) {
-		__block int rc;
-		dispatch_sync(obj.base->queue, ^{
-			rc = obj.base->rc;
-		});
-		return rc;
+		return obj.base->rc;
 	} else {
 		return 0;
 	}
@@ -29,20 +29,23 @@
 #include <Block.h>
 #include <stdint.h>
 #include <uuid/uuid.h>
+#include <libkern/OSAtomic.h>
 
 #define RETAIN(obj) lz_retain((struct lazy_base_s *)obj)
 #define RELEASE(obj) lz_release((struct lazy_base_s *)obj)
 
-#define LAZY_BASE_HEAD dispatch_queue_t queue; \
-			           int rc; \
-                       void (^dealloc)();
+#define LAZY_BASE_HEAD void (*dealloc)(void * obj); \
+                       volatile int32_t rc;
 
-#define LAZY_BASE_INIT(obj, d) obj->queue = dispatch_queue_create(0, 0); \
-                               obj->rc = 1; \
-                               obj->dealloc = Block_copy(d);
+#define LAZY_BASE_INIT(obj, d) obj->dealloc = d; \
+                               obj->rc = 1;
 
 struct lazy_base_s {
     LAZY_BASE_HEAD
 };
 
+// Retains the handle only if its retain count has not reached 0 yet.
+// Returns 1 on success.
+int lazy_base_try_retain(struct lazy_base_s * obj);
+
 #endif // _LAZY_BASE_IMPL_H_
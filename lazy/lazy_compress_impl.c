@@ -0,0 +1,212 @@
+/*
+ *  lazy_compress_impl.c
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 02.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lazy_compress_impl.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define LAZY_COMPRESS_HASH_BITS 12
+#define LAZY_COMPRESS_MIN_MATCH 4
+#define LAZY_COMPRESS_MAX_OFFSET 65535
+
+// no match starts in the last 12 bytes and the last 5 bytes are literals
+#define LAZY_COMPRESS_MATCH_LIMIT 12
+#define LAZY_COMPRESS_LAST_LITERALS 5
+
+static inline uint32_t lazy_compress_read32(const unsigned char * p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(uint32_t));
+    return value;
+}
+
+static inline uint32_t lazy_compress_hash(uint32_t value) {
+    return (value * 2654435761U) >> (32 - LAZY_COMPRESS_HASH_BITS);
+}
+
+static inline unsigned char * lazy_compress_put_length(unsigned char * op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = length;
+    return op;
+}
+
+// Reads the extension of a length. Returns 0, if the input ends.
+static inline const unsigned char * lazy_compress_get_length(const unsigned char * ip, const unsigned char * end, size_t * length) {
+    unsigned char byte;
+    do {
+        if (ip >= end) {
+            return 0;
+        }
+        byte = *ip++;
+        *length += byte;
+    } while (byte == 255);
+    return ip;
+}
+
+#pragma mark -
+#pragma mark Compress
+
+size_t lazy_compress_bound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+// Writes a sequence. Returns 0, if it does not fit into the output.
+static unsigned char * lazy_compress_sequence(unsigned char * op,
+                                              unsigned char * op_end,
+                                              const unsigned char * literals,
+                                              size_t num_literals,
+                                              size_t offset,
+                                              size_t match_length) {
+    size_t needed = 1 + num_literals / 255 + 1 + num_literals + (offset ? 2 + match_length / 255 + 1 : 0);
+    if (needed > (size_t)(op_end - op)) {
+        return 0;
+    }
+    unsigned char * token = op++;
+    *token = (num_literals >= 15 ? 15 : num_literals) << 4;
+    if (num_literals >= 15) {
+        op = lazy_compress_put_length(op, num_literals - 15);
+    }
+    memcpy(op, literals, num_literals);
+    op += num_literals;
+    
+    if (offset) {
+        match_length -= LAZY_COMPRESS_MIN_MATCH;
+        *token |= match_length >= 15 ? 15 : match_length;
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        if (match_length >= 15) {
+            op = lazy_compress_put_length(op, match_length - 15);
+        }
+    }
+    return op;
+}
+
+size_t lazy_compress(const void * src, size_t length, void * dst, size_t capacity) {
+    const unsigned char * base = src;
+    const unsigned char * ip = base;
+    const unsigned char * anchor = base;
+    const unsigned char * end = base + length;
+    unsigned char * op = dst;
+    unsigned char * op_end = op + capacity;
+    
+    // positions of the last occurrences of 4 byte sequences
+    uint32_t table[1 << LAZY_COMPRESS_HASH_BITS];
+    memset(table, 0, sizeof(table));
+    
+    if (length > LAZY_COMPRESS_MATCH_LIMIT && length <= UINT32_MAX) {
+        const unsigned char * match_limit = end - LAZY_COMPRESS_MATCH_LIMIT;
+        const unsigned char * extend_limit = end - LAZY_COMPRESS_LAST_LITERALS;
+        while (ip < match_limit) {
+            uint32_t sequence = lazy_compress_read32(ip);
+            uint32_t hash = lazy_compress_hash(sequence);
+            const unsigned char * ref = base + table[hash];
+            table[hash] = ip - base;
+            
+            if (ref >= ip || ip - ref > LAZY_COMPRESS_MAX_OFFSET || lazy_compress_read32(ref) != sequence) {
+                // skip faster through data without matches
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            
+            const unsigned char * match_end = ip + LAZY_COMPRESS_MIN_MATCH;
+            ref += LAZY_COMPRESS_MIN_MATCH;
+            while (match_end < extend_limit && *match_end == *ref) {
+                match_end++;
+                ref++;
+            }
+            op = lazy_compress_sequence(op, op_end, anchor, ip - anchor, match_end - ref, match_end - ip);
+            if (!op) {
+                return 0;
+            }
+            ip = match_end;
+            anchor = ip;
+        }
+    }
+    
+    op = lazy_compress_sequence(op, op_end, anchor, end - anchor, 0, 0);
+    if (!op) {
+        return 0;
+    }
+    return op - (unsigned char *)dst;
+}
+
+#pragma mark -
+#pragma mark Decompress
+
+int lazy_decompress(const void * src, size_t length, void * dst, size_t raw_length) {
+    const unsigned char * ip = src;
+    const unsigned char * end = ip + length;
+    unsigned char * op = dst;
+    unsigned char * op_end = op + raw_length;
+    
+    while (ip < end) {
+        unsigned char token = *ip++;
+        
+        size_t num_literals = token >> 4;
+        if (num_literals == 15 && !(ip = lazy_compress_get_length(ip, end, &num_literals))) {
+            return -1;
+        }
+        if (num_literals > (size_t)(end - ip) || num_literals > (size_t)(op_end - op)) {
+            return -1;
+        }
+        memcpy(op, ip, num_literals);
+        op += num_literals;
+        ip += num_literals;
+        if (ip == end) {
+            // the last sequence has no match
+            break;
+        }
+        
+        if (end - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (unsigned char *)dst)) {
+            return -1;
+        }
+        size_t match_length = token & 15;
+        if (match_length == 15 && !(ip = lazy_compress_get_length(ip, end, &match_length))) {
+            return -1;
+        }
+        match_length += LAZY_COMPRESS_MIN_MATCH;
+        if (match_length > (size_t)(op_end - op)) {
+            return -1;
+        }
+        
+        const unsigned char * ref = op - offset;
+        if (offset >= match_length) {
+            memcpy(op, ref, match_length);
+            op += match_length;
+        } else {
+            // the match overlaps with the output (a repeated pattern)
+            while (match_length-- > 0) {
+                *op++ = *ref++;
+            }
+        }
+    }
+    return op == op_end ? 0 : -1;
+}
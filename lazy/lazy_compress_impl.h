@@ -0,0 +1,43 @@
+/*
+ *  lazy_compress_impl.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 02.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAZY_COMPRESS_IMPL_H_
+#define _LAZY_COMPRESS_IMPL_H_
+
+#include <stddef.h>
+
+// A fast LZ77 codec for payloads (the block format of LZ4: a sequence of
+// literals followed by a match of at least 4 bytes with a 16 bit offset).
+
+// Maximum length of the compressed data.
+size_t lazy_compress_bound(size_t length);
+
+// Compresses the data and returns the length of the compressed data or 0,
+// if it does not fit into 'capacity' bytes.
+size_t lazy_compress(const void * src, size_t length, void * dst, size_t capacity);
+
+// Decompresses exactly 'raw_length' bytes. Returns 0 on success and -1, if
+// the compressed data is not valid.
+int lazy_decompress(const void * src, size_t length, void * dst, size_t raw_length);
+
+#endif // _LAZY_COMPRESS_IMPL_H_
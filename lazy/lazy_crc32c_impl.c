@@ -0,0 +1,141 @@
+/*
+ *  lazy_crc32c_impl.c
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 07.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lazy_crc32c_impl.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LAZY_CRC32C_SSE42 1
+#include <cpuid.h>
+#include <nmmintrin.h>
+#endif
+
+// reversed polynomial of CRC32C
+#define LAZY_CRC32C_POLY 0x82F63B78
+
+static uint32_t lazy_crc32c_table[8][256];
+static uint32_t (*lazy_crc32c_impl)(uint32_t crc, const unsigned char * data, size_t length);
+static pthread_once_t lazy_crc32c_once = PTHREAD_ONCE_INIT;
+
+#pragma mark -
+#pragma mark Software (Slicing by 8)
+
+static uint32_t lazy_crc32c_sw(uint32_t crc, const unsigned char * data, size_t length) {
+    while (length > 0 && ((uintptr_t)data & 7)) {
+        crc = lazy_crc32c_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+        length--;
+    }
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, data, sizeof(uint32_t));
+        memcpy(&high, data + 4, sizeof(uint32_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        low = __builtin_bswap32(low);
+        high = __builtin_bswap32(high);
+#endif
+        low ^= crc;
+        crc = lazy_crc32c_table[7][low & 0xff] ^
+              lazy_crc32c_table[6][(low >> 8) & 0xff] ^
+              lazy_crc32c_table[5][(low >> 16) & 0xff] ^
+              lazy_crc32c_table[4][low >> 24] ^
+              lazy_crc32c_table[3][high & 0xff] ^
+              lazy_crc32c_table[2][(high >> 8) & 0xff] ^
+              lazy_crc32c_table[1][(high >> 16) & 0xff] ^
+              lazy_crc32c_table[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = lazy_crc32c_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#pragma mark -
+#pragma mark SSE 4.2
+
+#ifdef LAZY_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t lazy_crc32c_hw(uint32_t crc, const unsigned char * data, size_t length) {
+    while (length > 0 && ((uintptr_t)data & 7)) {
+        crc = _mm_crc32_u8(crc, *data++);
+        length--;
+    }
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        uint64_t value;
+        memcpy(&value, data, sizeof(uint64_t));
+        crc64 = _mm_crc32_u64(crc64, value);
+        data += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+#else
+    while (length >= 4) {
+        uint32_t value;
+        memcpy(&value, data, sizeof(uint32_t));
+        crc = _mm_crc32_u32(crc, value);
+        data += 4;
+        length -= 4;
+    }
+#endif
+    while (length-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+#pragma mark -
+#pragma mark Checksum
+
+static void lazy_crc32c_init() {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++) {
+            crc = crc & 1 ? (crc >> 1) ^ LAZY_CRC32C_POLY : crc >> 1;
+        }
+        lazy_crc32c_table[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            lazy_crc32c_table[k][n] = lazy_crc32c_table[0][lazy_crc32c_table[k - 1][n] & 0xff] ^ (lazy_crc32c_table[k - 1][n] >> 8);
+        }
+    }
+    
+    lazy_crc32c_impl = lazy_crc32c_sw;
+#ifdef LAZY_CRC32C_SSE42
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2)) {
+        lazy_crc32c_impl = lazy_crc32c_hw;
+    }
+#endif
+}
+
+uint32_t lazy_crc32c(uint32_t crc, const void * data, size_t length) {
+    pthread_once(&lazy_crc32c_once, lazy_crc32c_init);
+    return ~lazy_crc32c_impl(~crc, data, length);
+}
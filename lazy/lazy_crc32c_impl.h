@@ -0,0 +1,35 @@
+/*
+ *  lazy_crc32c_impl.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 07.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAZY_CRC32C_IMPL_H_
+#define _LAZY_CRC32C_IMPL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli) of the data, continuing the checksum 'crc' (0 for the
+// first block). Uses the crc32 instruction of SSE 4.2, if the processor
+// supports it, and a table driven implementation (slicing by 8) otherwise.
+uint32_t lazy_crc32c(uint32_t crc, const void * data, size_t length);
+
+#endif // _LAZY_CRC32C_IMPL_H_
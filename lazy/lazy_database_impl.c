@@ -25,6 +25,10 @@
 #include "lazy_logging_impl.h"
 #include "lazy_root_impl.h"
 #include "lazy_object_dispatch_group.h"
+#include "lazy_slab_impl.h"
+#include "lazy_compress_impl.h"
+#include "lazy_crc32c_impl.h"
+#include "lazy_varint_impl.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -35,6 +39,8 @@
 #include <assert.h>
 #include <sys/param.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
 #include <Block.h>
 
 // OS X only
@@ -43,6 +49,33 @@
 #pragma mark -
 #pragma mark Database Livecycle
 
+static void lazy_database_dealloc(void * ptr) {
+    struct lazy_database_s * db = ptr;
+    dispatch_release(db->write_queue);
+    dispatch_release(db->read_queue);
+    dispatch_release(db->commit_queue);
+    close(db->write_fd);
+    fclose(db->read_file);
+    pthread_mutex_destroy(&(db->commit_lock));
+    pthread_cond_destroy(&(db->commit_cond));
+    pthread_mutex_destroy(&(db->persist_lock));
+    pthread_cond_destroy(&(db->persist_cond));
+    pthread_mutex_destroy(&(db->sync_lock));
+    pthread_cond_destroy(&(db->sync_cond));
+    free(db->batch.data);
+    free(db->batch.extents);
+    free(db->flushing.data);
+    free(db->flushing.extents);
+    free(db->written);
+    RELEASE(db->mapping);
+    if (db->dedup) {
+        lazy_dedup_index_close(db->dedup);
+    }
+    lazy_root_table_close(db->roots);
+    lazy_object_map_destroy(&(db->objects));
+    free(db);
+}
+
 lz_db lz_db_open(const char * path) {
     
     char msg[1024];
@@ -73,7 +106,7 @@ lz_db lz_db_open(const char * path) {
     
     // create a database structure
     if (!exsits) {
-        INFO("Database does not exsist. Setting up default structure for version 1.");
+        INFO("Database does not exsist. Setting up default structure for version %d.", LAZY_DATABASE_VERSION);
         
         // create database folder
         if (mkdir(path, S_IRWXU)) {
@@ -87,55 +120,97 @@ lz_db lz_db_open(const char * path) {
         // create version info
         FILE * fd = fopen(filename, "w+");
         if (fd) {
-            fprintf(fd, "1");
+            fprintf(fd, "%d", LAZY_DATABASE_VERSION);
             fclose(fd);
-			version = 1;
+			version = LAZY_DATABASE_VERSION;
         } else {
             strerror_r(errno, msg, 1024);
             ERR("Could not create version info for database '%s': %s", path, msg);
             return 0;
         }
-        
-        // create index folder
-        snprintf(filename, MAXPATHLEN, "%s/index", path);
-        if (mkdir(filename, S_IRWXU)) {
-            strerror_r(errno, msg, 1024);
-            ERR("Could not create index folder for database '%s': %s", path, msg);
-            return 0;
-        }
     }
     
-    // open data file in append mode and
-    // set the file pointer to the begin of the file
+    // the roots are migrated from the index folder of older databases
+    struct lazy_root_table_s * roots = lazy_root_table_open(path);
+    if (!roots) {
+        ERR("Could not open the roots of database '%s'.", path);
+        return 0;
+    }
+    
+    // open data file for (positioned) writes and for reading
     snprintf(filename, MAXPATHLEN, "%s/data", path);
-    FILE * write_fd = fopen(filename, "a+");
-    assert(write_fd != NULL);
+    int write_fd = open(filename, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+    assert(write_fd >= 0);
     
     FILE * read_fd = fopen(filename, "r");
     assert(read_fd != NULL);
     
+    // new objects are appended at the end of the data file
+    struct stat data_stat;
+    int err = fstat(write_fd, &data_stat);
+    assert(err == 0);
+    
     // create handle
     struct lazy_database_s * db = malloc(sizeof(struct lazy_database_s));
     if (db) {
-        LAZY_BASE_INIT(db, ^{
-            dispatch_release(db->write_queue);
-            dispatch_release(db->read_queue);
-            fclose(write_fd);
-            fclose(read_fd);
-        });
+        LAZY_BASE_INIT(db, lazy_database_dealloc);
         db->version = version;
         strcpy(db->filename, path);
         
-        db->write_file = write_fd;
+        db->write_fd = write_fd;
         db->read_file = read_fd;
+        db->end_offset = data_stat.st_size;
         db->write_queue = dispatch_queue_create(NULL, NULL);
         db->read_queue = dispatch_queue_create(NULL, NULL);
+        db->commit_queue = dispatch_queue_create(NULL, NULL);
+        
+        pthread_mutex_init(&(db->commit_lock), 0);
+        pthread_cond_init(&(db->commit_cond), 0);
+        memset(&(db->batch), 0, sizeof(struct lazy_batch_s));
+        memset(&(db->flushing), 0, sizeof(struct lazy_batch_s));
+        db->batch.seq = 1;
+        db->written_seq = 0;
+        db->committing = 0;
+        db->commit_batch_size = LAZY_COMMIT_DEFAULT_BATCH_SIZE;
+        db->commit_delay = 0;
+        db->write_parallelism = sysconf(_SC_NPROCESSORS_ONLN);
+        pthread_mutex_init(&(db->persist_lock), 0);
+        pthread_cond_init(&(db->persist_cond), 0);
+        db->durability = LZ_DURABILITY_FLUSH;
+        db->compression = 0;
+        db->roots = roots;
+        db->dedup = 0;
+        db->checksums = 0;
+        db->verify_checksums = 1;
+        db->compression_threshold = LAZY_COMPRESSION_DEFAULT_THRESHOLD;
+        pthread_mutex_init(&(db->sync_lock), 0);
+        pthread_cond_init(&(db->sync_cond), 0);
+        db->sync_requested = 0;
+        db->sync_done = 0;
+        db->syncing = 0;
+        db->sync_failed = 0;
+        db->sync_pending = 0;
+        db->flushed_end = data_stat.st_size;
+        db->written = 0;
+        db->num_written = 0;
+        db->written_capacity = 0;
+        
+        db->use_mmap = 0;
+        db->mapping_lock = OS_SPINLOCK_INIT;
+        db->mapping = 0;
+        
+        lazy_object_map_init(&(db->objects));
+        db->cache_limit = 0;
+        db->cache_size = 0;
+        db->cache_evicting = 0;
+        db->cache_hand = 0;
         
         DBG("<%i> New database handle created.", db);
     } else {
         ERR("Could not allocate memory to create a new database handle.");
-        fclose(write_fd);
+        close(write_fd);
         fclose(read_fd);
+        lazy_root_table_close(roots);
     }
     return db;
 }
@@ -148,150 +223,2089 @@ int lz_db_version(lz_db db) {
 }
 
 #pragma mark -
-#pragma mark Read & Write Objects
+#pragma mark Record Format
 
-lz_obj lazy_database_read_object(lz_db db,
-                                 object_id_t id) {
+static size_t lazy_record_header_length(lz_db db) {
+    if (db->version >= 2) {
+        return sizeof(struct lazy_record_header_s);
+    } else {
+        return sizeof(uint16_t) + sizeof(uint32_t);
+    }
+}
+
+// Decodes the header of a record and returns the offset of the references
+// in the record (or 0, if the header is not valid). A valid record ends in
+// front of 'end' (the end of the data file).
+static size_t lazy_record_decode_header(lz_db db,
+                                        const char * bytes,
+                                        object_id_t id,
+                                        uint64_t end,
+                                        uint16_t * num_ref,
+                                        size_t * refs_size,
+                                        uint32_t * payload_length,
+                                        uint16_t * flags,
+                                        uint32_t * checksum) {
+    uint64_t max_length = end > id ? end - id : 0;
+    if (db->version >= 2) {
+        struct lazy_record_header_s header;
+        memcpy(&header, bytes, sizeof(struct lazy_record_header_s));
+        size_t offset = sizeof(struct lazy_record_header_s) + (header.flags & LAZY_RECORD_CHECKSUM ? sizeof(uint32_t) : 0);
+        uint64_t length = offset + sizeof(object_id_t) * header.num_ref + (uint64_t)header.payload_length;
+        if (db->version >= 3) {
+            // between 1 and LAZY_VARINT_MAX_LENGTH bytes per reference
+            uint64_t min_length = offset + header.num_ref + (uint64_t)header.payload_length;
+            length = min_length + (LAZY_VARINT_MAX_LENGTH - 1) * header.num_ref;
+            if (header.length < min_length || header.length > length) {
+                ERR("Invalid header of record %llu (record length: %u; expected: %llu - %llu).", id, header.length, min_length, length);
+                return 0;
+            }
+            length = header.length;
+        } else if (header.length != length) {
+            ERR("Invalid header of record %llu (record length: %u; expected: %llu).", id, header.length, length);
+            return 0;
+        }
+        if (length > max_length) {
+            ERR("Invalid header of record %llu (record length: %llu; end of data: %llu).", id, length, end);
+            return 0;
+        }
+        *num_ref = header.num_ref;
+        *refs_size = length - offset - header.payload_length;
+        *payload_length = header.payload_length;
+        *flags = header.flags;
+        *checksum = 0;
+        if (header.flags & LAZY_RECORD_CHECKSUM) {
+            memcpy(checksum, bytes + sizeof(struct lazy_record_header_s), sizeof(uint32_t));
+        }
+        return offset;
+    } else {
+        memcpy(num_ref, bytes, sizeof(uint16_t));
+        memcpy(payload_length, bytes + sizeof(uint16_t), sizeof(uint32_t));
+        *flags = 0;
+        *checksum = 0;
+        *refs_size = sizeof(object_id_t) * (*num_ref);
+        size_t offset = sizeof(uint16_t) + sizeof(uint32_t);
+        uint64_t length = offset + sizeof(object_id_t) * (*num_ref) + (uint64_t)(*payload_length);
+        if (length > max_length) {
+            ERR("Invalid header of record %llu (record length: %llu; end of data: %llu).", id, length, end);
+            return 0;
+        }
+        return offset;
+    }
+}
+
+// The size of the stored references of the object at the position 'oid'
+// (an upper bound, if the position is unknown).
+static size_t lazy_record_refs_size(lz_db db, lz_obj obj, object_id_t oid) {
+    if (db->version >= 3 && oid == OBJECT_ID_UNKNOWN) {
+        return LAZY_VARINT_MAX_LENGTH * obj->num_references;
+    } else if (db->version >= 3) {
+        return lazy_refs_encoded_length(oid, obj->reference_ids, obj->num_references);
+    } else {
+        return sizeof(object_id_t) * obj->num_references;
+    }
+}
+
+static size_t lazy_record_encode_refs(lz_db db, lz_obj obj, object_id_t oid, char * bytes) {
+    if (db->version >= 3) {
+        return lazy_refs_encode(oid, obj->reference_ids, obj->num_references, bytes);
+    } else {
+        memcpy(bytes, obj->reference_ids, sizeof(object_id_t) * obj->num_references);
+        return sizeof(object_id_t) * obj->num_references;
+    }
+}
+
+static int lazy_record_decode_refs(lz_db db, object_id_t id, const char * bytes, size_t refs_size, object_id_t * refs, uint16_t num_ref) {
+    if (db->version >= 3) {
+        if (!lazy_refs_decode(id, bytes, refs_size, refs, num_ref)) {
+            ERR("<%i> Invalid references of record %llu.", db, id);
+            return 0;
+        }
+    } else {
+        memcpy(refs, bytes, refs_size);
+    }
+    return 1;
+}
+
+// Creates the object of a record, whose references are decoded into the
+// object. The payload belongs to the object, even if the references are
+// not valid.
+static lz_obj lazy_record_unmarshal(lz_db db,
+                                    object_id_t id,
+                                    void * data,
+                                    uint32_t data_size,
+                                    lz_base owner,
+                                    uint16_t num_ref,
+                                    uint16_t flags,
+                                    const char * refs,
+                                    size_t refs_size) {
+    lz_obj obj = lz_obj_unmarshal(db, id, data, data_size, owner, num_ref, 0);
+    if (!obj) {
+        return 0;
+    }
+    if (!lazy_record_decode_refs(db, id, refs, refs_size, obj->reference_ids, num_ref)) {
+        lz_release(obj);
+        return 0;
+    }
+    if (flags & LAZY_RECORD_LARGE) {
+        if (!lazy_large_valid(db, id, data, data_size)) {
+            lz_release(obj);
+            return 0;
+        }
+        obj->flags |= LAZY_OBJECT_LARGE;
+    }
+    return obj;
+}
+
+#pragma mark -
+#pragma mark Record Checksums
+
+void lz_db_set_checksums(lz_db db, int enabled) {
+    db->checksums = enabled;
+}
+
+void lz_db_set_verify(lz_db db, int enabled) {
+    db->verify_checksums = enabled;
+}
+
+void lz_db_set_root_history(lz_db db, uint32_t num_ids) {
+    db->roots->history = num_ids;
+}
+
+static uint32_t lazy_record_checksum(const char * header,
+                                     const void * refs,
+                                     size_t refs_size,
+                                     const void * payload,
+                                     size_t payload_length) {
+    uint32_t crc = lazy_crc32c(0, header, sizeof(struct lazy_record_header_s));
+    crc = lazy_crc32c(crc, refs, refs_size);
+    return lazy_crc32c(crc, payload, payload_length);
+}
+
+// Checks the checksum of a record (if it has one). The references and the
+// payload don't have to follow the header in memory.
+static int lazy_record_verify(lz_db db,
+                              object_id_t id,
+                              const char * header,
+                              uint16_t flags,
+                              uint32_t checksum,
+                              const void * refs,
+                              size_t refs_size,
+                              const void * payload,
+                              size_t payload_length) {
+    if (!(flags & LAZY_RECORD_CHECKSUM)) {
+        return 1;
+    }
+    uint32_t crc = lazy_record_checksum(header, refs, refs_size, payload, payload_length);
+    if (crc != checksum) {
+        ERR("<%i> Checksum of record %llu does not match (%08x; expected: %08x).", db, id, crc, checksum);
+        return 0;
+    }
+    return 1;
+}
+
+#pragma mark -
+#pragma mark Payload Compression
+
+void lz_db_set_compression(lz_db db, int enabled, uint32_t threshold) {
+    db->compression = enabled;
+    db->compression_threshold = threshold;
+}
+
+// The payload of a record, as it is stored in the data file.
+struct lazy_record_payload_s {
+    const void * data;
+    uint32_t length;
+    uint16_t flags;
+    void * buffer;
+};
+
+// Compresses the payload of the object, if compression is enabled for the
+// database or the object and if it saves at least 1/8 of the payload. The
+// description of a large object is not compressed.
+static void lazy_record_payload_init(lz_db db, lz_obj obj, struct lazy_record_payload_s * payload) {
+    payload->data = obj->payload_data;
+    payload->length = obj->payload_length;
+    payload->flags = db->checksums && db->version >= 2 ? LAZY_RECORD_CHECKSUM : 0;
+    payload->buffer = 0;
+    if (obj->flags & LAZY_OBJECT_LARGE) {
+        payload->flags |= LAZY_RECORD_LARGE;
+        return;
+    }
     
-    int offset = 0;
+    int enabled = obj->flags & LAZY_OBJECT_COMPRESS || (db->compression && !(obj->flags & LAZY_OBJECT_NO_COMPRESS));
+    if (!enabled || db->version < 2 || obj->payload_length < db->compression_threshold || obj->payload_length < 16) {
+        return;
+    }
     
-    // get the number of references for this object
-    uint16_t num_ref;
-    assert(pread(fileno(db->read_file), &num_ref, sizeof(uint16_t), id + offset) == sizeof(uint16_t));
-    offset = sizeof(uint16_t);
+    size_t capacity = obj->payload_length - obj->payload_length / 8 - sizeof(uint32_t);
+    char * buffer = malloc(sizeof(uint32_t) + capacity);
+    assert(buffer);
+    size_t length = lazy_compress(obj->payload_data, obj->payload_length, buffer + sizeof(uint32_t), capacity);
+    if (length == 0) {
+        free(buffer);
+        return;
+    }
+    memcpy(buffer, &(obj->payload_length), sizeof(uint32_t));
+    payload->data = buffer;
+    payload->length = sizeof(uint32_t) + length;
+    payload->flags |= LAZY_RECORD_COMPRESSED;
+    payload->buffer = buffer;
+}
+
+static void lazy_record_payload_destroy(struct lazy_record_payload_s * payload) {
+    free(payload->buffer);
+    payload->buffer = 0;
+}
+
+// Returns a copy of the stored payload (decompressed, if necessary), which
+// is released with free(), or 0 if the payload is not valid.
+static void * lazy_record_payload_decode(lz_db db,
+                                         object_id_t id,
+                                         uint16_t flags,
+                                         const char * stored,
+                                         uint32_t stored_length,
+                                         uint32_t * length) {
+    if (!(flags & LAZY_RECORD_COMPRESSED)) {
+        void * data = malloc(stored_length > 0 ? stored_length : 1);
+        assert(data);
+        memcpy(data, stored, stored_length);
+        *length = stored_length;
+        return data;
+    }
     
-    // read the size of the payload
-    uint32_t data_size;
-    assert(pread(fileno(db->read_file), &data_size, sizeof(uint32_t), id + offset) == sizeof(uint32_t));
-    offset += sizeof(uint32_t);
+    uint32_t raw_length;
+    if (stored_length < sizeof(uint32_t)) {
+        ERR("<%i> Invalid compressed payload of record %llu.", db, id);
+        return 0;
+    }
+    memcpy(&raw_length, stored, sizeof(uint32_t));
+    if (raw_length > (uint64_t)(stored_length - sizeof(uint32_t)) * 255 + 16) {
+        ERR("<%i> Invalid compressed payload of record %llu (length: %u).", db, id, raw_length);
+        return 0;
+    }
+    void * data = malloc(raw_length > 0 ? raw_length : 1);
+    assert(data);
+    if (lazy_decompress(stored + sizeof(uint32_t), stored_length - sizeof(uint32_t), data, raw_length) != 0) {
+        ERR("<%i> Could not decompress the payload of record %llu.", db, id);
+        free(data);
+        return 0;
+    }
+    *length = raw_length;
+    return data;
+}
+
+#pragma mark -
+#pragma mark Group Commit
+
+void lz_db_set_group_commit(lz_db db, size_t batch_size, uint64_t delay) {
+    pthread_mutex_lock(&(db->commit_lock));
+    db->commit_batch_size = batch_size > 0 ? batch_size : 1;
+    db->commit_delay = delay;
+    pthread_mutex_unlock(&(db->commit_lock));
+}
+
+// The length of the record of the object at the position 'oid'.
+static size_t lazy_record_length(lz_db db, lz_obj obj, struct lazy_record_payload_s * payload, object_id_t oid) {
+    uint64_t length = lazy_record_header_length(db) + lazy_record_refs_size(db, obj, oid) + (uint64_t)payload->length;
+    if (payload->flags & LAZY_RECORD_CHECKSUM) {
+        length += sizeof(uint32_t);
+    }
+    if (length > UINT32_MAX) {
+        ERR("Object is too large (%llu bytes).", length);
+        assert(0);
+    }
+    return length;
+}
+
+// Encodes the header and the references of a record with the given length
+// at the position 'oid'. Returns the offset of the payload.
+static size_t lazy_record_encode_head(lz_db db, lz_obj obj, struct lazy_record_payload_s * payload, object_id_t oid, char * bytes, size_t length) {
+    size_t offset = 0;
+    if (db->version >= 2) {
+        struct lazy_record_header_s header;
+        header.length = length;
+        header.payload_length = payload->length;
+        header.num_ref = obj->num_references;
+        header.flags = payload->flags;
+        memcpy(bytes, &header, sizeof(struct lazy_record_header_s));
+        offset = sizeof(struct lazy_record_header_s);
+        if (payload->flags & LAZY_RECORD_CHECKSUM) {
+            size_t refs_offset = offset + sizeof(uint32_t);
+            size_t refs_size = lazy_record_encode_refs(db, obj, oid, bytes + refs_offset);
+            uint32_t checksum = lazy_record_checksum(bytes,
+                                                     bytes + refs_offset,
+                                                     refs_size,
+                                                     payload->data,
+                                                     payload->length);
+            memcpy(bytes + offset, &checksum, sizeof(uint32_t));
+            return refs_offset + refs_size;
+        }
+    } else {
+        memcpy(bytes, &(obj->num_references), sizeof(uint16_t));
+        memcpy(bytes + sizeof(uint16_t), &(obj->payload_length), sizeof(uint32_t));
+        offset = sizeof(uint16_t) + sizeof(uint32_t);
+    }
+    return offset + lazy_record_encode_refs(db, obj, oid, bytes + offset);
+}
+
+static void lazy_record_encode(lz_db db, lz_obj obj, struct lazy_record_payload_s * payload, object_id_t oid, char * bytes, size_t length) {
+    size_t offset = lazy_record_encode_head(db, obj, payload, oid, bytes, length);
+    memcpy(bytes + offset, payload->data, payload->length);
+}
+
+static void lazy_database_pwrite(lz_db db, const char * bytes, size_t length, object_id_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(db->write_fd, bytes, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            char msg[1024];
+            strerror_r(errno, msg, 1024);
+            ERR("<%i> Could not write %lu bytes at offset %llu: %s", db, length, offset, msg);
+            assert(0);
+            return;
+        }
+        bytes += written;
+        length -= written;
+        offset += written;
+    }
+}
+
+// Reserves the space for a record at the end of the data file.
+static object_id_t lazy_database_reserve(lz_db db, size_t length) {
+    return OSAtomicAdd64Barrier(length, &(db->end_offset)) - length;
+}
+
+// Reserves the space for the record of the object. Since version 3, the
+// length of the record depends on its position. It is computed again, if
+// an other record has been reserved in the meantime.
+static object_id_t lazy_database_reserve_record(lz_db db, lz_obj obj, struct lazy_record_payload_s * payload, size_t * length) {
+    if (db->version < 3) {
+        *length = lazy_record_length(db, obj, payload, 0);
+        return lazy_database_reserve(db, *length);
+    }
+    object_id_t oid;
+    do {
+        oid = db->end_offset;
+        *length = lazy_record_length(db, obj, payload, oid);
+    } while (!OSAtomicCompareAndSwap64Barrier(oid, oid + *length, &(db->end_offset)));
+    return oid;
+}
+
+// Marks the range as written and moves the watermark forward, if all
+// records in front of it have been written. The commit lock has to be held.
+static void lazy_database_range_written(lz_db db, object_id_t offset, size_t length) {
+    if (offset != db->flushed_end) {
+        // insert the range in order
+        if (db->num_written == db->written_capacity) {
+            db->written_capacity = db->written_capacity ? db->written_capacity * 2 : 16;
+            db->written = realloc(db->written, sizeof(struct lazy_extent_s) * db->written_capacity);
+            assert(db->written);
+        }
+        size_t pos = db->num_written;
+        while (pos > 0 && db->written[pos - 1].offset > offset) {
+            db->written[pos] = db->written[pos - 1];
+            pos--;
+        }
+        db->written[pos].offset = offset;
+        db->written[pos].length = length;
+        db->num_written++;
+        return;
+    }
     
-    // read the references from the file
-    object_id_t refs[num_ref];
-    if (num_ref > 0) {
-        int bytes_read = pread(fileno(db->read_file), &refs, sizeof(object_id_t) * num_ref, id + offset);
-        assert(bytes_read == sizeof(object_id_t) * num_ref);
-        assert(refs);
-        offset += sizeof(object_id_t) * num_ref;
+    object_id_t end = offset + length;
+    size_t num_merged = 0;
+    while (num_merged < db->num_written && db->written[num_merged].offset == end) {
+        end += db->written[num_merged].length;
+        num_merged++;
+    }
+    memmove(db->written, db->written + num_merged, sizeof(struct lazy_extent_s) * (db->num_written - num_merged));
+    db->num_written -= num_merged;
+    db->flushed_end = end;
+    if (db->dedup) {
+        lazy_dedup_index_written(db->dedup, end);
+    }
+}
+
+// Waits (as leader) for more records, until the batch is full or the delay
+// is over. The commit lock has to be held.
+static void lazy_database_wait_for_batch(lz_db db) {
+    if (db->commit_delay == 0 || db->batch.length >= db->commit_batch_size) {
+        return;
+    }
+    struct timeval now;
+    gettimeofday(&now, 0);
+    uint64_t deadline = (uint64_t)now.tv_sec * NSEC_PER_SEC + (uint64_t)now.tv_usec * NSEC_PER_USEC + db->commit_delay;
+    struct timespec ts;
+    ts.tv_sec = deadline / NSEC_PER_SEC;
+    ts.tv_nsec = deadline % NSEC_PER_SEC;
+    while (db->batch.length < db->commit_batch_size) {
+        if (pthread_cond_timedwait(&(db->commit_cond), &(db->commit_lock), &ts) == ETIMEDOUT) {
+            break;
+        }
+    }
+}
+
+// Appends a record to the batch. Records which follow each other in the
+// data file share an extent. The commit lock has to be held.
+static void lazy_batch_append(lz_db db, struct lazy_batch_s * batch, lz_obj obj, struct lazy_record_payload_s * payload, object_id_t oid, size_t length) {
+    if (batch->length + length > batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity : LAZY_COMMIT_DEFAULT_BATCH_SIZE;
+        while (capacity < batch->length + length) {
+            capacity *= 2;
+        }
+        batch->data = realloc(batch->data, capacity);
+        assert(batch->data);
+        batch->capacity = capacity;
     }
+    lazy_record_encode(db, obj, payload, oid, batch->data + batch->length, length);
+    batch->length += length;
     
-    // allocate memory for the payload and read it from the file
-    void * data = malloc(data_size);
-    assert(data);
-    pread(fileno(db->read_file), data, data_size, id + offset);
+    struct lazy_extent_s * last = batch->num_extents ? &(batch->extents[batch->num_extents - 1]) : 0;
+    if (last && last->offset + last->length == oid) {
+        last->length += length;
+    } else {
+        if (batch->num_extents == batch->extents_capacity) {
+            batch->extents_capacity = batch->extents_capacity ? batch->extents_capacity * 2 : 16;
+            batch->extents = realloc(batch->extents, sizeof(struct lazy_extent_s) * batch->extents_capacity);
+            assert(batch->extents);
+        }
+        batch->extents[batch->num_extents].offset = oid;
+        batch->extents[batch->num_extents].length = length;
+        batch->num_extents++;
+    }
+}
+
+// Writes the record at the reserved offset, without copying the payload.
+static void lazy_database_pwrite_record(lz_db db, lz_obj obj, struct lazy_record_payload_s * payload, object_id_t oid, size_t length) {
+    size_t head_length = length - payload->length;
+    char * head = malloc(head_length);
+    assert(head);
+    lazy_record_encode_head(db, obj, payload, oid, head, length);
+    lazy_database_pwrite(db, head, head_length, oid);
+    lazy_database_pwrite(db, payload->data, payload->length, oid + head_length);
+    free(head);
+}
+
+// Writes a large record directly to the data file, without copying the
+// payload. Other records are written at the same time.
+static object_id_t lazy_database_write_direct(lz_db db,
+                                              lz_obj obj,
+                                              struct lazy_record_payload_s * payload) {
+    size_t length;
+    object_id_t oid = lazy_database_reserve_record(db, obj, payload, &length);
+    lazy_database_pwrite_record(db, obj, payload, oid, length);
     
-    return lz_obj_unmarshal(db,
-                            id,
-                            data,
-                            data_size,
-                            ^{free(data);},
-                            num_ref, refs);
+    pthread_mutex_lock(&(db->commit_lock));
+    lazy_database_range_written(db, oid, length);
+    pthread_mutex_unlock(&(db->commit_lock));
+    return oid;
 }
 
-object_id_t lazy_database_write_object(lz_db db,
-                                       lz_obj obj) {
-    __block object_id_t result;
-    dispatch_semaphore_wait(obj->write_lock, DISPATCH_TIME_FOREVER);
-    if (obj->is_temp) {
-        // OPTIMIZE: Run parallel
-        dispatch_apply(obj->num_references, dispatch_get_global_queue(0, 0), ^(size_t i) {
-            obj->reference_ids[i] = lazy_database_write_object(db, obj->reference_objs[i]);
-        });
-        dispatch_sync(db->write_queue, ^{
-            // get the position in the file as the object id
-            object_id_t oid = ftell(db->write_file);
-            
-            // write number of references
-            if (fwrite(&(obj->num_references), sizeof(uint16_t), 1, db->write_file) == 0) {
-                ERR("Could not write number of references to file.");
-                assert(0);
-            }
-            
-            // write payload length
-            if(fwrite(&(obj->payload_length), sizeof(uint32_t), 1, db->write_file) == 0) {
-                ERR("Could not write payload length to file.");
-                assert(0);
-            }
-            
-            // write references
-            if (obj->num_references > 0) {
-                if(fwrite(obj->reference_ids, sizeof(object_id_t), obj->num_references, db->write_file) == 0) {
-                    ERR("Could not write references to file.");
-                    assert(0);
+// Writes the current batch (as leader). The commit lock has to be held, it
+// is released while the batch is written.
+static void lazy_database_flush_batch(lz_db db) {
+    db->committing = 1;
+    lazy_database_wait_for_batch(db);
+    
+    struct lazy_batch_s flushing = db->batch;
+    db->batch = db->flushing;
+    db->batch.length = 0;
+    db->batch.num_extents = 0;
+    db->batch.seq = flushing.seq + 1;
+    db->flushing = flushing;
+    pthread_mutex_unlock(&(db->commit_lock));
+    
+    VERBOSE("<%i> Writing batch of %lu bytes in %lu extents.", db, flushing.length, flushing.num_extents);
+    size_t pos = 0;
+    for (size_t loop = 0; loop < flushing.num_extents; loop++) {
+        lazy_database_pwrite(db, flushing.data + pos, flushing.extents[loop].length, flushing.extents[loop].offset);
+        pos += flushing.extents[loop].length;
+    }
+    
+    pthread_mutex_lock(&(db->commit_lock));
+    for (size_t loop = 0; loop < flushing.num_extents; loop++) {
+        lazy_database_range_written(db, flushing.extents[loop].offset, flushing.extents[loop].length);
+    }
+    db->written_seq = flushing.seq;
+    db->committing = 0;
+    pthread_cond_broadcast(&(db->commit_cond));
+}
+
+// Appends the record of the object to the current batch (or writes it
+// directly) without waiting for the batch. A full batch is written by the
+// thread which fills it, unless an other thread is writing one.
+static object_id_t lazy_database_append_record(lz_db db,
+                                               lz_obj obj) {
+    struct lazy_record_payload_s payload;
+    lazy_record_payload_init(db, obj, &payload);
+    if (lazy_record_length(db, obj, &payload, db->end_offset) >= LAZY_COMMIT_DIRECT_THRESHOLD) {
+        object_id_t oid = lazy_database_write_direct(db, obj, &payload);
+        lazy_record_payload_destroy(&payload);
+        return oid;
+    }
+    
+    pthread_mutex_lock(&(db->commit_lock));
+    size_t length;
+    object_id_t oid = lazy_database_reserve_record(db, obj, &payload, &length);
+    lazy_batch_append(db, &(db->batch), obj, &payload, oid, length);
+    if (db->batch.length >= db->commit_batch_size) {
+        if (db->committing) {
+            // wake up a leader waiting for a full batch
+            pthread_cond_broadcast(&(db->commit_cond));
+        } else {
+            lazy_database_flush_batch(db);
+        }
+    }
+    pthread_mutex_unlock(&(db->commit_lock));
+    lazy_record_payload_destroy(&payload);
+    return oid;
+}
+
+void lazy_database_commit(lz_db db) {
+    pthread_mutex_lock(&(db->commit_lock));
+    uint64_t seq = db->batch.num_extents > 0 ? db->batch.seq : db->batch.seq - 1;
+    while (db->written_seq < seq) {
+        if (db->committing) {
+            pthread_cond_wait(&(db->commit_cond), &(db->commit_lock));
+        } else {
+            lazy_database_flush_batch(db);
+        }
+    }
+    pthread_mutex_unlock(&(db->commit_lock));
+}
+
+// Records, which have not been written yet, are read from the batches.
+static lz_obj lazy_database_read_batched_object(lz_db db,
+                                                object_id_t id) {
+    lz_obj obj = 0;
+    pthread_mutex_lock(&(db->commit_lock));
+    struct lazy_batch_s * batches[2] = {&(db->flushing), &(db->batch)};
+    for (int loop = 0; loop < 2 && !obj; loop++) {
+        struct lazy_batch_s * batch = batches[loop];
+        size_t pos = 0;
+        for (size_t i = 0; i < batch->num_extents; i++) {
+            struct lazy_extent_s * extent = &(batch->extents[i]);
+            if (id >= extent->offset && id < extent->offset + extent->length) {
+                char * record = batch->data + pos + (id - extent->offset);
+                uint16_t num_ref;
+                size_t refs_size;
+                uint32_t data_size;
+                uint16_t flags;
+                uint32_t checksum;
+                size_t offset = lazy_record_decode_header(db, record, id, extent->offset + extent->length, &num_ref, &refs_size, &data_size, &flags, &checksum);
+                void * data = 0;
+                if (offset &&
+                    (!db->verify_checksums ||
+                     lazy_record_verify(db, id, record, flags, checksum, record + offset, refs_size, record + offset + refs_size, data_size))) {
+                    data = lazy_record_payload_decode(db, id, flags, record + offset + refs_size, data_size, &data_size);
                 }
+                if (data) {
+                    obj = lazy_record_unmarshal(db,
+                                                id,
+                                                data,
+                                                data_size,
+                                                0, // payload is released with free()
+                                                num_ref,
+                                                flags,
+                                                record + offset,
+                                                refs_size);
+                }
+                break;
             }
-            
-            // write payload
-            if(fwrite(obj->payload_data, 1, obj->payload_length, db->write_file) == 0) {
-                ERR("Could not write payload to file.");
-                assert(0);
-            }
-            
-            obj->is_temp = 0;
-            obj->oid = oid;
-            result = oid;
-            fflush(db->write_file);
-        });
-    } else {
-        result = obj->oid;
+            pos += extent->length;
+        }
     }
-    dispatch_semaphore_signal(obj->write_lock);
-    return result;
+    pthread_mutex_unlock(&(db->commit_lock));
+    return obj;
 }
 
 #pragma mark -
-#pragma mark Access Root Handle
+#pragma mark Durability
 
-lz_root lz_db_root(lz_db db, const char * name) {
-    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
-    char digest_str[CC_SHA1_DIGEST_LENGTH * 2 + 1];
-    object_id_t root_id;
-    int root_is_bound;
-    FILE * fd;
-    char msg[1024];
-    char filename[MAXPATHLEN];
-    int exsits = 0;
-	
-    // sha1(name)
-    CC_SHA1(name, strlen(name), digest);
-    // OPTIMIZE: find a better way to convert the digest to a string
-    snprintf(digest_str,
-			 CC_SHA1_DIGEST_LENGTH * 2 + 1,
-			 "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-			 digest[0],digest[1],digest[2],digest[3],digest[4],digest[5],digest[6],digest[7],digest[8],digest[9],digest[10],digest[11],digest[12],digest[13],digest[14],digest[15],digest[16],digest[17],digest[18],digest[19]);
-	
-    // read root obj
-    snprintf(filename, MAXPATHLEN, "%s/index/%s", db->filename, digest_str);
-    fd = fopen(filename, "a+");
-    if (!fd) {
+void lz_db_set_durability(lz_db db, lz_durability durability) {
+    db->durability = durability;
+}
+
+int lazy_fsync(int fd) {
+#ifdef F_FULLFSYNC
+    // fsync() on OS X doesn't flush the write cache of the disk
+    if (fcntl(fd, F_FULLFSYNC) == 0) {
+        return 1;
+    }
+#endif
+    if (fsync(fd)) {
+        char msg[1024];
         strerror_r(errno, msg, 1024);
-        ERR("Could not read root object '%s' (%s): %s", name, digest_str, msg);
+        ERR("Could not sync file: %s", msg);
         return 0;
     }
-	
-    // read last root object
-    if (ftell(fd) == 0) {
-        root_is_bound = 0;
-    } else {
-        fseek(fd, -1 * sizeof(object_id_t), SEEK_END);
-        int objects_read = fread(&root_id, sizeof(object_id_t), 1, fd);
-        assert(objects_read == 1);
+    return 1;
+}
+
+int lazy_database_sync_data(lz_db db) {
+    pthread_mutex_lock(&(db->sync_lock));
+    uint64_t ticket = ++(db->sync_requested);
+    while (db->sync_done < ticket) {
+        if (db->syncing) {
+            pthread_cond_wait(&(db->sync_cond), &(db->sync_lock));
+            continue;
+        }
         
-        if (root_id == OBJECT_ID_UNKNOWN) {
-            root_is_bound = 0;
-        } else {
-            root_is_bound = 1;
+        // this sync covers all requests up to now
+        uint64_t target = db->sync_requested;
+        db->syncing = 1;
+        pthread_mutex_unlock(&(db->sync_lock));
+        
+        int synced = lazy_fsync(db->write_fd);
+        
+        pthread_mutex_lock(&(db->sync_lock));
+        if (!synced) {
+            // the pages which could not be written may have been dropped
+            db->sync_failed = 1;
         }
+        db->sync_done = target;
+        db->syncing = 0;
+        pthread_cond_broadcast(&(db->sync_cond));
+    }
+    int synced = !db->sync_failed;
+    pthread_mutex_unlock(&(db->sync_lock));
+    return synced;
+}
+
+// Syncs the data file once, stores the roots in the order of the updates
+// and syncs the journal of the root table once. The handlers are called on
+// the queues of their roots, not on the write queue, since they could
+// update roots themselves.
+static void lazy_database_sync_pending(lz_db db) {
+    pthread_mutex_lock(&(db->sync_lock));
+    struct lazy_sync_request_s * pending = db->sync_pending;
+    db->sync_pending = 0;
+    pthread_mutex_unlock(&(db->sync_lock));
+    
+    if (!pending) {
+        return;
     }
     
-    struct lazy_root_s * root = malloc(sizeof(struct lazy_root_s));
-    if (root) {
-        LAZY_BASE_INIT(root, ^{
-            lz_release(root->root_obj);
-            lz_release(root->database);
-            fclose(root->file);
+    struct lazy_sync_request_s * requests = 0;
+    while (pending) {
+        struct lazy_sync_request_s * next = pending->next;
+        pending->next = requests;
+        requests = pending;
+        pending = next;
+    }
+    
+    // the roots must not point to data which is not on the disk
+    int synced = lazy_database_sync_data(db);
+    if (synced) {
+        for (struct lazy_sync_request_s * r = requests; r; r = r->next) {
+            lazy_root_table_set(db->roots, r->root->digest, r->oid);
+        }
+        synced = lazy_root_table_sync(db->roots);
+    }
+    if (synced) {
+        DBG("<%i> Synced root updates.", db);
+    } else {
+        ERR("<%i> Could not sync root updates.", db);
+    }
+    
+    while (requests) {
+        struct lazy_sync_request_s * request = requests;
+        requests = request->next;
+        dispatch_group_async(lazy_object_get_dispatch_group(), request->root->queue, ^{
+            request->handler(synced);
+            Block_release(request->handler);
+            RELEASE(request->root);
+            free(request);
         });
-		strcpy(root->filename, filename);
-        root->file = fd;
+    }
+}
+
+void lazy_database_sync_root(lz_db db, struct lazy_root_s * root, object_id_t oid, void(^handler)(int synced)) {
+    struct lazy_sync_request_s * request = malloc(sizeof(struct lazy_sync_request_s));
+    assert(request);
+    request->root = RETAIN(root);
+    request->oid = oid;
+    request->handler = Block_copy(handler);
+    
+    pthread_mutex_lock(&(db->sync_lock));
+    request->next = db->sync_pending;
+    db->sync_pending = request;
+    pthread_mutex_unlock(&(db->sync_lock));
+    
+    // requests which arrive while the worker syncs are handled by the next block
+    lz_retain(db);
+    dispatch_group_async(lazy_object_get_dispatch_group(), db->write_queue, ^{
+        lazy_database_sync_pending(db);
+        lz_release(db);
+    });
+}
+
+#pragma mark -
+#pragma mark Memory Mapped Read
+
+void lz_db_set_mmap(lz_db db, int enabled) {
+    db->use_mmap = enabled;
+}
+
+// the first mapping has at least this size, the size is doubled if needed
+#define LAZY_MAPPING_MIN_LENGTH (1024 * 1024)
+
+static void lazy_mapping_dealloc(void * ptr) {
+    struct lazy_mapping_s * mapping = ptr;
+    munmap(mapping->data, mapping->length);
+    free(mapping);
+}
+
+// Returns a (retained) mapping of the data file which covers at least the
+// first 'end' bytes. The mapping may be larger than the file. This is safe,
+// because only records which are already in the file are accessed and the
+// file only grows.
+static struct lazy_mapping_s * lazy_database_get_mapping(lz_db db, uint64_t end) {
+    struct lazy_mapping_s * mapping;
+    
+    OSSpinLockLock(&(db->mapping_lock));
+    mapping = db->mapping;
+    if (mapping && mapping->length >= end) {
+        RETAIN(mapping);
+        OSSpinLockUnlock(&(db->mapping_lock));
+        return mapping;
+    }
+    OSSpinLockUnlock(&(db->mapping_lock));
+    
+    uint64_t length = LAZY_MAPPING_MIN_LENGTH;
+    while (length < end) {
+        length *= 2;
+    }
+    if (length > SIZE_MAX) {
+        return 0;
+    }
+    
+    void * data = mmap(0, length, PROT_READ, MAP_SHARED, fileno(db->read_file), 0);
+    if (data == MAP_FAILED) {
+        char msg[1024];
+        strerror_r(errno, msg, 1024);
+        WARNING("Could not map %llu bytes of the data file: %s", length, msg);
+        return 0;
+    }
+    
+    mapping = malloc(sizeof(struct lazy_mapping_s));
+    assert(mapping);
+    LAZY_BASE_INIT(mapping, lazy_mapping_dealloc);
+    mapping->data = data;
+    mapping->length = length;
+    
+    // replace the mapping of the database, if it is still the smaller one
+    struct lazy_mapping_s * old = 0;
+    OSSpinLockLock(&(db->mapping_lock));
+    if (db->mapping && db->mapping->length >= length) {
+        old = mapping;
+        mapping = db->mapping;
+    } else {
+        old = db->mapping;
+        db->mapping = mapping;
+    }
+    RETAIN(mapping);
+    OSSpinLockUnlock(&(db->mapping_lock));
+    
+    RELEASE(old);
+    return mapping;
+}
+
+// Only records in front of the watermark are read from the mapping: pages
+// behind the end of the file can't be accessed. Returns 0 otherwise, the
+// record is read with pread() then.
+static lz_obj lazy_database_read_mapped_object(lz_db db,
+                                               object_id_t id) {
+    uint64_t flushed_end = db->flushed_end;
+    if (id > flushed_end || flushed_end - id < lazy_record_header_length(db)) {
+        return 0;
+    }
+    
+    // the header and the checksum
+    struct lazy_mapping_s * mapping = lazy_database_get_mapping(db, id + lazy_record_header_length(db) + sizeof(uint32_t));
+    if (!mapping) {
+        return 0;
+    }
+    
+    uint16_t num_ref;
+    size_t refs_size;
+    uint32_t data_size;
+    uint16_t flags;
+    uint32_t checksum;
+    uint64_t offset = lazy_record_decode_header(db, (char *)mapping->data + id, id, flushed_end, &num_ref, &refs_size, &data_size, &flags, &checksum);
+    if (!offset) {
+        RELEASE(mapping);
+        return 0;
+    }
+    uint64_t end = id + offset + refs_size + data_size;
+    if (mapping->length < end) {
+        RELEASE(mapping);
+        mapping = lazy_database_get_mapping(db, end);
+        if (!mapping) {
+            return 0;
+        }
+    }
+    
+    // the references are copied, the payload stays in the mapping (unless
+    // it is compressed)
+    char * record = (char *)mapping->data + id;
+    void * data = record + offset + refs_size;
+    struct lazy_base_s * owner = (struct lazy_base_s *)mapping;
+    
+    // the record ends in front of the watermark (see above)
+    if (db->verify_checksums &&
+        !lazy_record_verify(db, id, record, flags, checksum, record + offset, refs_size, data, data_size)) {
+        RELEASE(mapping);
+        return 0;
+    }
+    if (flags & LAZY_RECORD_COMPRESSED) {
+        data = lazy_record_payload_decode(db, id, flags, data, data_size, &data_size);
+        owner = 0;
+        if (!data) {
+            RELEASE(mapping);
+            return 0;
+        }
+    }
+    lz_obj obj = lazy_record_unmarshal(db,
+                                       id,
+                                       data,
+                                       data_size,
+                                       owner,
+                                       num_ref,
+                                       flags,
+                                       record + offset,
+                                       refs_size);
+    RELEASE(mapping);
+    return obj;
+}
+
+#pragma mark -
+#pragma mark Cache
+
+void lz_db_set_cache_limit(lz_db db, uint64_t max_bytes) {
+    db->cache_limit = max_bytes;
+}
+
+uint64_t lz_db_cache_size(lz_db db) {
+    return db->cache_size > 0 ? db->cache_size : 0;
+}
+
+// Evicts objects in the order of a CLOCK: the hand walks over the stripes
+// of the identity map. Objects which have been used since the last round
+// get a second chance.
+
+#define LAZY_CACHE_MAX_ROUNDS 2
+
+static uint64_t lazy_database_evict_stripe(lz_db db, struct lazy_object_map_stripe_s * stripe) {
+    uint64_t evicted = 0;
+    
+    // collect the (retained) objects of the stripe
+    pthread_mutex_lock(&(stripe->lock));
+    size_t count = 0;
+    lz_obj * objs = malloc(sizeof(lz_obj) * (stripe->count > 0 ? stripe->count : 1));
+    assert(objs);
+    for (size_t loop = 0; loop < stripe->size; loop++) {
+        lz_obj obj = stripe->entries[loop].obj;
+        if (obj && obj != LAZY_OBJECT_MAP_PENDING && lazy_base_try_retain((struct lazy_base_s *)obj)) {
+            objs[count++] = obj;
+        }
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+    
+    for (size_t loop = 0; loop < count; loop++) {
+        lz_obj obj = objs[loop];
+        if (db->cache_size > (int64_t)db->cache_limit) {
+            if (obj->referenced) {
+                obj->referenced = 0;
+            } else if (pthread_mutex_trylock(&(obj->write_lock)) == 0) {
+                evicted += lazy_object_evict(obj);
+                pthread_mutex_unlock(&(obj->write_lock));
+            }
+        }
+        lz_release(obj);
+    }
+    free(objs);
+    return evicted;
+}
+
+static uint64_t lazy_database_evict(lz_db db) {
+    uint64_t evicted = 0;
+    int num_stripes = LAZY_OBJECT_MAP_NUM_STRIPES * LAZY_CACHE_MAX_ROUNDS;
+    while (num_stripes-- > 0 && db->cache_limit && db->cache_size > (int64_t)db->cache_limit) {
+        struct lazy_object_map_stripe_s * stripe = &(db->objects.stripes[db->cache_hand]);
+        db->cache_hand = (db->cache_hand + 1) % LAZY_OBJECT_MAP_NUM_STRIPES;
+        evicted += lazy_database_evict_stripe(db, stripe);
+    }
+    DBG("<%i> Cache size after eviction: %lld bytes.", db, db->cache_size);
+    return evicted;
+}
+
+uint64_t lazy_database_trim_cache(lz_db db) {
+    if (!OSAtomicCompareAndSwap32Barrier(0, 1, &(db->cache_evicting))) {
+        return 0;
+    }
+    uint64_t evicted = 0;
+    uint64_t round;
+    do {
+        round = lazy_database_evict(db);
+        evicted += round;
+    } while (round > 0 && db->cache_size > (int64_t)db->cache_limit);
+    OSAtomicCompareAndSwap32Barrier(1, 0, &(db->cache_evicting));
+    return evicted;
+}
+
+// Counts the payload of a resident object and starts to evict objects in
+// the background, if the cache limit is exceeded. Only payloads owned by
+// the library are cached; the payload of an object created by the
+// application belongs to it until the object is deallocated.
+static void lazy_database_cache_add(lz_db db, lz_obj obj) {
+    if (!(obj->flags & LAZY_OBJECT_FREE_PAYLOAD) && !obj->payload_owner) {
+        return;
+    }
+    obj->flags |= LAZY_OBJECT_CACHED;
+    int64_t size = OSAtomicAdd64Barrier(obj->payload_length, &(db->cache_size));
+    
+    if (db->cache_limit && size > (int64_t)db->cache_limit &&
+        OSAtomicCompareAndSwap32Barrier(0, 1, &(db->cache_evicting))) {
+        lz_retain(db);
+        dispatch_group_async(lazy_object_get_dispatch_group(), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+            // objects added during the last round don't start a new worker
+            uint64_t evicted;
+            do {
+                evicted = lazy_database_evict(db);
+                OSAtomicCompareAndSwap32Barrier(1, 0, &(db->cache_evicting));
+            } while (evicted > 0 && db->cache_size > (int64_t)db->cache_limit &&
+                     OSAtomicCompareAndSwap32Barrier(0, 1, &(db->cache_evicting)));
+            lz_release(db);
+        });
+    }
+}
+
+#pragma mark -
+#pragma mark Read & Write Objects
+
+// Most records of version 2 are read with a single call to pread(). Only if
+// a record is larger than the read ahead, the rest is read afterwards.
+#define LAZY_RECORD_READ_AHEAD 4096
+
+static lz_obj lazy_database_read_record(lz_db db,
+                                        object_id_t id) {
+    
+    int fd = fileno(db->read_file);
+    char buffer[LAZY_RECORD_READ_AHEAD];
+    
+    ssize_t bytes_read = pread(fd, buffer, LAZY_RECORD_READ_AHEAD, id);
+    if (bytes_read < (ssize_t)sizeof(struct lazy_record_header_s)) {
+        ERR("Could not read the header of record %llu.", id);
+        return 0;
+    }
+    
+    uint16_t num_ref;
+    size_t refs_size;
+    uint32_t data_size;
+    uint16_t flags;
+    uint32_t checksum;
+    size_t offset = lazy_record_decode_header(db, buffer, id, db->end_offset, &num_ref, &refs_size, &data_size, &flags, &checksum);
+    if (!offset || offset > bytes_read) {
+        return 0;
+    }
+    size_t available = bytes_read;
+    
+    // references
+    char * refs = buffer + offset;
+    char * refs_buffer = 0;
+    if (offset + refs_size > available) {
+        // the references don't fit into the read ahead
+        size_t part = available - offset;
+        refs_buffer = malloc(refs_size);
+        assert(refs_buffer);
+        memcpy(refs_buffer, buffer + offset, part);
+        if (pread(fd, refs_buffer + part, refs_size - part, id + available) != refs_size - part) {
+            ERR("Could not read the references of record %llu.", id);
+            free(refs_buffer);
+            return 0;
+        }
+        refs = refs_buffer;
+        available = offset + refs_size;
+    }
+    offset += refs_size;
+    
+    // payload
+    void * data = malloc(data_size > 0 ? data_size : 1);
+    assert(data);
+    size_t part = available - offset;
+    if (part > data_size) {
+        part = data_size;
+    }
+    memcpy(data, buffer + offset, part);
+    if (part < data_size) {
+        if (pread(fd, (char *)data + part, data_size - part, id + offset + part) != data_size - part) {
+            ERR("Could not read the payload of record %llu.", id);
+            free(refs_buffer);
+            free(data);
+            return 0;
+        }
+    }
+    if (db->verify_checksums &&
+        !lazy_record_verify(db, id, buffer, flags, checksum, refs, refs_size, data, data_size)) {
+        free(refs_buffer);
+        free(data);
+        return 0;
+    }
+    if (flags & LAZY_RECORD_COMPRESSED) {
+        void * stored = data;
+        data = lazy_record_payload_decode(db, id, flags, stored, data_size, &data_size);
+        free(stored);
+        if (!data) {
+            free(refs_buffer);
+            return 0;
+        }
+    }
+    
+    lz_obj obj = lazy_record_unmarshal(db,
+                                       id,
+                                       data,
+                                       data_size,
+                                       0, // payload is released with free()
+                                       num_ref,
+                                       flags,
+                                       refs,
+                                       refs_size);
+    free(refs_buffer);
+    return obj;
+}
+
+static lz_obj lazy_database_read_record_v1(lz_db db,
+                                           object_id_t id) {
+    
+    int fd = fileno(db->read_file);
+    int offset = 0;
+    
+    // get the number of references for this object
+    uint16_t num_ref;
+    if (pread(fd, &num_ref, sizeof(uint16_t), id + offset) != sizeof(uint16_t)) {
+        ERR("Could not read the number of references of record %llu.", id);
+        return 0;
+    }
+    offset = sizeof(uint16_t);
+    
+    // read the size of the payload
+    uint32_t data_size;
+    if (pread(fd, &data_size, sizeof(uint32_t), id + offset) != sizeof(uint32_t)) {
+        ERR("Could not read the payload length of record %llu.", id);
+        return 0;
+    }
+    offset += sizeof(uint32_t);
+    
+    // read the references from the file
+    object_id_t refs[num_ref > 0 ? num_ref : 1];
+    if (num_ref > 0) {
+        int bytes_read = pread(fd, &refs, sizeof(object_id_t) * num_ref, id + offset);
+        if (bytes_read != sizeof(object_id_t) * num_ref) {
+            ERR("Could not read the references of record %llu.", id);
+            return 0;
+        }
+        offset += sizeof(object_id_t) * num_ref;
+    }
+    
+    // allocate memory for the payload and read it from the file
+    void * data = malloc(data_size > 0 ? data_size : 1);
+    assert(data);
+    if (pread(fd, data, data_size, id + offset) != data_size) {
+        ERR("Could not read the payload of record %llu.", id);
+        free(data);
+        return 0;
+    }
+    
+    return lz_obj_unmarshal(db,
+                            id,
+                            data,
+                            data_size,
+                            0, // payload is released with free()
+                            num_ref,
+                            refs);
+}
+
+static lz_obj lazy_database_fault_object(lz_db db,
+                                         object_id_t id) {
+    if (id >= db->flushed_end) {
+        lz_obj obj = lazy_database_read_batched_object(db, id);
+        if (obj) {
+            return obj;
+        }
+    }
+    
+    if (db->use_mmap) {
+        lz_obj obj = lazy_database_read_mapped_object(db, id);
+        if (obj) {
+            return obj;
+        }
+        // fall back to pread()
+    }
+    
+    if (db->version >= 2) {
+        return lazy_database_read_record(db, id);
+    } else {
+        return lazy_database_read_record_v1(db, id);
+    }
+}
+
+// Each object id is represented by at most one resident object. If the
+// object is not resident, it is read from the data file by the first
+// thread asking for it. Other threads wait for this read.
+
+lz_obj lazy_database_read_object(lz_db db,
+                                 object_id_t id) {
+    lz_obj obj = lazy_object_map_reserve(&(db->objects), id);
+    if (obj) {
+        VERBOSE("<%i> Object <%i> with id %llu is resident.", db, obj, id);
+        return obj;
+    }
+    
+    obj = lazy_database_fault_object(db, id);
+    if (obj) {
+        lazy_database_cache_add(db, obj);
+        lz_obj resident = lazy_object_map_add(&(db->objects), obj);
+        if (resident != obj) {
+            lz_release_sync(obj);
+            obj = resident;
+        }
+    } else {
+        lazy_object_map_cancel(&(db->objects), id);
+    }
+    return obj;
+}
+
+void lazy_database_reload_payload(lz_db db, lz_obj obj) {
+    DBG("<%i> Reading evicted payload of object <%i>.", db, obj);
+    
+    // read the record into a temporary object and take over its payload
+    lz_obj tmp = lazy_database_fault_object(db, obj->oid);
+    if (!tmp) {
+        ERR("<%i> Could not read the evicted payload of object <%i>.", db, obj);
+        return;
+    }
+    obj->payload_data = tmp->payload_data;
+    obj->payload_owner = tmp->payload_owner;
+    obj->flags = (obj->flags & ~LAZY_OBJECT_EVICTED) | (tmp->flags & LAZY_OBJECT_FREE_PAYLOAD);
+    tmp->payload_data = 0;
+    tmp->payload_owner = 0;
+    tmp->flags = 0;
+    lz_release_sync(tmp);
+    
+    lazy_database_cache_add(db, obj);
+}
+
+#pragma mark -
+#pragma mark Scrub
+
+// Checks a record of the mapped data file.
+static int lazy_database_check_record(lz_db db, const char * data, object_id_t id, uint64_t end) {
+    const char * record = data + id;
+    uint16_t num_ref;
+    size_t refs_size;
+    uint32_t data_size;
+    uint16_t flags;
+    uint32_t checksum;
+    size_t offset = lazy_record_decode_header(db, record, id, end, &num_ref, &refs_size, &data_size, &flags, &checksum);
+    if (!offset) {
+        return 0;
+    }
+    const char * payload = record + offset + refs_size;
+    if (!lazy_record_verify(db, id, record, flags, checksum, record + offset, refs_size, payload, data_size)) {
+        return 0;
+    }
+    object_id_t * refs = malloc(sizeof(object_id_t) * (num_ref > 0 ? num_ref : 1));
+    assert(refs);
+    int valid = lazy_record_decode_refs(db, id, record + offset, refs_size, refs, num_ref);
+    for (int loop = 0; loop < num_ref && valid; loop++) {
+        if (refs[loop] >= end) {
+            ERR("<%i> Reference %d of record %llu points behind the end of the data file.", db, loop, id);
+            valid = 0;
+        }
+    }
+    free(refs);
+    if (!valid) {
+        return 0;
+    }
+    if (flags & LAZY_RECORD_COMPRESSED) {
+        void * decoded = lazy_record_payload_decode(db, id, flags, payload, data_size, &data_size);
+        if (!decoded) {
+            return 0;
+        }
+        free(decoded);
+    }
+    if (flags & LAZY_RECORD_LARGE) {
+        if (!lazy_large_valid(db, id, payload, data_size)) {
+            return 0;
+        }
+        struct lazy_large_s large;
+        memcpy(&large, payload, sizeof(struct lazy_large_s));
+        uint64_t num_chunks = (data_size - sizeof(struct lazy_large_s)) / sizeof(object_id_t);
+        for (uint64_t loop = 0; loop < num_chunks; loop++) {
+            object_id_t chunk;
+            memcpy(&chunk, payload + sizeof(struct lazy_large_s) + sizeof(object_id_t) * loop, sizeof(object_id_t));
+            if (chunk >= end) {
+                ERR("<%i> Chunk %llu of the large object %llu points behind the end of the data file.", db, loop, id);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int64_t lz_db_scrub(lz_db db, void(^handler)(uint64_t offset)) {
+    lazy_database_commit(db);
+    uint64_t end = db->flushed_end;
+    if (end == 0) {
+        return 0;
+    }
+    
+    const char * data = mmap(0, end, PROT_READ, MAP_SHARED, fileno(db->read_file), 0);
+    if (data == MAP_FAILED) {
+        char msg[1024];
+        strerror_r(errno, msg, 1024);
+        ERR("<%i> Could not map the data file: %s", db, msg);
+        return -1;
+    }
+    
+    // find the records (the headers are read sequentially)
+    size_t num_records = 0, capacity = 1024;
+    object_id_t * records = malloc(sizeof(object_id_t) * capacity);
+    assert(records);
+    volatile int64_t num_invalid = 0;
+    object_id_t pos = 0;
+    while (pos < end) {
+        uint16_t num_ref;
+        size_t refs_size;
+        uint32_t data_size;
+        uint16_t flags;
+        uint32_t checksum;
+        size_t offset = 0;
+        if (end - pos >= lazy_record_header_length(db)) {
+            offset = lazy_record_decode_header(db, data + pos, pos, end, &num_ref, &refs_size, &data_size, &flags, &checksum);
+        }
+        if (!offset) {
+            // the following records can't be found
+            ERR("<%i> Scrub stopped at the invalid record %llu (%llu bytes not checked).", db, pos, end - pos);
+            num_invalid++;
+            if (handler) {
+                handler(pos);
+            }
+            break;
+        }
+        if (num_records == capacity) {
+            capacity *= 2;
+            records = realloc(records, sizeof(object_id_t) * capacity);
+            assert(records);
+        }
+        records[num_records++] = pos;
+        pos += offset + refs_size + data_size;
+    }
+    
+    // check the records on all processors
+    volatile int64_t * invalid = &num_invalid;
+    size_t stripes = sysconf(_SC_NPROCESSORS_ONLN);
+    dispatch_apply(stripes, dispatch_get_global_queue(0, 0), ^(size_t stripe){
+        size_t first = num_records * stripe / stripes;
+        size_t last = num_records * (stripe + 1) / stripes;
+        for (size_t loop = first; loop < last; loop++) {
+            if (!lazy_database_check_record(db, data, records[loop], end)) {
+                OSAtomicIncrement64Barrier(invalid);
+                if (handler) {
+                    handler(records[loop]);
+                }
+            }
+        }
+    });
+    INFO("<%i> Scrub checked %lu records, %lld are invalid.", db, num_records, num_invalid);
+    
+    free(records);
+    munmap((void *)data, end);
+    return num_invalid;
+}
+
+#pragma mark -
+#pragma mark Write Objects
+
+void lz_db_set_write_parallelism(lz_db db, long num_writers) {
+    db->write_parallelism = num_writers > 0 ? num_writers : 1;
+}
+
+void lz_db_set_dedup(lz_db db, int enabled) {
+    if (enabled && !db->dedup) {
+        if (db->version < 2) {
+            ERR("<%i> Deduplication needs a database of version 2 or later.", db);
+            return;
+        }
+        char filename[MAXPATHLEN];
+        snprintf(filename, MAXPATHLEN, "%s/dedup", db->filename);
+        
+        // an entry is only used, if its record had been written, when the
+        // index was opened, and has the digest of the entry
+        lazy_database_commit(db);
+        db->dedup = lazy_dedup_index_open(filename, db->flushed_end, ^(const unsigned char * digest, object_id_t oid){
+            lz_obj obj = lazy_database_fault_object(db, oid);
+            if (!obj) {
+                return 0;
+            }
+            unsigned char record_digest[LAZY_DEDUP_DIGEST_LENGTH];
+            lazy_dedup_digest(obj, record_digest);
+            lz_release_sync(obj);
+            return memcmp(digest, record_digest, LAZY_DEDUP_DIGEST_LENGTH) == 0;
+        });
+    } else if (!enabled && db->dedup) {
+        lazy_dedup_index_close(db->dedup);
+        db->dedup = 0;
+    }
+}
+
+// Objects are claimed by a writer by setting 'is_temp' to the id of the
+// writer. The writer only visits objects it has claimed, persisted objects
+// and objects of other writers are skipped without locking. While an object
+// is claimed, its oid is used to store its height (longest path to a leaf
+// of the claimed subgraph).
+
+static volatile int32_t lazy_writer_id = 1;
+
+// Returns a new writer id. The counter wraps around, 0 (persisted) and 1
+// (temporary, not claimed) are skipped.
+static int32_t lazy_writer_new_id() {
+    int32_t writer;
+    do {
+        writer = OSAtomicIncrement32Barrier(&lazy_writer_id);
+    } while (writer == 0 || writer == 1);
+    return writer;
+}
+
+struct lazy_write_frame_s {
+    lz_obj obj;
+    uint16_t next;
+};
+
+static inline int lazy_object_claim(lz_obj obj, int32_t writer) {
+    return OSAtomicCompareAndSwap32Barrier(1, writer, (volatile int32_t *)&(obj->is_temp));
+}
+
+static inline int lazy_object_is_ready(lz_obj obj) {
+    for (int loop = 0; loop < obj->num_references; loop++) {
+        if (obj->reference_objs[loop]->is_temp) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Wakes up writers waiting for objects of this writer.
+static void lazy_database_signal_persisted(lz_db db) {
+    pthread_mutex_lock(&(db->persist_lock));
+    pthread_cond_broadcast(&(db->persist_cond));
+    pthread_mutex_unlock(&(db->persist_lock));
+}
+
+// Adds a persisted object to the identity map. With deduplication, an other
+// object with the same id could be resident already.
+static void lazy_database_map_persisted(lz_db db, lz_obj obj) {
+    lz_obj resident = lazy_object_map_add(&(db->objects), obj);
+    if (resident != obj) {
+        lz_release(resident);
+    }
+}
+
+// Appends the record of a claimed object, whose references are persisted.
+// With deduplication, the id of an equal record is used instead.
+static void lazy_database_persist(lz_db db, lz_obj obj) {
+    for (int loop = 0; loop < obj->num_references; loop++) {
+        obj->reference_ids[loop] = obj->reference_objs[loop]->oid;
+    }
+    
+    // the position in the file is the object id
+    object_id_t oid;
+    if (db->dedup) {
+        unsigned char digest[LAZY_DEDUP_DIGEST_LENGTH];
+        lazy_dedup_digest(obj, digest);
+        if (!lazy_dedup_index_lookup(db->dedup, digest, &oid)) {
+            oid = lazy_database_append_record(db, obj);
+            lazy_dedup_index_insert(db->dedup, digest, oid);
+            
+            // the record could have been written already
+            lazy_dedup_index_written(db->dedup, db->flushed_end);
+        }
+    } else {
+        oid = lazy_database_append_record(db, obj);
+    }
+    
+    pthread_mutex_lock(&(obj->write_lock));
+    obj->oid = oid;
+    obj->database = lz_retain(db);
+    lazy_database_cache_add(db, obj);
+    OSMemoryBarrier();
+    obj->is_temp = 0;
+    pthread_mutex_unlock(&(obj->write_lock));
+    
+    lazy_database_map_persisted(db, obj);
+}
+
+// Collects the objects claimed by the writer in post order (depth first,
+// without recursion). Returns the number of objects and their max height.
+static size_t lazy_database_claim_graph(lz_obj root, int32_t writer, lz_obj ** result, uint64_t * max_height) {
+    size_t num_objs = 0, objs_capacity = 64;
+    lz_obj * objs = malloc(sizeof(lz_obj) * objs_capacity);
+    size_t depth = 0, stack_capacity = 64;
+    struct lazy_write_frame_s * stack = malloc(sizeof(struct lazy_write_frame_s) * stack_capacity);
+    assert(objs && stack);
+    
+    *max_height = 0;
+    root->oid = 0;
+    stack[depth].obj = root;
+    stack[depth].next = 0;
+    depth++;
+    
+    while (depth > 0) {
+        struct lazy_write_frame_s * frame = &(stack[depth - 1]);
+        if (frame->next < frame->obj->num_references) {
+            lz_obj child = frame->obj->reference_objs[frame->next++];
+            if (child->is_temp && lazy_object_claim(child, writer)) {
+                if (depth == stack_capacity) {
+                    stack_capacity *= 2;
+                    stack = realloc(stack, sizeof(struct lazy_write_frame_s) * stack_capacity);
+                    assert(stack);
+                }
+                child->oid = 0;
+                stack[depth].obj = child;
+                stack[depth].next = 0;
+                depth++;
+            }
+        } else {
+            lz_obj obj = frame->obj;
+            depth--;
+            
+            uint64_t height = 0;
+            for (int loop = 0; loop < obj->num_references; loop++) {
+                lz_obj child = obj->reference_objs[loop];
+                if (child->is_temp == writer && child->oid + 1 > height) {
+                    height = child->oid + 1;
+                }
+            }
+            obj->oid = height;
+            if (height > *max_height) {
+                *max_height = height;
+            }
+            
+            if (num_objs == objs_capacity) {
+                objs_capacity *= 2;
+                objs = realloc(objs, sizeof(lz_obj) * objs_capacity);
+                assert(objs);
+            }
+            objs[num_objs++] = obj;
+        }
+    }
+    
+    free(stack);
+    *result = objs;
+    return num_objs;
+}
+
+// Writes the claimed objects level by level (leaves first). The objects of
+// a level are written by up to 'write_parallelism' threads. Objects which
+// wait for objects of other writers are written at the end.
+static void lazy_database_write_claimed(lz_db db, lz_obj * objs, size_t num_objs, uint64_t max_height) {
+    // sort by height
+    size_t * level_start = calloc(max_height + 2, sizeof(size_t));
+    lz_obj * sorted = malloc(sizeof(lz_obj) * num_objs);
+    lz_obj * blocked = malloc(sizeof(lz_obj) * num_objs);
+    assert(level_start && sorted && blocked);
+    for (size_t loop = 0; loop < num_objs; loop++) {
+        level_start[objs[loop]->oid + 1]++;
+    }
+    for (uint64_t level = 1; level <= max_height + 1; level++) {
+        level_start[level] += level_start[level - 1];
+    }
+    for (size_t loop = 0; loop < num_objs; loop++) {
+        sorted[level_start[objs[loop]->oid]++] = objs[loop];
+    }
+    
+    volatile int32_t num_blocked = 0;
+    volatile int32_t * next_blocked = &num_blocked;
+    size_t start = 0;
+    for (uint64_t level = 0; level <= max_height; level++) {
+        size_t end = level_start[level];
+        size_t count = end - start;
+        size_t stripes = count < db->write_parallelism ? count : db->write_parallelism;
+        
+        void(^write_stripe)(size_t) = ^(size_t stripe) {
+            for (size_t loop = start + stripe; loop < end; loop += stripes) {
+                if (lazy_object_is_ready(sorted[loop])) {
+                    lazy_database_persist(db, sorted[loop]);
+                } else {
+                    blocked[OSAtomicIncrement32Barrier(next_blocked) - 1] = sorted[loop];
+                }
+            }
+        };
+        if (stripes > 1) {
+            dispatch_apply(stripes, dispatch_get_global_queue(0, 0), write_stripe);
+        } else {
+            write_stripe(0);
+        }
+        lazy_database_signal_persisted(db);
+        start = end;
+    }
+    
+    // objects with references to objects of other writers
+    while (num_blocked > 0) {
+        int32_t remaining = 0;
+        for (int32_t loop = 0; loop < num_blocked; loop++) {
+            if (lazy_object_is_ready(blocked[loop])) {
+                lazy_database_persist(db, blocked[loop]);
+            } else {
+                blocked[remaining++] = blocked[loop];
+            }
+        }
+        if (remaining == num_blocked) {
+            // wait for an other writer, unless it was faster
+            pthread_mutex_lock(&(db->persist_lock));
+            int ready = 0;
+            for (int32_t loop = 0; loop < remaining && !ready; loop++) {
+                ready = lazy_object_is_ready(blocked[loop]);
+            }
+            if (!ready) {
+                pthread_cond_wait(&(db->persist_cond), &(db->persist_lock));
+            }
+            pthread_mutex_unlock(&(db->persist_lock));
+        } else {
+            lazy_database_signal_persisted(db);
+        }
+        num_blocked = remaining;
+    }
+    
+    free(level_start);
+    free(sorted);
+    free(blocked);
+}
+
+object_id_t lazy_database_write_graph(lz_db db,
+                                      lz_obj obj) {
+    if (obj->is_temp) {
+        int32_t writer = lazy_writer_new_id();
+        if (lazy_object_claim(obj, writer)) {
+            lz_obj * objs;
+            uint64_t max_height;
+            size_t num_objs = lazy_database_claim_graph(obj, writer, &objs, &max_height);
+            DBG("<%i> Writing %lu objects (height %llu).", db, num_objs, max_height);
+            lazy_database_write_claimed(db, objs, num_objs, max_height);
+            free(objs);
+        } else {
+            // an other writer is writing the object
+            pthread_mutex_lock(&(db->persist_lock));
+            while (obj->is_temp) {
+                pthread_cond_wait(&(db->persist_cond), &(db->persist_lock));
+            }
+            pthread_mutex_unlock(&(db->persist_lock));
+        }
+    }
+    return obj->oid;
+}
+
+object_id_t lazy_database_write_object(lz_db db,
+                                       lz_obj obj) {
+    object_id_t oid = lazy_database_write_graph(db, obj);
+    
+    // the object could have been persisted by an other writer, which is
+    // still waiting for its batch
+    lazy_database_commit(db);
+    return oid;
+}
+
+#pragma mark -
+#pragma mark Import
+
+// An import claims the objects like a writer, but appends them (children
+// first) to chunks, which are written with a single reservation each. The
+// objects are marked as persisted after their chunk has been written.
+//
+// With deduplication, objects whose references are persisted are looked
+// up in the index of the database and in the current chunk. Objects with
+// references into the current chunk can't be equal to an existing record.
+
+struct lazy_import_record_s {
+    struct lazy_record_payload_s payload;
+    size_t length;
+    // an equal object in front of it in the chunk (the record is not written)
+    lz_obj same;
+    int has_digest;
+    unsigned char digest[LAZY_DEDUP_DIGEST_LENGTH];
+};
+
+struct lazy_import_s {
+    lz_db db;
+    int32_t writer;
+    
+    // the objects of the current chunk and their records
+    lz_obj * objs;
+    struct lazy_import_record_s * records;
+    size_t num_objs;
+    size_t objs_capacity;
+    size_t length;
+    
+    // digests of the current chunk -> position in the chunk
+    struct lazy_dedup_table_s chunk_digests;
+    
+    dispatch_queue_t queue;
+    dispatch_semaphore_t chunks;
+};
+
+static void lazy_import_init(struct lazy_import_s * import, lz_db db) {
+    memset(import, 0, sizeof(struct lazy_import_s));
+    import->db = db;
+    import->writer = lazy_writer_new_id();
+    lazy_dedup_table_init(&(import->chunk_digests));
+    import->queue = dispatch_queue_create(0, 0);
+    import->chunks = dispatch_semaphore_create(LAZY_IMPORT_MAX_CHUNKS);
+}
+
+static void lazy_import_mark_persisted(lz_db db, lz_obj obj, object_id_t oid) {
+    obj->oid = oid;
+    obj->database = lz_retain(db);
+    lazy_database_cache_add(db, obj);
+    OSMemoryBarrier();
+    obj->is_temp = 0;
+    lazy_database_map_persisted(db, obj);
+}
+
+// Assigns the positions of the records of a chunk, which starts at 'start',
+// and returns the length of the chunk. Since version 3, the length of each
+// record depends on its position.
+static size_t lazy_import_layout(lz_db db,
+                                 lz_obj * objs,
+                                 struct lazy_import_record_s * records,
+                                 size_t num_objs,
+                                 object_id_t start) {
+    size_t pos = 0;
+    for (size_t loop = 0; loop < num_objs; loop++) {
+        lz_obj obj = objs[loop];
+        struct lazy_import_record_s * record = &(records[loop]);
+        if (record->same) {
+            obj->oid = record->same->oid;
+            continue;
+        }
+        for (int i = 0; i < obj->num_references; i++) {
+            obj->reference_ids[i] = obj->reference_objs[i]->oid;
+        }
+        obj->oid = start + pos;
+        record->length = lazy_record_length(db, obj, &(record->payload), obj->oid);
+        pos += record->length;
+    }
+    return pos;
+}
+
+// Encodes the objects of the current chunk and writes them in the
+// background.
+static void lazy_import_flush(struct lazy_import_s * import) {
+    if (import->num_objs == 0) {
+        return;
+    }
+    lz_db db = import->db;
+    lz_obj * objs = import->objs;
+    struct lazy_import_record_s * records = import->records;
+    size_t num_objs = import->num_objs;
+    size_t length = import->length;
+    import->objs = 0;
+    import->records = 0;
+    import->num_objs = 0;
+    import->objs_capacity = 0;
+    import->length = 0;
+    lazy_dedup_table_destroy(&(import->chunk_digests));
+    
+    // the chunk is reserved at once, its length is computed again, if an
+    // other record has been reserved in the meantime
+    dispatch_semaphore_wait(import->chunks, DISPATCH_TIME_FOREVER);
+    object_id_t start;
+    do {
+        start = db->end_offset;
+        length = lazy_import_layout(db, objs, records, num_objs, start);
+    } while (!OSAtomicCompareAndSwap64Barrier(start, start + length, &(db->end_offset)));
+    
+    // a single large record is written without copying the payload
+    char * buffer = 0;
+    if (num_objs > 1 || length < LAZY_IMPORT_CHUNK_SIZE) {
+        buffer = malloc(length > 0 ? length : 1);
+        assert(buffer);
+    }
+    size_t pos = 0;
+    for (size_t loop = 0; loop < num_objs; loop++) {
+        lz_obj obj = objs[loop];
+        struct lazy_import_record_s * record = &(records[loop]);
+        if (record->same) {
+            continue;
+        }
+        if (db->dedup && !record->has_digest) {
+            lazy_dedup_digest(obj, record->digest);
+            record->has_digest = 1;
+        }
+        if (buffer) {
+            lazy_record_encode(db, obj, &(record->payload), obj->oid, buffer + pos, record->length);
+            lazy_record_payload_destroy(&(record->payload));
+        }
+        pos += record->length;
+    }
+    
+    dispatch_semaphore_t chunks = import->chunks;
+    dispatch_async(import->queue, ^{
+        if (buffer) {
+            lazy_database_pwrite(db, buffer, length, start);
+            free(buffer);
+        } else {
+            lazy_database_pwrite_record(db, objs[0], &(records[0].payload), start, length);
+            lazy_record_payload_destroy(&(records[0].payload));
+        }
+        
+        // the entries are written to the index file with the watermark
+        for (size_t loop = 0; loop < num_objs; loop++) {
+            if (db->dedup && !records[loop].same) {
+                lazy_dedup_index_insert(db->dedup, records[loop].digest, objs[loop]->oid);
+            }
+        }
+        pthread_mutex_lock(&(db->commit_lock));
+        lazy_database_range_written(db, start, length);
+        pthread_mutex_unlock(&(db->commit_lock));
+        
+        for (size_t loop = 0; loop < num_objs; loop++) {
+            lazy_import_mark_persisted(db, objs[loop], objs[loop]->oid);
+        }
+        lazy_database_signal_persisted(db);
+        for (size_t loop = 0; loop < num_objs; loop++) {
+            lz_release(objs[loop]);
+        }
+        free(objs);
+        free(records);
+        dispatch_semaphore_signal(chunks);
+    });
+}
+
+// Waits until all chunks have been written.
+static void lazy_import_finish(struct lazy_import_s * import) {
+    lazy_import_flush(import);
+    dispatch_sync(import->queue, ^{});
+    dispatch_release(import->queue);
+    dispatch_release(import->chunks);
+    lazy_dedup_table_destroy(&(import->chunk_digests));
+    
+    // objects which have been found in the index could refer to records,
+    // which are not written yet
+    lazy_database_commit(import->db);
+    lazy_database_signal_persisted(import->db);
+}
+
+// Looks up an object, whose references are persisted. Returns 1, if the
+// object has been persisted or belongs to an equal object of the chunk.
+static int lazy_import_dedup(struct lazy_import_s * import, lz_obj obj, struct lazy_import_record_s * record) {
+    for (int loop = 0; loop < obj->num_references; loop++) {
+        if (obj->reference_objs[loop]->is_temp) {
+            return 0;
+        }
+        obj->reference_ids[loop] = obj->reference_objs[loop]->oid;
+    }
+    lazy_dedup_digest(obj, record->digest);
+    record->has_digest = 1;
+    
+    object_id_t oid;
+    if (lazy_dedup_index_lookup(import->db->dedup, record->digest, &oid)) {
+        lazy_import_mark_persisted(import->db, obj, oid);
+        return 1;
+    }
+    if (lazy_dedup_table_get(&(import->chunk_digests), record->digest, &oid)) {
+        record->same = import->objs[oid];
+        return 1;
+    }
+    lazy_dedup_table_put(&(import->chunk_digests), record->digest, import->num_objs);
+    return 0;
+}
+
+// Appends an object claimed by the import to the current chunk.
+static void lazy_import_append(struct lazy_import_s * import, lz_obj obj) {
+    // references, which are written by other writers (or have not been
+    // emitted), are persisted before
+    for (int loop = 0; loop < obj->num_references; loop++) {
+        lz_obj child = obj->reference_objs[loop];
+        if (child->is_temp && child->is_temp != import->writer) {
+            lazy_import_flush(import);
+            lazy_database_write_object(import->db, child);
+        }
+    }
+    
+    struct lazy_import_record_s record;
+    memset(&record, 0, sizeof(struct lazy_import_record_s));
+    if (import->db->dedup && lazy_import_dedup(import, obj, &record)) {
+        if (!record.same) {
+            return;
+        }
+    } else {
+        lazy_record_payload_init(import->db, obj, &(record.payload));
+        // the position of the record is not known yet
+        record.length = lazy_record_length(import->db, obj, &(record.payload), OBJECT_ID_UNKNOWN);
+        if (import->num_objs > 0 && import->length + record.length > LAZY_IMPORT_CHUNK_SIZE) {
+            // the position in the chunk is not valid anymore
+            lazy_import_flush(import);
+            if (record.has_digest) {
+                lazy_dedup_table_put(&(import->chunk_digests), record.digest, 0);
+            }
+        }
+    }
+    
+    if (import->num_objs == import->objs_capacity) {
+        import->objs_capacity = import->objs_capacity ? import->objs_capacity * 2 : 1024;
+        import->objs = realloc(import->objs, sizeof(lz_obj) * import->objs_capacity);
+        import->records = realloc(import->records, sizeof(struct lazy_import_record_s) * import->objs_capacity);
+        assert(import->objs && import->records);
+    }
+    import->records[import->num_objs] = record;
+    import->objs[import->num_objs++] = lz_retain(obj);
+    import->length += record.length;
+}
+
+void lz_db_import(lz_db db, lz_obj obj) {
+    if (!obj->is_temp) {
+        return;
+    }
+    struct lazy_import_s import;
+    lazy_import_init(&import, db);
+    if (lazy_object_claim(obj, import.writer)) {
+        lz_obj * objs;
+        uint64_t max_height;
+        size_t num_objs = lazy_database_claim_graph(obj, import.writer, &objs, &max_height);
+        DBG("<%i> Importing %lu objects.", db, num_objs);
+        for (size_t loop = 0; loop < num_objs; loop++) {
+            lazy_import_append(&import, objs[loop]);
+        }
+        free(objs);
+    }
+    lazy_import_finish(&import);
+    
+    // an other writer could have claimed the object
+    lazy_database_write_object(db, obj);
+}
+
+void lz_db_import_stream(lz_db db, void(^producer)(void(^emit)(lz_obj obj))) {
+    struct lazy_import_s import;
+    struct lazy_import_s * import_ptr = &import;
+    lazy_import_init(&import, db);
+    producer(^(lz_obj obj){
+        if (!obj->is_temp || obj->is_temp == import_ptr->writer) {
+            // persisted or emitted before
+            return;
+        }
+        if (lazy_object_claim(obj, import_ptr->writer)) {
+            lazy_import_append(import_ptr, obj);
+        } else {
+            // wait for the other writer
+            lazy_import_flush(import_ptr);
+            lazy_database_write_object(db, obj);
+        }
+    });
+    lazy_import_finish(&import);
+}
+
+#pragma mark -
+#pragma mark Large Objects
+
+lz_writer lz_writer_new(lz_db db) {
+    if (db->version < 2) {
+        ERR("<%i> Large objects need a database of version 2 or later.", db);
+        return 0;
+    }
+    struct lazy_writer_s * writer = malloc(sizeof(struct lazy_writer_s));
+    assert(writer);
+    writer->db = lz_retain(db);
+    writer->chunk = malloc(LAZY_LARGE_CHUNK_SIZE);
+    assert(writer->chunk);
+    writer->chunk_length = 0;
+    writer->length = 0;
+    writer->chunk_flags = db->checksums ? LAZY_RECORD_CHECKSUM : 0;
+    writer->chunks = 0;
+    writer->num_chunks = 0;
+    writer->chunks_capacity = 0;
+    return writer;
+}
+
+// Writes a chunk directly to the data file.
+static void lazy_writer_write_chunk(struct lazy_writer_s * writer, const char * bytes, size_t length) {
+    lz_db db = writer->db;
+    lz_obj chunk = lz_obj_new((void *)bytes, length, 0, 0);
+    struct lazy_record_payload_s payload;
+    payload.data = bytes;
+    payload.length = length;
+    payload.flags = writer->chunk_flags;
+    payload.buffer = 0;
+    object_id_t oid = lazy_database_write_direct(db, chunk, &payload);
+    lz_release(chunk);
+    
+    if (writer->num_chunks == writer->chunks_capacity) {
+        writer->chunks_capacity = writer->chunks_capacity ? writer->chunks_capacity * 2 : 64;
+        writer->chunks = realloc(writer->chunks, sizeof(object_id_t) * writer->chunks_capacity);
+        assert(writer->chunks);
+    }
+    writer->chunks[writer->num_chunks++] = oid;
+}
+
+void lz_writer_write(lz_writer writer, const void * data, size_t length) {
+    if (!writer) {
+        return;
+    }
+    const char * bytes = data;
+    writer->length += length;
+    while (length > 0) {
+        if (writer->chunk_length == 0 && length >= LAZY_LARGE_CHUNK_SIZE) {
+            // whole chunks are written without copying
+            lazy_writer_write_chunk(writer, bytes, LAZY_LARGE_CHUNK_SIZE);
+            bytes += LAZY_LARGE_CHUNK_SIZE;
+            length -= LAZY_LARGE_CHUNK_SIZE;
+            continue;
+        }
+        size_t part = MIN(LAZY_LARGE_CHUNK_SIZE - writer->chunk_length, length);
+        memcpy(writer->chunk + writer->chunk_length, bytes, part);
+        writer->chunk_length += part;
+        bytes += part;
+        length -= part;
+        if (writer->chunk_length == LAZY_LARGE_CHUNK_SIZE) {
+            lazy_writer_write_chunk(writer, writer->chunk, writer->chunk_length);
+            writer->chunk_length = 0;
+        }
+    }
+}
+
+lz_obj lz_writer_finish(lz_writer writer) {
+    if (!writer) {
+        return 0;
+    }
+    lz_db db = writer->db;
+    if (writer->chunk_length > 0) {
+        lazy_writer_write_chunk(writer, writer->chunk, writer->chunk_length);
+    }
+    
+    // the description of the object is its payload
+    size_t size = sizeof(struct lazy_large_s) + sizeof(object_id_t) * writer->num_chunks;
+    struct lazy_large_s * large = malloc(size);
+    assert(large);
+    large->length = writer->length;
+    large->chunk_size = LAZY_LARGE_CHUNK_SIZE;
+    large->chunk_flags = writer->chunk_flags;
+    memcpy(large->chunks, writer->chunks, sizeof(object_id_t) * writer->num_chunks);
+    
+    lz_obj obj = lz_obj_new(large, size, 0, 0);
+    obj->flags |= LAZY_OBJECT_FREE_PAYLOAD | LAZY_OBJECT_LARGE;
+    lazy_database_write_object(db, obj);
+    DBG("<%i> Large object <%i> with %llu bytes in %lu chunks written.", db, obj, writer->length, writer->num_chunks);
+    
+    free(writer->chunks);
+    free(writer->chunk);
+    free(writer);
+    lz_release(db);
+    return obj;
+}
+
+int lazy_large_valid(lz_db db, object_id_t id, const void * data, size_t data_size) {
+    struct lazy_large_s large;
+    if (data_size >= sizeof(struct lazy_large_s)) {
+        memcpy(&large, data, sizeof(struct lazy_large_s));
+        size_t chunks_size = data_size - sizeof(struct lazy_large_s);
+        if (large.chunk_size != 0 && chunks_size % sizeof(object_id_t) == 0 &&
+            chunks_size / sizeof(object_id_t) == large.length / large.chunk_size + (large.length % large.chunk_size != 0)) {
+            return 1;
+        }
+    }
+    ERR("<%i> Invalid description of the large object %llu.", db, id);
+    return 0;
+}
+
+// The chunks are read in parallel. With checksums, each chunk in the range
+// is read and verified as a whole.
+int lazy_database_read_range(lz_db db,
+                             const struct lazy_large_s * large,
+                             uint64_t offset,
+                             size_t length,
+                             char * buffer) {
+    if (length == 0) {
+        return 1;
+    }
+    uint64_t first = offset / large->chunk_size;
+    uint64_t last = (offset + length - 1) / large->chunk_size;
+    size_t head_length = lazy_record_header_length(db) + (large->chunk_flags & LAZY_RECORD_CHECKSUM ? sizeof(uint32_t) : 0);
+    int verify = db->verify_checksums && large->chunk_flags & LAZY_RECORD_CHECKSUM;
+    int fd = fileno(db->read_file);
+    
+    volatile int32_t num_failed = 0;
+    volatile int32_t * failed = &num_failed;
+    dispatch_apply(last - first + 1, dispatch_get_global_queue(0, 0), ^(size_t loop){
+        uint64_t index = first + loop;
+        uint64_t chunk_start = index * large->chunk_size;
+        uint64_t chunk_length = MIN(large->chunk_size, large->length - chunk_start);
+        uint64_t from = MAX(offset, chunk_start) - chunk_start;
+        uint64_t to = MIN(offset + length, chunk_start + chunk_length) - chunk_start;
+        char * dest = buffer + (chunk_start + from - offset);
+        object_id_t id;
+        memcpy(&id, &(large->chunks[index]), sizeof(object_id_t));
+        
+        if (!verify) {
+            if (pread(fd, dest, to - from, id + head_length + from) != to - from) {
+                ERR("<%i> Could not read %llu bytes of chunk %llu.", db, to - from, id);
+                OSAtomicIncrement32Barrier(failed);
+            }
+            return;
+        }
+        
+        size_t record_length = head_length + chunk_length;
+        char * record = malloc(record_length);
+        assert(record);
+        uint16_t num_ref;
+        size_t refs_size;
+        uint32_t data_size;
+        uint16_t flags;
+        uint32_t checksum;
+        if (pread(fd, record, record_length, id) != record_length) {
+            ERR("<%i> Could not read chunk %llu.", db, id);
+            OSAtomicIncrement32Barrier(failed);
+        } else if (lazy_record_decode_header(db, record, id, db->end_offset, &num_ref, &refs_size, &data_size, &flags, &checksum) != head_length ||
+                   num_ref != 0 || data_size != chunk_length ||
+                   !lazy_record_verify(db, id, record, flags, checksum, 0, 0, record + head_length, data_size)) {
+            ERR("<%i> Invalid chunk %llu.", db, id);
+            OSAtomicIncrement32Barrier(failed);
+        } else {
+            memcpy(dest, record + head_length + from, to - from);
+        }
+        free(record);
+    });
+    return num_failed == 0;
+}
+
+#pragma mark -
+#pragma mark Access Root Handle
+
+static void lazy_root_dealloc(void * ptr) {
+    struct lazy_root_s * root = ptr;
+    lz_release(root->root_obj);
+    lz_release(root->database);
+    dispatch_release(root->queue);
+    dispatch_release(root->publish_queue);
+    lazy_slab_free(root, sizeof(struct lazy_root_s));
+}
+
+lz_root lz_db_root(lz_db db, const char * name) {
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    object_id_t root_id;
+	
+    // sha1(name) is the key in the root table
+    CC_SHA1(name, strlen(name), digest);
+    int root_is_bound = lazy_root_table_get(db->roots, digest, &root_id);
+    
+    struct lazy_root_s * root = lazy_slab_alloc(sizeof(struct lazy_root_s));
+    if (root) {
+        LAZY_BASE_INIT(root, lazy_root_dealloc);
+        root->publish_queue = dispatch_queue_create(0, 0);
+        root->queue = dispatch_queue_create(0, 0);
+        dispatch_set_target_queue(root->queue, root->publish_queue);
+        memcpy(root->digest, digest, LAZY_ROOT_DIGEST_LENGTH);
         
         root->root_is_bound = root_is_bound;
 		root->root_obj_id = root_id;
@@ -28,23 +28,197 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <sys/param.h>
 #include <dispatch/dispatch.h>
 
 #include "lazy_base_impl.h"
 #include "lazy_object_impl.h"
+#include "lazy_object_map_impl.h"
+#include "lazy_dedup_impl.h"
+#include "lazy_root_table_impl.h"
 
 
+// Format of newly created databases. Records of version 1 start with the
+// number of references (uint16_t) and the payload length (uint32_t). Since
+// version 2, each record starts with a fixed size header, which contains
+// the length of the whole record. References and payload follow the header.
+// Since version 3, the references are stored as varints relative to the
+// record (see lazy_varint_impl.h), thus the length of a record depends on
+// its position in the data file.
+
+#define LAZY_DATABASE_VERSION 3
+
+struct lazy_record_header_s {
+    uint32_t length;
+    uint32_t payload_length;
+    uint16_t num_ref;
+    uint16_t flags;
+};
+
+// The payload of the record is compressed (see lazy_compress_impl.h). The
+// compressed payload starts with the length of the uncompressed payload
+// (uint32_t). 'payload_length' is the length of the compressed payload.
+#define LAZY_RECORD_COMPRESSED 0x1
+
+// A CRC32C of the record follows the header (uint32_t). It covers the
+// header, the references and the stored payload.
+#define LAZY_RECORD_CHECKSUM 0x2
+
+// The payload of the record describes a large object (struct lazy_large_s),
+// whose content is stored in separate records (chunks).
+#define LAZY_RECORD_LARGE 0x4
+
+// Payloads smaller than the threshold are not compressed.
+#define LAZY_COMPRESSION_DEFAULT_THRESHOLD 512
+
+// A read-only mapping of the data file. Objects with a payload inside of
+// the mapping retain it, thus a mapping stays valid until the last of these
+// objects is deallocated, even if the database maps a bigger region.
+
+struct lazy_mapping_s {
+    LAZY_BASE_HEAD
+    
+    void * data;
+    size_t length;
+};
+
+// The space of a record in the data file is reserved by adding its length
+// to the end offset. Small records are written in batches (group commit):
+// writers append their records to the current batch and wait until it has
+// been written by one of them (the leader). In the meantime, the next batch
+// is filled. Large records are written directly and in parallel. All
+// records in front of 'flushed_end' have been written.
+
+#define LAZY_COMMIT_DEFAULT_BATCH_SIZE (1024 * 1024)
+#define LAZY_COMMIT_DIRECT_THRESHOLD (64 * 1024)
+
+// Imports are written in chunks of this size, while the next chunk is
+// encoded.
+#define LAZY_IMPORT_CHUNK_SIZE (8 * 1024 * 1024)
+#define LAZY_IMPORT_MAX_CHUNKS 2
+
+// The content of a large object is written in chunks of this size. Each
+// chunk is a record without references, whose payload is neither compressed
+// nor deduplicated. The records of the chunks of an object share the same
+// flags ('chunk_flags'), thus the offset of the content in each chunk is
+// known without reading its header.
+
+#define LAZY_LARGE_CHUNK_SIZE (1024 * 1024)
+
+struct lazy_large_s {
+    uint64_t length;
+    uint32_t chunk_size;
+    uint32_t chunk_flags;
+    object_id_t chunks[];
+};
+
+struct lazy_writer_s {
+    lz_db db;
+    char * chunk;
+    size_t chunk_length;
+    uint64_t length;
+    uint16_t chunk_flags;
+    object_id_t * chunks;
+    size_t num_chunks;
+    size_t chunks_capacity;
+};
+
+// a contiguous range of records in the data file
+struct lazy_extent_s {
+    object_id_t offset;
+    size_t length;
+};
+
+struct lazy_batch_s {
+    char * data;
+    size_t length;
+    size_t capacity;
+    struct lazy_extent_s * extents;
+    size_t num_extents;
+    size_t extents_capacity;
+    uint64_t seq;
+};
+
+// A root update waiting for the next sync (LZ_DURABILITY_GROUP).
+struct lazy_sync_request_s {
+    struct lazy_root_s * root;
+    object_id_t oid;
+    void (^handler)(int synced);
+    struct lazy_sync_request_s * next;
+};
+
 struct lazy_database_s {
     LAZY_BASE_HEAD
     
     int version;
     char filename[MAXPATHLEN];
 	
-    FILE * write_file;
+    int write_fd;
     FILE * read_file;
+    volatile int64_t end_offset;
     dispatch_queue_t write_queue;
     dispatch_queue_t read_queue;
+    
+    // root updates wait for the group commit on this queue
+    dispatch_queue_t commit_queue;
+    
+    pthread_mutex_t commit_lock;
+    pthread_cond_t commit_cond;
+    struct lazy_batch_s batch;
+    struct lazy_batch_s flushing;
+    uint64_t written_seq;
+    int committing;
+    size_t commit_batch_size;
+    uint64_t commit_delay;
+    
+    // graph persistence (see lazy_database_write_object)
+    size_t write_parallelism;
+    pthread_mutex_t persist_lock;
+    pthread_cond_t persist_cond;
+    
+    // record checksums (see lazy_record_verify)
+    int checksums;
+    int verify_checksums;
+    
+    // the roots of the database
+    struct lazy_root_table_s * roots;
+    
+    // content addressed index (0, if deduplication is disabled)
+    struct lazy_dedup_index_s * dedup;
+    
+    // payload compression (see lazy_record_payload_init)
+    int compression;
+    uint32_t compression_threshold;
+    
+    // durability (see lazy_database_sync_data)
+    lz_durability durability;
+    pthread_mutex_t sync_lock;
+    pthread_cond_t sync_cond;
+    uint64_t sync_requested;
+    uint64_t sync_done;
+    int syncing;
+    int sync_failed;
+    struct lazy_sync_request_s * sync_pending;
+    
+    // written ranges behind the watermark (sorted by offset)
+    volatile object_id_t flushed_end;
+    struct lazy_extent_s * written;
+    size_t num_written;
+    size_t written_capacity;
+    
+    int use_mmap;
+    OSSpinLock mapping_lock;
+    struct lazy_mapping_s * mapping;
+    
+    // resident objects of this database
+    struct lazy_object_map_s objects;
+    
+    // payloads of resident objects are evicted above the limit
+    uint64_t cache_limit;
+    volatile int64_t cache_size;
+    volatile int32_t cache_evicting;
+    int cache_hand;
 };
 
 #pragma mark -
@@ -53,4 +227,56 @@ struct lazy_database_s {
 lz_obj lazy_database_read_object(lz_db db, object_id_t);
 object_id_t lazy_database_write_object(lz_db db, lz_obj obj);
 
+// Appends the records of the temporary objects of the graph, without
+// waiting for them to be written.
+object_id_t lazy_database_write_graph(lz_db db, lz_obj obj);
+
+// Returns after all records appended so far have been written.
+void lazy_database_commit(lz_db db);
+
+#pragma mark -
+#pragma mark Cache
+
+// Evicts objects on the calling thread, until the cache limit is met or no
+// more objects can be evicted. Returns the number of evicted bytes (0, if
+// objects are evicted in the background at the same time).
+uint64_t lazy_database_trim_cache(lz_db db);
+
+#pragma mark -
+#pragma mark Large Objects
+
+// Returns 1, if the payload is a valid description of a large object (the
+// number of chunks matches the length of the content).
+int lazy_large_valid(lz_db db, object_id_t id, const void * data, size_t data_size);
+
+// Reads a range of the content of a large object into the buffer. The
+// description has to be valid (see lazy_large_valid). Returns 0, if the
+// range could not be read.
+int lazy_database_read_range(lz_db db,
+                             const struct lazy_large_s * large,
+                             uint64_t offset,
+                             size_t length,
+                             char * buffer);
+
+#pragma mark -
+#pragma mark Durability
+
+// Syncs a file to the disk (F_FULLFSYNC where available). Returns 0, if the
+// file could not be synced.
+int lazy_fsync(int fd);
+
+// Syncs the data file. Concurrent callers share a sync, which started
+// after they called the function. Returns 0, if a sync of the data file
+// has failed (once a sync failed, the data file is not synced anymore).
+int lazy_database_sync_data(lz_db db);
+
+// The sync worker of the database (LZ_DURABILITY_GROUP) stores the root
+// update after the data file has been synced and calls the handler (on an
+// other queue) after the journal of the roots has been synced.
+void lazy_database_sync_root(lz_db db, struct lazy_root_s * root, object_id_t oid, void(^handler)(int synced));
+
+// Reads the evicted payload of the object again. The write lock of the
+// object has to be held.
+void lazy_database_reload_payload(lz_db db, lz_obj obj);
+
 #endif // _LAZY_DATABASE_IMPL_H_
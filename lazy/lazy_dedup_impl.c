@@ -0,0 +1,269 @@
+/*
+ *  lazy_dedup_impl.c
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 04.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lazy_dedup_impl.h"
+#include "lazy_logging_impl.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <Block.h>
+#include <CommonCrypto/CommonDigest.h>
+
+#define LAZY_DEDUP_MIN_SIZE 64
+
+// size of an entry in the index file (digest and id)
+#define LAZY_DEDUP_FILE_ENTRY_LENGTH (LAZY_DEDUP_DIGEST_LENGTH + sizeof(object_id_t))
+
+void lazy_dedup_digest(lz_obj obj, unsigned char * digest) {
+    CC_SHA1_CTX ctx;
+    CC_SHA1_Init(&ctx);
+    CC_SHA1_Update(&ctx, &(obj->num_references), sizeof(uint16_t));
+    CC_SHA1_Update(&ctx, &(obj->payload_length), sizeof(uint32_t));
+    CC_SHA1_Update(&ctx, obj->reference_ids, sizeof(object_id_t) * obj->num_references);
+    CC_SHA1_Update(&ctx, obj->payload_data, obj->payload_length);
+    CC_SHA1_Final(digest, &ctx);
+}
+
+#pragma mark -
+#pragma mark Hash Table (Linear Probing)
+
+// The digest is a hash already.
+static inline uint64_t lazy_dedup_hash(const unsigned char * digest) {
+    uint64_t hash;
+    memcpy(&hash, digest, sizeof(uint64_t));
+    return hash;
+}
+
+void lazy_dedup_table_init(struct lazy_dedup_table_s * table) {
+    table->entries = 0;
+    table->size = 0;
+    table->count = 0;
+}
+
+void lazy_dedup_table_destroy(struct lazy_dedup_table_s * table) {
+    free(table->entries);
+    lazy_dedup_table_init(table);
+}
+
+static size_t lazy_dedup_table_find(struct lazy_dedup_table_s * table, const unsigned char * digest) {
+    size_t mask = table->size - 1;
+    size_t pos = lazy_dedup_hash(digest) & mask;
+    while (table->entries[pos].used && memcmp(table->entries[pos].digest, digest, LAZY_DEDUP_DIGEST_LENGTH) != 0) {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+static void lazy_dedup_table_grow(struct lazy_dedup_table_s * table) {
+    struct lazy_dedup_entry_s * entries = table->entries;
+    size_t size = table->size;
+    
+    table->size = size ? size * 2 : LAZY_DEDUP_MIN_SIZE;
+    table->entries = calloc(table->size, sizeof(struct lazy_dedup_entry_s));
+    assert(table->entries);
+    
+    for (size_t loop = 0; loop < size; loop++) {
+        if (entries[loop].used) {
+            table->entries[lazy_dedup_table_find(table, entries[loop].digest)] = entries[loop];
+        }
+    }
+    free(entries);
+}
+
+int lazy_dedup_table_get(struct lazy_dedup_table_s * table, const unsigned char * digest, object_id_t * oid) {
+    if (table->count == 0) {
+        return 0;
+    }
+    struct lazy_dedup_entry_s * entry = &(table->entries[lazy_dedup_table_find(table, digest)]);
+    if (entry->used) {
+        *oid = entry->oid;
+        return 1;
+    }
+    return 0;
+}
+
+int lazy_dedup_table_put(struct lazy_dedup_table_s * table, const unsigned char * digest, object_id_t oid) {
+    if ((table->count + 1) * 2 > table->size) {
+        lazy_dedup_table_grow(table);
+    }
+    struct lazy_dedup_entry_s * entry = &(table->entries[lazy_dedup_table_find(table, digest)]);
+    if (entry->used) {
+        return 0;
+    }
+    memcpy(entry->digest, digest, LAZY_DEDUP_DIGEST_LENGTH);
+    entry->used = LAZY_DEDUP_ENTRY_VALID;
+    entry->oid = oid;
+    table->count++;
+    return 1;
+}
+
+#pragma mark -
+#pragma mark Index
+
+static inline struct lazy_dedup_stripe_s * lazy_dedup_stripe(struct lazy_dedup_index_s * index, const unsigned char * digest) {
+    return &(index->stripes[digest[LAZY_DEDUP_DIGEST_LENGTH - 1] & (LAZY_DEDUP_NUM_STRIPES - 1)]);
+}
+
+// Adds or replaces the entry of the digest. The stripe has to be locked.
+static void lazy_dedup_stripe_set(struct lazy_dedup_stripe_s * stripe, const unsigned char * digest, object_id_t oid, uint32_t state) {
+    struct lazy_dedup_table_s * table = &(stripe->table);
+    if (!lazy_dedup_table_put(table, digest, oid)) {
+        table->entries[lazy_dedup_table_find(table, digest)].oid = oid;
+    }
+    table->entries[lazy_dedup_table_find(table, digest)].used = state;
+}
+
+struct lazy_dedup_index_s * lazy_dedup_index_open(const char * filename,
+                                                  uint64_t end,
+                                                  int(^valid)(const unsigned char * digest, object_id_t oid)) {
+    FILE * file = fopen(filename, "a+");
+    if (!file) {
+        ERR("Could not open the deduplication index '%s'.", filename);
+        return 0;
+    }
+    
+    struct lazy_dedup_index_s * index = malloc(sizeof(struct lazy_dedup_index_s));
+    assert(index);
+    for (int loop = 0; loop < LAZY_DEDUP_NUM_STRIPES; loop++) {
+        pthread_mutex_init(&(index->stripes[loop].lock), 0);
+        lazy_dedup_table_init(&(index->stripes[loop].table));
+    }
+    pthread_mutex_init(&(index->file_lock), 0);
+    index->file = file;
+    index->valid = Block_copy(valid);
+    index->pending = 0;
+    index->num_pending = 0;
+    index->pending_capacity = 0;
+    
+    // load the entries, a later entry of a digest replaces an earlier one
+    // (which has been invalid)
+    unsigned char buffer[LAZY_DEDUP_FILE_ENTRY_LENGTH];
+    size_t num_entries = 0, num_ignored = 0;
+    rewind(file);
+    while (fread(buffer, LAZY_DEDUP_FILE_ENTRY_LENGTH, 1, file) == 1) {
+        object_id_t oid;
+        memcpy(&oid, buffer + LAZY_DEDUP_DIGEST_LENGTH, sizeof(object_id_t));
+        if (oid < end) {
+            lazy_dedup_stripe_set(lazy_dedup_stripe(index, buffer), buffer, oid, LAZY_DEDUP_ENTRY_LOADED);
+            num_entries++;
+        } else {
+            num_ignored++;
+        }
+    }
+    if (num_ignored > 0) {
+        WARNING("Ignoring %lu entries of the deduplication index '%s'.", num_ignored, filename);
+    }
+    DBG("Loaded %lu entries of the deduplication index '%s'.", num_entries, filename);
+    return index;
+}
+
+void lazy_dedup_index_close(struct lazy_dedup_index_s * index) {
+    for (int loop = 0; loop < LAZY_DEDUP_NUM_STRIPES; loop++) {
+        pthread_mutex_destroy(&(index->stripes[loop].lock));
+        lazy_dedup_table_destroy(&(index->stripes[loop].table));
+    }
+    pthread_mutex_destroy(&(index->file_lock));
+    Block_release(index->valid);
+    fclose(index->file);
+    free(index->pending);
+    free(index);
+}
+
+// Returns the state of the entry of the digest (0, if there is none).
+static uint32_t lazy_dedup_stripe_get(struct lazy_dedup_stripe_s * stripe, const unsigned char * digest, object_id_t * oid) {
+    pthread_mutex_lock(&(stripe->lock));
+    uint32_t state = 0;
+    if (lazy_dedup_table_get(&(stripe->table), digest, oid)) {
+        state = stripe->table.entries[lazy_dedup_table_find(&(stripe->table), digest)].used;
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+    return state;
+}
+
+// A loaded entry is checked outside of the lock (the record may have to be
+// read). Its state is only changed, if it has not been replaced meanwhile.
+int lazy_dedup_index_lookup(struct lazy_dedup_index_s * index, const unsigned char * digest, object_id_t * oid) {
+    struct lazy_dedup_stripe_s * stripe = lazy_dedup_stripe(index, digest);
+    uint32_t state = lazy_dedup_stripe_get(stripe, digest, oid);
+    if (state != LAZY_DEDUP_ENTRY_LOADED) {
+        return state == LAZY_DEDUP_ENTRY_VALID;
+    }
+    
+    int valid = index->valid(digest, *oid);
+    if (!valid) {
+        WARNING("Ignoring the entry of the deduplication index for record %llu.", *oid);
+    }
+    pthread_mutex_lock(&(stripe->lock));
+    struct lazy_dedup_entry_s * entry = &(stripe->table.entries[lazy_dedup_table_find(&(stripe->table), digest)]);
+    if (entry->used == LAZY_DEDUP_ENTRY_LOADED && entry->oid == *oid) {
+        entry->used = valid ? LAZY_DEDUP_ENTRY_VALID : LAZY_DEDUP_ENTRY_INVALID;
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+    return valid;
+}
+
+void lazy_dedup_index_insert(struct lazy_dedup_index_s * index, const unsigned char * digest, object_id_t oid) {
+    struct lazy_dedup_stripe_s * stripe = lazy_dedup_stripe(index, digest);
+    pthread_mutex_lock(&(stripe->lock));
+    int added = lazy_dedup_table_put(&(stripe->table), digest, oid);
+    if (!added) {
+        struct lazy_dedup_entry_s * entry = &(stripe->table.entries[lazy_dedup_table_find(&(stripe->table), digest)]);
+        if (entry->used == LAZY_DEDUP_ENTRY_INVALID) {
+            entry->oid = oid;
+            entry->used = LAZY_DEDUP_ENTRY_VALID;
+            added = 1;
+        }
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+    
+    if (added) {
+        pthread_mutex_lock(&(index->file_lock));
+        if (index->num_pending == index->pending_capacity) {
+            index->pending_capacity = index->pending_capacity ? index->pending_capacity * 2 : 64;
+            index->pending = realloc(index->pending, LAZY_DEDUP_FILE_ENTRY_LENGTH * index->pending_capacity);
+            assert(index->pending);
+        }
+        unsigned char * entry = index->pending + LAZY_DEDUP_FILE_ENTRY_LENGTH * index->num_pending++;
+        memcpy(entry, digest, LAZY_DEDUP_DIGEST_LENGTH);
+        memcpy(entry + LAZY_DEDUP_DIGEST_LENGTH, &oid, sizeof(object_id_t));
+        pthread_mutex_unlock(&(index->file_lock));
+    }
+}
+
+void lazy_dedup_index_written(struct lazy_dedup_index_s * index, uint64_t flushed_end) {
+    pthread_mutex_lock(&(index->file_lock));
+    size_t num_kept = 0;
+    for (size_t loop = 0; loop < index->num_pending; loop++) {
+        unsigned char * entry = index->pending + LAZY_DEDUP_FILE_ENTRY_LENGTH * loop;
+        object_id_t oid;
+        memcpy(&oid, entry + LAZY_DEDUP_DIGEST_LENGTH, sizeof(object_id_t));
+        if (oid < flushed_end) {
+            fwrite(entry, LAZY_DEDUP_FILE_ENTRY_LENGTH, 1, index->file);
+        } else {
+            memmove(index->pending + LAZY_DEDUP_FILE_ENTRY_LENGTH * num_kept++, entry, LAZY_DEDUP_FILE_ENTRY_LENGTH);
+        }
+    }
+    index->num_pending = num_kept;
+    pthread_mutex_unlock(&(index->file_lock));
+}
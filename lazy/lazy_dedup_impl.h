@@ -0,0 +1,125 @@
+/*
+ *  lazy_dedup_impl.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 04.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAZY_DEDUP_IMPL_H_
+#define _LAZY_DEDUP_IMPL_H_
+
+#include <lazy.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "lazy_object_impl.h"
+
+// Content addressed index of a database: SHA1 of (payload, reference ids)
+// -> object id. Since the references are stored as ids, equal subgraphs
+// have equal digests (like a Merkle tree) and are stored once.
+//
+// The index is kept in memory and new entries are appended to the file
+// 'dedup' of the database, as soon as their records have been written. It
+// is a cache: entries which got lost only cost disk space. Since the index
+// file and the data file are not synced, an entry can still be on the disk
+// before its record. An entry of the file is checked against its record,
+// when it is found for the first time, and ignored, if the record is
+// missing or has an other digest.
+
+#define LAZY_DEDUP_DIGEST_LENGTH 20
+#define LAZY_DEDUP_NUM_STRIPES 64
+
+// states of an entry of the index ('used' of the hash table)
+#define LAZY_DEDUP_ENTRY_VALID 1
+#define LAZY_DEDUP_ENTRY_LOADED 2
+#define LAZY_DEDUP_ENTRY_INVALID 3
+
+struct lazy_dedup_entry_s {
+    unsigned char digest[LAZY_DEDUP_DIGEST_LENGTH];
+    uint32_t used;
+    object_id_t oid;
+};
+
+// hash table with linear probing (not synchronized)
+struct lazy_dedup_table_s {
+    struct lazy_dedup_entry_s * entries;
+    size_t size;
+    size_t count;
+};
+
+struct lazy_dedup_stripe_s {
+    pthread_mutex_t lock;
+    struct lazy_dedup_table_s table;
+};
+
+struct lazy_dedup_index_s {
+    struct lazy_dedup_stripe_s stripes[LAZY_DEDUP_NUM_STRIPES];
+    pthread_mutex_t file_lock;
+    FILE * file;
+    
+    // checks a loaded entry against its record
+    int (^valid)(const unsigned char * digest, object_id_t oid);
+    
+    // entries of records, which have not been written yet
+    unsigned char * pending;
+    size_t num_pending;
+    size_t pending_capacity;
+};
+
+// Digest of a temporary object, the reference ids have to be set.
+void lazy_dedup_digest(lz_obj obj, unsigned char * digest);
+
+#pragma mark -
+#pragma mark Hash Table
+
+void lazy_dedup_table_init(struct lazy_dedup_table_s * table);
+void lazy_dedup_table_destroy(struct lazy_dedup_table_s * table);
+
+// Returns 1 and sets 'oid', if the digest is in the table.
+int lazy_dedup_table_get(struct lazy_dedup_table_s * table, const unsigned char * digest, object_id_t * oid);
+
+// Adds the entry. Returns 0, if the digest is already in the table (the
+// existing entry is kept).
+int lazy_dedup_table_put(struct lazy_dedup_table_s * table, const unsigned char * digest, object_id_t oid);
+
+#pragma mark -
+#pragma mark Index
+
+// Opens (or creates) the index file and loads the entries in front of
+// 'end'. An entry is only used, after 'valid' has returned 1 for it, when it
+// has been found for the first time. Returns 0, if the file could not be
+// opened.
+struct lazy_dedup_index_s * lazy_dedup_index_open(const char * filename,
+                                                  uint64_t end,
+                                                  int(^valid)(const unsigned char * digest, object_id_t oid));
+void lazy_dedup_index_close(struct lazy_dedup_index_s * index);
+
+int lazy_dedup_index_lookup(struct lazy_dedup_index_s * index, const unsigned char * digest, object_id_t * oid);
+
+// Adds the entry to the index (it replaces an invalid entry). It is written to the index file by
+// lazy_dedup_index_written(), after the record has been written.
+void lazy_dedup_index_insert(struct lazy_dedup_index_s * index, const unsigned char * digest, object_id_t oid);
+
+// Appends the pending entries of records in front of 'flushed_end' to the
+// index file.
+void lazy_dedup_index_written(struct lazy_dedup_index_s * index, uint64_t flushed_end);
+
+#endif // _LAZY_DEDUP_IMPL_H_
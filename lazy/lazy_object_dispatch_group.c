@@ -23,6 +23,8 @@
 
 #include "lazy_object_dispatch_group.h"
 
+#include <stdint.h>
+
 dispatch_group_t lazy_object_get_dispatch_group() {
     static dispatch_group_t group = 0;
     static dispatch_once_t predicate = 0;
@@ -32,6 +34,27 @@ dispatch_group_t lazy_object_get_dispatch_group() {
     return (group);
 }
 
+// Objects don't have a queue of their own. Instead, each object is mapped
+// by its address onto one of a fixed set of serial queues. Blocks for the
+// same object always end up on the same queue and keep their order.
+
+#define LAZY_OBJECT_NUM_QUEUES 64
+
+dispatch_queue_t lazy_object_get_dispatch_queue(const void * obj) {
+    static dispatch_queue_t queues[LAZY_OBJECT_NUM_QUEUES];
+    static dispatch_once_t predicate = 0;
+    dispatch_once(&predicate, ^{
+        for (int loop = 0; loop < LAZY_OBJECT_NUM_QUEUES; loop++) {
+            queues[loop] = dispatch_queue_create(0, 0);
+        }
+    });
+    
+    // the lower bits are the same for all objects (alignment of the allocation)
+    uintptr_t hash = (uintptr_t)obj >> 4;
+    hash ^= hash >> 11;
+    return queues[hash % LAZY_OBJECT_NUM_QUEUES];
+}
+
 void lz_wait_for_completion() {
     dispatch_group_t group = lazy_object_get_dispatch_group();
     dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
@@ -27,5 +27,6 @@
 #include <dispatch/dispatch.h>
 
 dispatch_group_t lazy_object_get_dispatch_group();
+dispatch_queue_t lazy_object_get_dispatch_queue(const void * obj);
 
 #endif // _LAZY_OBJECT_DISPATCH_GROUP_IMPL_H_
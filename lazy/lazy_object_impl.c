@@ -25,6 +25,7 @@
 #include "lazy_logging_impl.h"
 #include "lazy_object_dispatch_group.h"
 #include "lazy_database_impl.h"
+#include "lazy_slab_impl.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
@@ -35,135 +36,131 @@
 #pragma mark -
 #pragma mark Object Livecycle
 
-lz_obj lz_obj_new(void * data,
-                  uint32_t length,
-                  void(^dealloc)(),
-                  uint16_t num_ref, ...) {
-    struct lazy_object_s * obj = malloc(sizeof(struct lazy_object_s));
+#define LAZY_OBJECT_STACK_REFS 32
+#define LAZY_OBJECT_SIZE(num_ref) (sizeof(struct lazy_object_s) + (num_ref) * (sizeof(lz_obj) + sizeof(object_id_t)))
+
+static void lazy_object_dealloc(void * ptr) {
+    struct lazy_object_s * obj = ptr;
+    
+    // the object is no longer resident
+    if (obj->database) {
+        lazy_object_map_remove(&(obj->database->objects), obj);
+        if (obj->flags & LAZY_OBJECT_CACHED) {
+            OSAtomicAdd64Barrier(-(int64_t)obj->payload_length, &(obj->database->cache_size));
+        }
+    }
+    
+    // release references
+    VERBOSE("<%i> Releasing %i references.", obj, obj->num_references);
+    for (int loop=0; loop < obj->num_references; loop++) {
+        VERBOSE("<%i> Releasing reference to <%i>.", obj, obj->reference_objs[loop]);
+        lz_release(obj->reference_objs[loop]);
+    }
+    VERBOSE("<%i> References released.", obj);
+    
+    VERBOSE("<%i> Releasing reference to database <%i>.", obj, obj->database);
+    lz_release(obj->database);
+    
+    pthread_mutex_destroy(&(obj->write_lock));
+    if (obj->flags & LAZY_OBJECT_FREE_PAYLOAD) {
+        free(obj->payload_data);
+    } else if (obj->payload_dealloc) {
+        obj->payload_dealloc();
+        Block_release(obj->payload_dealloc);
+    }
+    lz_release(obj->payload_owner);
+    
+    lazy_slab_free(obj, LAZY_OBJECT_SIZE(obj->num_references));
+}
+
+static struct lazy_object_s * lazy_object_create(void * data,
+                                                 uint32_t length,
+                                                 void(^dealloc)(),
+                                                 uint16_t num_ref) {
+    // header, reference_objs and reference_ids in one allocation
+    struct lazy_object_s * obj = lazy_slab_alloc(LAZY_OBJECT_SIZE(num_ref));
     if (obj) {
-        LAZY_BASE_INIT(obj, ^{
-            
-            // release references
-            VERBOSE("<%i> Releasing %i references.", obj, obj->num_references);
-            for (int loop=0; loop < obj->num_references; loop++) {
-                VERBOSE("<%i> Releasing reference to <%i>.", obj, obj->reference_objs[loop]);
-                lz_release(obj->reference_objs[loop]);
-            }
-            VERBOSE("<%i> References released.", obj);
-            
-            VERBOSE("<%i> Releasing reference to database <%i>.", obj, obj->database);
-            lz_release(obj->database);
-            
-            dispatch_release(obj->write_lock);
-            obj->payload_dealloc();
-            Block_release(obj->payload_dealloc);
-            if (obj->num_references > 0) {
-                free(obj->reference_ids);
-                free(obj->reference_objs);
-            }
-        });
+        LAZY_BASE_INIT(obj, lazy_object_dealloc);
         
-        obj->oid = 0;
         // set up references
-        
         obj->num_references = num_ref;
-        if (num_ref > 0) {
-            obj->reference_objs = calloc(num_ref, sizeof(lz_obj));
-            obj->reference_ids = calloc(num_ref, sizeof(object_id_t));
-            assert(obj->reference_objs);
-            assert(obj->reference_ids);
-            
-            // copy references
-            va_list refs;
-            va_start(refs, num_ref);
-            int loop;
-            for (loop = 0; loop < num_ref; loop++) {
-                struct lazy_object_s * ref = va_arg(refs, struct lazy_object_s *);
-                obj->reference_objs[loop] = lz_retain(ref);
-            }
-            va_end(refs);
-        }
+        obj->reference_objs = (lz_obj *)(obj + 1);
+        obj->reference_ids = (object_id_t *)(obj->reference_objs + num_ref);
+        memset(obj->reference_objs, 0, LAZY_OBJECT_SIZE(num_ref) - sizeof(struct lazy_object_s));
         
         // set payload
         obj->payload_length = length;
         obj->payload_data = data;
-        obj->payload_dealloc = Block_copy(dealloc);
-            
-        obj->write_lock = dispatch_semaphore_create(1);
-        obj->is_temp = 1;
-        obj->database = 0;
-            
-        DBG("<%i> New object created.", obj);
+        obj->payload_dealloc = dealloc ? Block_copy(dealloc) : 0;
+        obj->payload_owner = 0;
+        obj->flags = 0;
+        
+        pthread_mutex_init(&(obj->write_lock), 0);
+        obj->pins = 0;
+        obj->referenced = 0;
     } else {
         ERR("Could not allocate memory to create a new object.");
     }
     return obj;
 }
 
-// TODO: Use a "base" function for 'lz_obj_new()' and 'lz_obj_new_v()'
+lz_obj lz_obj_new(void * data,
+                  uint32_t length,
+                  void(^dealloc)(),
+                  uint16_t num_ref, ...) {
+    // up to 65535 references, only few are collected on the stack
+    lz_obj stack_refs[LAZY_OBJECT_STACK_REFS];
+    lz_obj * refs = stack_refs;
+    if (num_ref > LAZY_OBJECT_STACK_REFS) {
+        refs = malloc(sizeof(lz_obj) * num_ref);
+        if (!refs) {
+            ERR("Could not allocate memory to create a new object.");
+            return 0;
+        }
+    }
+    
+    va_list args;
+    va_start(args, num_ref);
+    for (int loop = 0; loop < num_ref; loop++) {
+        refs[loop] = va_arg(args, struct lazy_object_s *);
+    }
+    va_end(args);
+    
+    lz_obj obj = lz_obj_new_v(data, length, dealloc, num_ref, refs);
+    if (refs != stack_refs) {
+        free(refs);
+    }
+    return obj;
+}
 
 lz_obj lz_obj_new_v(void * data,
                     uint32_t length,
                     void(^dealloc)(),
                     uint16_t num_ref,
                     struct lazy_object_s ** refs) {
-
-    struct lazy_object_s * obj = malloc(sizeof(struct lazy_object_s));
+    struct lazy_object_s * obj = lazy_object_create(data, length, dealloc, num_ref);
     if (obj) {
-        LAZY_BASE_INIT(obj, ^{
-            
-            // release references
-            VERBOSE("<%i> Releasing %i references.", obj, obj->num_references);
-            for (int loop=0; loop < obj->num_references; loop++) {
-                VERBOSE("<%i> Releasing reference to <%i>.", obj, obj->reference_objs[loop]);
-                lz_release(obj->reference_objs[loop]);
-            }
-            VERBOSE("<%i> References released.", obj);
-            
-            VERBOSE("<%i> Releasing reference to database <%i>.", obj, obj->database);
-            lz_release(obj->database);
-            
-            dispatch_release(obj->write_lock);
-            obj->payload_dealloc();
-            Block_release(obj->payload_dealloc);
-            if (obj->num_references > 0) {
-                free(obj->reference_ids);
-                free(obj->reference_objs);
-            }
-        });
-        
-        obj->oid = 0;
-        // set up references
-        
-        obj->num_references = num_ref;
-        if (num_ref > 0) {
-            obj->reference_objs = calloc(num_ref, sizeof(lz_obj));
-            obj->reference_ids = calloc(num_ref, sizeof(object_id_t));
-            assert(obj->reference_objs);
-            assert(obj->reference_ids);
-            
-            // copy references
-            for (int loop = 0; loop < num_ref; loop++) {
-                obj->reference_objs[loop] = lz_retain(refs[loop]);
-            }
+        // copy references
+        for (int loop = 0; loop < num_ref; loop++) {
+            obj->reference_objs[loop] = lz_retain(refs[loop]);
         }
         
-        // set payload
-        obj->payload_length = length;
-        obj->payload_data = data;
-        obj->payload_dealloc = Block_copy(dealloc);
-        
-        obj->write_lock = dispatch_semaphore_create(1);
+        obj->oid = 0;
         obj->is_temp = 1;
         obj->database = 0;
         
         DBG("<%i> New object created.", obj);
-    } else {
-        ERR("Could not allocate memory to create a new object.");
     }
     return obj;
 }
 
+void lz_obj_set_compression(lz_obj obj, int enabled) {
+    if (obj->is_temp) {
+        obj->flags &= ~(LAZY_OBJECT_COMPRESS | LAZY_OBJECT_NO_COMPRESS);
+        obj->flags |= enabled ? LAZY_OBJECT_COMPRESS : LAZY_OBJECT_NO_COMPRESS;
+    }
+}
+
 #pragma mark -
 #pragma mark Unmarshal Object
 
@@ -171,62 +168,29 @@ lz_obj lz_obj_unmarshal(lz_db db,
                         object_id_t oid,
                         void * data,
                         uint32_t length,
-                        void(^dealloc)(),
+                        lz_base owner,
                         uint16_t num_ref,
                         object_id_t * refs) {
-    struct lazy_object_s * obj = malloc(sizeof(struct lazy_object_s));
+    struct lazy_object_s * obj = lazy_object_create(data, length, 0, num_ref);
     if (obj) {
-        LAZY_BASE_INIT(obj, ^{
-            
-            // release references
-            VERBOSE("<%i> Releasing %i references.", obj, obj->num_references);
-            int loop;
-            for (loop=0; loop < obj->num_references; loop++) {
-                VERBOSE("<%i> Releasing reference to <%i>.", obj, obj->reference_objs[loop]);
-                lz_release(obj->reference_objs[loop]);
-            }
-            VERBOSE("<%i> References released.", obj);
-            
-            VERBOSE("<%i> Releasing reference to database <%i>.", obj, obj->database);
-            lz_release(obj->database);
-            
-            dispatch_release(obj->write_lock);
-            obj->payload_dealloc();
-            Block_release(obj->payload_dealloc);
-            if (obj->num_references > 0) {
-                free(obj->reference_ids);
-                free(obj->reference_objs);
-            }
-        });
-        
         // set up references
-        obj->num_references = num_ref;
-        if (num_ref > 0) {
-            obj->reference_objs = calloc(num_ref, sizeof(lz_obj));
-            obj->reference_ids = calloc(num_ref, sizeof(object_id_t));
-            assert(obj->reference_objs);
-            assert(obj->reference_ids);
+        if (refs) {
             memcpy(obj->reference_ids, refs, sizeof(object_id_t) * num_ref);
         }
         
-            
+        if (owner.base) {
+            obj->payload_owner = lz_retain(owner);
+        } else {
+            obj->flags |= LAZY_OBJECT_FREE_PAYLOAD;
+        }
+        
         obj->is_temp = 0;
         obj->oid = oid;
         
-        obj->write_lock = dispatch_semaphore_create(1);
-            
-        // set payload
-        obj->payload_length = length;
-        obj->payload_data = data;
-        obj->payload_dealloc = Block_copy(dealloc);
-            
         // set database
         obj->database = lz_retain(db);
         
         DBG("<%i> New object created.", obj);
-        
-    } else {
-        ERR("Could not allocate memory to create a new object.");
     }
     return obj;
 }
@@ -251,9 +215,79 @@ uint16_t lz_obj_num_ref(lz_obj obj) {
     return obj->num_references;
 }
 
+// Objects of a database with a cache limit are only accessed with the write
+// lock held, the evicting thread could release the references otherwise.
+static inline int lazy_object_is_evictable(lz_obj obj) {
+    return obj->database && obj->database->cache_limit;
+}
+
 lz_obj lz_obj_ref(lz_obj obj, uint16_t pos) {
-    lz_obj result = lz_obj_weak_ref(obj, pos);
-    return lz_retain(result);
+    if (lazy_object_is_evictable(obj)) {
+        pthread_mutex_lock(&(obj->write_lock));
+        lz_obj result = lz_retain(lz_obj_weak_ref(obj, pos));
+        obj->referenced = 1;
+        pthread_mutex_unlock(&(obj->write_lock));
+        return result;
+    } else {
+        lz_obj result = lz_obj_weak_ref(obj, pos);
+        return lz_retain(result);
+    }
+}
+
+static inline int lazy_object_ref_is_resident(lz_obj obj, uint16_t pos) {
+    return pos >= obj->num_references || obj->reference_objs[pos] || !obj->database;
+}
+
+void lz_obj_ref_async(lz_obj obj, uint16_t pos, void(^result_handler)(lz_obj ref)) {
+    uint16_t positions[1] = {pos};
+    lz_obj_refs_async(obj, positions, 1, ^(lz_obj * refs){
+        result_handler(refs[0]);
+    });
+}
+
+void lz_obj_refs_async(lz_obj obj, const uint16_t * positions, uint16_t count, void(^result_handler)(lz_obj * refs)) {
+    void(^handler)(lz_obj *) = Block_copy(result_handler);
+    dispatch_group_t group = lazy_object_get_dispatch_group();
+    dispatch_queue_t queue = lazy_object_get_dispatch_queue(obj);
+    
+    // positions and results are used after returning
+    uint16_t * pos = malloc(sizeof(uint16_t) * (count > 0 ? count : 1));
+    lz_obj * refs = malloc(sizeof(lz_obj) * (count > 0 ? count : 1));
+    assert(pos && refs);
+    memcpy(pos, positions, sizeof(uint16_t) * count);
+    
+    int resident = 1;
+    for (int loop = 0; loop < count && resident; loop++) {
+        resident = lazy_object_ref_is_resident(obj, pos[loop]);
+    }
+    
+    lz_retain(obj);
+    void(^resolve)() = ^{
+        for (int loop = 0; loop < count; loop++) {
+            refs[loop] = lz_obj_ref(obj, pos[loop]);
+        }
+    };
+    void(^finish)() = ^{
+        handler(refs);
+        Block_release(handler);
+        free(refs);
+        free(pos);
+        lz_release(obj);
+    };
+    
+    if (resident) {
+        // no need to use the I/O queue of the database
+        dispatch_group_async(group, queue, ^{
+            resolve();
+            finish();
+        });
+    } else {
+        DBG("<%i> Reading %i references on the I/O queue.", obj, count);
+        dispatch_group_async(group, obj->database->read_queue, ^{
+            resolve();
+            dispatch_group_async(group, queue, finish);
+        });
+    }
 }
 
 lz_obj lz_obj_weak_ref(lz_obj obj, uint16_t pos) {
@@ -262,8 +296,13 @@ lz_obj lz_obj_weak_ref(lz_obj obj, uint16_t pos) {
         if (result) {
             return result;
         } else {
+            // concurrent faults of the same object share one read (identity
+            // map), but only the first thread installs it in the slot
 			lz_obj o = lazy_database_read_object(obj->database, obj->reference_ids[pos]);
-            (obj->reference_objs[pos]) = o;
+            if (o && !OSAtomicCompareAndSwapPtrBarrier(0, o, (void * volatile *)&(obj->reference_objs[pos]))) {
+                lz_release(o);
+                o = obj->reference_objs[pos];
+            }
 			return o;
         }
     } else {
@@ -275,15 +314,127 @@ lz_obj lz_obj_weak_ref(lz_obj obj, uint16_t pos) {
 #pragma mark -
 #pragma mark Check Same Object
 
+// The payload is pinned while the block is applied. An evicted payload is
+// read again from the database.
+static void lazy_object_apply(lz_obj obj, void(^handle)(void * data, uint32_t length)) {
+    if (lazy_object_is_evictable(obj)) {
+        pthread_mutex_lock(&(obj->write_lock));
+        if (obj->flags & LAZY_OBJECT_EVICTED) {
+            lazy_database_reload_payload(obj->database, obj);
+        }
+        OSAtomicIncrement32Barrier(&(obj->pins));
+        obj->referenced = 1;
+        pthread_mutex_unlock(&(obj->write_lock));
+        
+        handle(obj->payload_data, obj->payload_length);
+        OSAtomicDecrement32Barrier(&(obj->pins));
+    } else {
+        handle(obj->payload_data, obj->payload_length);
+    }
+}
+
+// The content of a large object is only read with lz_obj_read_range().
 void lz_obj_sync(lz_obj obj, void(^handle)(void * data, uint32_t length)) {
     DBG("<%i> Applying synchronous 'payload block'.", obj);
-    handle(obj->payload_data, obj->payload_length);
+    if (obj->flags & LAZY_OBJECT_LARGE) {
+        handle(0, 0);
+    } else {
+        lazy_object_apply(obj, handle);
+    }
 }
 
 void lz_obj_async(lz_obj obj, void(^handle)(void * data, uint32_t length)) {
-    dispatch_group_async(lazy_object_get_dispatch_group(), obj->queue, ^{
+    dispatch_group_async(lazy_object_get_dispatch_group(), lazy_object_get_dispatch_queue(obj), ^{
         DBG("<%i> Applying asynchronous 'payload function'.", obj);
-        handle(obj->payload_data, obj->payload_length);
+        if (obj->flags & LAZY_OBJECT_LARGE) {
+            handle(0, 0);
+        } else {
+            lazy_object_apply(obj, handle);
+        }
+    });
+}
+
+uint64_t lz_obj_length(lz_obj obj) {
+    __block uint64_t length = 0;
+    lazy_object_apply(obj, ^(void * data, uint32_t payload_length){
+        if (obj->flags & LAZY_OBJECT_LARGE) {
+            memcpy(&length, data, sizeof(uint64_t));
+        } else {
+            length = payload_length;
+        }
+    });
+    return length;
+}
+
+// The description of a large object is pinned, while its chunks are read.
+int64_t lz_obj_read_range(lz_obj obj, uint64_t offset, size_t length, void(^handle)(void * data, size_t length)) {
+    __block int64_t result = -1;
+    __block char * buffer = 0;
+    lazy_object_apply(obj, ^(void * data, uint32_t payload_length){
+        if (!(obj->flags & LAZY_OBJECT_LARGE)) {
+            uint64_t start = MIN(offset, payload_length);
+            result = MIN(length, payload_length - start);
+            handle((char *)data + start, result);
+            return;
+        }
+        if (!lazy_large_valid(obj->database, obj->oid, data, payload_length)) {
+            return;
+        }
+        struct lazy_large_s large;
+        memcpy(&large, data, sizeof(struct lazy_large_s));
+        uint64_t start = MIN(offset, large.length);
+        size_t count = MIN(length, large.length - start);
+        buffer = malloc(count > 0 ? count : 1);
+        assert(buffer);
+        if (lazy_database_read_range(obj->database, data, start, count, buffer)) {
+            result = count;
+        }
     });
+    if (buffer) {
+        if (result >= 0) {
+            handle(buffer, result);
+        }
+        free(buffer);
+    }
+    return result;
+}
+
+#pragma mark -
+#pragma mark Evict Object
+
+uint32_t lazy_object_evict(lz_obj obj) {
+    if (obj->is_temp || obj->pins > 0) {
+        return 0;
+    }
+    
+    // references, which are only held by this object
+    for (int loop = 0; loop < obj->num_references; loop++) {
+        lz_obj child = obj->reference_objs[loop];
+        if (child && child->rc == 1) {
+            if (OSAtomicCompareAndSwapPtrBarrier(child, 0, (void * volatile *)&(obj->reference_objs[loop]))) {
+                lz_release(child);
+            }
+        }
+    }
+    
+    if (!(obj->flags & LAZY_OBJECT_CACHED)) {
+        return 0;
+    }
+    
+    VERBOSE("<%i> Evicting payload (%u bytes).", obj, obj->payload_length);
+    if (obj->flags & LAZY_OBJECT_FREE_PAYLOAD) {
+        free(obj->payload_data);
+    } else if (obj->payload_dealloc) {
+        obj->payload_dealloc();
+        Block_release(obj->payload_dealloc);
+        obj->payload_dealloc = 0;
+    }
+    lz_release(obj->payload_owner);
+    obj->payload_owner = 0;
+    obj->payload_data = 0;
+    obj->flags = (obj->flags & ~(LAZY_OBJECT_FREE_PAYLOAD | LAZY_OBJECT_CACHED)) | LAZY_OBJECT_EVICTED;
+    
+    OSAtomicAdd64Barrier(-(int64_t)obj->payload_length, &(obj->database->cache_size));
+    return obj->payload_length;
 }
 
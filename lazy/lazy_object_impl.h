@@ -26,41 +26,84 @@
 
 #include <lazy.h>
 #include <dispatch/dispatch.h>
+#include <pthread.h>
 
 #include "lazy_base_impl.h"
 
 typedef uint64_t object_id_t;
 #define OBJECT_ID_UNKNOWN UINT64_MAX
 
+// The header is ordered by access frequency: the fields needed to walk
+// the object graph and to access the payload are in the first 64 bytes (on
+// 64 bit systems), the write lock is behind them. Both reference arrays are
+// part of the same allocation and follow the header (reference_objs points
+// behind the header, reference_ids behind the last element of
+// reference_objs).
+
 struct lazy_object_s {
 	LAZY_BASE_HEAD
+	uint16_t num_references;
+	uint16_t flags;
 	
 	// object persistence
-	object_id_t oid;
 	int is_temp;
-	lz_db database;
-	dispatch_semaphore_t write_lock;
-
-	// references to other objects
-	uint16_t num_references;
-	object_id_t * reference_ids;
-	lz_obj * reference_objs;
-    
+	
 	// object payload
-	void (^payload_dealloc)();
 	uint32_t payload_length;
 	void * payload_data;
+	
+	// references to other objects
+	lz_obj * reference_objs;
+	object_id_t * reference_ids;
+	
+	// cache of the database (see lazy_object_evict)
+	volatile int32_t pins;
+	volatile int32_t referenced;
+	
+	// object persistence
+	object_id_t oid;
+	lz_db database;
+	
+	void (^payload_dealloc)();
+	struct lazy_base_s * payload_owner;
+	pthread_mutex_t write_lock;
 };
 
+// the payload is released with free() (no dealloc block)
+#define LAZY_OBJECT_FREE_PAYLOAD 0x1
+// the payload is counted in the cache size of the database
+#define LAZY_OBJECT_CACHED 0x2
+// the payload has been evicted and is read again on the next access
+#define LAZY_OBJECT_EVICTED 0x4
+// the payload is compressed (or not), regardless of the database setting
+#define LAZY_OBJECT_COMPRESS 0x8
+#define LAZY_OBJECT_NO_COMPRESS 0x10
+// the payload is the description of a large object (see lz_writer_finish)
+#define LAZY_OBJECT_LARGE 0x20
+
 #pragma mark -
 #pragma mark Unmarshal Object
 
+// The payload belongs to the handle 'owner' (e.g., a mapping of the data
+// file), which is retained by the object. If no owner is given, the payload
+// is released with free(). Without 'refs', the ids of the references are
+// set by the caller.
+
 lz_obj lz_obj_unmarshal(lz_db db,
                         object_id_t oid,
-							void * data,
-							uint32_t length,
-							void(^dealloc)(),
-							uint16_t num_ref,
-							object_id_t * refs);
+                        void * data,
+                        uint32_t length,
+                        lz_base owner,
+                        uint16_t num_ref,
+                        object_id_t * refs);
+
+#pragma mark -
+#pragma mark Evict Object
+
+// Releases the payload and the resident references of a persisted object,
+// unless the payload is in use (pinned). Returns the number of bytes of
+// the released payload. The write lock of the object has to be held.
+
+uint32_t lazy_object_evict(lz_obj obj);
 
 #endif // _LAZY_OBJECT_IMPL_H_
@@ -0,0 +1,232 @@
+/*
+ *  lazy_object_map_impl.c
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 17.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lazy_object_map_impl.h"
+#include "lazy_logging_impl.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+#define LAZY_OBJECT_MAP_MIN_SIZE 64
+
+#pragma mark -
+#pragma mark Hashing
+
+static inline uint64_t lazy_object_map_hash(object_id_t oid) {
+    uint64_t hash = oid * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+static inline struct lazy_object_map_stripe_s * lazy_object_map_stripe(struct lazy_object_map_s * map, uint64_t hash) {
+    return &(map->stripes[hash >> 58 & (LAZY_OBJECT_MAP_NUM_STRIPES - 1)]);
+}
+
+#pragma mark -
+#pragma mark Map Livecycle
+
+void lazy_object_map_init(struct lazy_object_map_s * map) {
+    for (int loop = 0; loop < LAZY_OBJECT_MAP_NUM_STRIPES; loop++) {
+        struct lazy_object_map_stripe_s * stripe = &(map->stripes[loop]);
+        pthread_mutex_init(&(stripe->lock), 0);
+        pthread_cond_init(&(stripe->fault_done), 0);
+        stripe->entries = 0;
+        stripe->size = 0;
+        stripe->count = 0;
+    }
+}
+
+void lazy_object_map_destroy(struct lazy_object_map_s * map) {
+    for (int loop = 0; loop < LAZY_OBJECT_MAP_NUM_STRIPES; loop++) {
+        struct lazy_object_map_stripe_s * stripe = &(map->stripes[loop]);
+        pthread_mutex_destroy(&(stripe->lock));
+        pthread_cond_destroy(&(stripe->fault_done));
+        free(stripe->entries);
+    }
+}
+
+#pragma mark -
+#pragma mark Hash Table (Linear Probing)
+
+// Returns the position of the entry with the id or of the empty slot,
+// where it would be inserted.
+static size_t lazy_object_map_find(struct lazy_object_map_stripe_s * stripe, uint64_t hash, object_id_t oid) {
+    size_t mask = stripe->size - 1;
+    size_t pos = hash & mask;
+    while (stripe->entries[pos].obj && stripe->entries[pos].oid != oid) {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+static void lazy_object_map_grow(struct lazy_object_map_stripe_s * stripe) {
+    struct lazy_object_map_entry_s * entries = stripe->entries;
+    size_t size = stripe->size;
+    
+    stripe->size = size ? size * 2 : LAZY_OBJECT_MAP_MIN_SIZE;
+    stripe->entries = calloc(stripe->size, sizeof(struct lazy_object_map_entry_s));
+    assert(stripe->entries);
+    
+    for (size_t loop = 0; loop < size; loop++) {
+        if (entries[loop].obj) {
+            size_t pos = lazy_object_map_find(stripe, lazy_object_map_hash(entries[loop].oid), entries[loop].oid);
+            stripe->entries[pos] = entries[loop];
+        }
+    }
+    free(entries);
+}
+
+// Removes the entry at the position and moves the following entries of
+// the cluster back, if they belong to an earlier position.
+static void lazy_object_map_remove_at(struct lazy_object_map_stripe_s * stripe, size_t pos) {
+    size_t mask = stripe->size - 1;
+    size_t next = pos;
+    while (1) {
+        next = (next + 1) & mask;
+        if (!stripe->entries[next].obj) {
+            break;
+        }
+        size_t home = lazy_object_map_hash(stripe->entries[next].oid) & mask;
+        int stays = (pos <= next) ? (pos < home && home <= next) : (pos < home || home <= next);
+        if (!stays) {
+            stripe->entries[pos] = stripe->entries[next];
+            pos = next;
+        }
+    }
+    stripe->entries[pos].obj = 0;
+    stripe->count--;
+}
+
+// Retains the object of the entry, if it is resident and not on its way
+// to be deallocated.
+static inline int lazy_object_map_try_retain(lz_obj obj) {
+    return obj && obj != LAZY_OBJECT_MAP_PENDING && lazy_base_try_retain((struct lazy_base_s *)obj);
+}
+
+#pragma mark -
+#pragma mark Access Objects
+
+lz_obj lazy_object_map_get(struct lazy_object_map_s * map, object_id_t oid) {
+    uint64_t hash = lazy_object_map_hash(oid);
+    struct lazy_object_map_stripe_s * stripe = lazy_object_map_stripe(map, hash);
+    lz_obj result = 0;
+    
+    pthread_mutex_lock(&(stripe->lock));
+    if (stripe->count > 0) {
+        size_t pos = lazy_object_map_find(stripe, hash, oid);
+        lz_obj obj = stripe->entries[pos].obj;
+        if (lazy_object_map_try_retain(obj)) {
+            result = obj;
+        }
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+    
+    return result;
+}
+
+lz_obj lazy_object_map_reserve(struct lazy_object_map_s * map, object_id_t oid) {
+    uint64_t hash = lazy_object_map_hash(oid);
+    struct lazy_object_map_stripe_s * stripe = lazy_object_map_stripe(map, hash);
+    lz_obj result = 0;
+    
+    pthread_mutex_lock(&(stripe->lock));
+    while (1) {
+        if ((stripe->count + 1) * 2 > stripe->size) {
+            lazy_object_map_grow(stripe);
+        }
+        size_t pos = lazy_object_map_find(stripe, hash, oid);
+        lz_obj obj = stripe->entries[pos].obj;
+        if (obj == LAZY_OBJECT_MAP_PENDING) {
+            // an other thread is reading the object
+            pthread_cond_wait(&(stripe->fault_done), &(stripe->lock));
+            continue;
+        }
+        if (lazy_object_map_try_retain(obj)) {
+            result = obj;
+        } else {
+            if (!obj) {
+                stripe->count++;
+            }
+            stripe->entries[pos].oid = oid;
+            stripe->entries[pos].obj = LAZY_OBJECT_MAP_PENDING;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+    
+    return result;
+}
+
+lz_obj lazy_object_map_add(struct lazy_object_map_s * map, lz_obj obj) {
+    uint64_t hash = lazy_object_map_hash(obj->oid);
+    struct lazy_object_map_stripe_s * stripe = lazy_object_map_stripe(map, hash);
+    lz_obj result = obj;
+    
+    pthread_mutex_lock(&(stripe->lock));
+    if ((stripe->count + 1) * 2 > stripe->size) {
+        lazy_object_map_grow(stripe);
+    }
+    size_t pos = lazy_object_map_find(stripe, hash, obj->oid);
+    lz_obj existing = stripe->entries[pos].obj;
+    if (existing != obj && lazy_object_map_try_retain(existing)) {
+        result = existing;
+    } else {
+        if (!existing) {
+            stripe->count++;
+        }
+        stripe->entries[pos].oid = obj->oid;
+        stripe->entries[pos].obj = obj;
+        if (existing == LAZY_OBJECT_MAP_PENDING) {
+            pthread_cond_broadcast(&(stripe->fault_done));
+        }
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+    
+    return result;
+}
+
+void lazy_object_map_cancel(struct lazy_object_map_s * map, object_id_t oid) {
+    uint64_t hash = lazy_object_map_hash(oid);
+    struct lazy_object_map_stripe_s * stripe = lazy_object_map_stripe(map, hash);
+    
+    pthread_mutex_lock(&(stripe->lock));
+    size_t pos = lazy_object_map_find(stripe, hash, oid);
+    if (stripe->entries[pos].obj == LAZY_OBJECT_MAP_PENDING) {
+        lazy_object_map_remove_at(stripe, pos);
+        pthread_cond_broadcast(&(stripe->fault_done));
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+}
+
+void lazy_object_map_remove(struct lazy_object_map_s * map, lz_obj obj) {
+    uint64_t hash = lazy_object_map_hash(obj->oid);
+    struct lazy_object_map_stripe_s * stripe = lazy_object_map_stripe(map, hash);
+    
+    pthread_mutex_lock(&(stripe->lock));
+    if (stripe->count > 0) {
+        size_t pos = lazy_object_map_find(stripe, hash, obj->oid);
+        if (stripe->entries[pos].obj == obj) {
+            lazy_object_map_remove_at(stripe, pos);
+        }
+    }
+    pthread_mutex_unlock(&(stripe->lock));
+}
@@ -0,0 +1,91 @@
+/*
+ *  lazy_object_map_impl.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 17.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAZY_OBJECT_MAP_IMPL_H_
+#define _LAZY_OBJECT_MAP_IMPL_H_
+
+#include <lazy.h>
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "lazy_object_impl.h"
+
+// Identity map of a database: object id -> object handle. The map does not
+// retain the objects, an object removes itself in its dealloc function.
+// The map is split into stripes with a lock and a hash table of their own.
+// While an object is read from the data file, its entry is marked as
+// pending. Other threads asking for the same id wait for this read.
+
+#define LAZY_OBJECT_MAP_NUM_STRIPES 64
+#define LAZY_OBJECT_MAP_PENDING ((lz_obj)1)
+
+struct lazy_object_map_entry_s {
+    object_id_t oid;
+    lz_obj obj;
+};
+
+struct lazy_object_map_stripe_s {
+    pthread_mutex_t lock;
+    pthread_cond_t fault_done;
+    struct lazy_object_map_entry_s * entries;
+    size_t size;
+    size_t count;
+};
+
+struct lazy_object_map_s {
+    struct lazy_object_map_stripe_s stripes[LAZY_OBJECT_MAP_NUM_STRIPES];
+};
+
+#pragma mark -
+#pragma mark Map Livecycle
+
+void lazy_object_map_init(struct lazy_object_map_s * map);
+void lazy_object_map_destroy(struct lazy_object_map_s * map);
+
+#pragma mark -
+#pragma mark Access Objects
+
+// Returns the (retained) object with the id or 0. Does not wait for
+// pending reads.
+lz_obj lazy_object_map_get(struct lazy_object_map_s * map, object_id_t oid);
+
+// Returns the (retained) object with the id. If a read of the object is
+// pending, it waits for the result. If the object is not resident, the
+// entry is marked as pending and 0 is returned. In this case the caller
+// has to read the object and finish with lazy_object_map_add() or
+// lazy_object_map_cancel().
+lz_obj lazy_object_map_reserve(struct lazy_object_map_s * map, object_id_t oid);
+
+// Adds the object to the map and wakes up threads waiting for it. If there
+// is already an object with the same id, this object is retained and
+// returned instead.
+lz_obj lazy_object_map_add(struct lazy_object_map_s * map, lz_obj obj);
+
+// Removes the pending entry of a failed read.
+void lazy_object_map_cancel(struct lazy_object_map_s * map, object_id_t oid);
+
+// Removes the entry of the object (if the entry still belongs to it).
+void lazy_object_map_remove(struct lazy_object_map_s * map, lz_obj obj);
+
+#endif // _LAZY_OBJECT_MAP_IMPL_H_
@@ -0,0 +1,296 @@
+/*
+ *  lazy_prefetch_impl.c
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 19.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lazy_prefetch_impl.h"
+#include "lazy_object_impl.h"
+#include "lazy_logging_impl.h"
+#include "lazy_object_dispatch_group.h"
+
+#include <stdlib.h>
+#include <libkern/OSAtomic.h>
+
+#define LAZY_PREFETCH_DEFAULT_LIMIT 16
+
+#pragma mark -
+#pragma mark Read Limit
+
+// The pending reads of all prefetches are started, while fewer reads than
+// the limit are running. The prefetches with pending reads take turns, each
+// read is started in a block of its own and nothing waits for a slot.
+
+static OSSpinLock lazy_prefetch_lock = OS_SPINLOCK_INIT;
+static long lazy_prefetch_limit = LAZY_PREFETCH_DEFAULT_LIMIT;
+static long lazy_prefetch_running = 0;
+static struct lazy_prefetch_s * lazy_prefetch_ready_head = 0;
+static struct lazy_prefetch_s * lazy_prefetch_ready_tail = 0;
+
+static void lazy_prefetch_read(lz_prefetch prefetch, struct lazy_prefetch_item_s * item);
+
+// The lock has to be held.
+static void lazy_prefetch_make_ready(lz_prefetch prefetch) {
+    prefetch->ready = 1;
+    prefetch->next_ready = 0;
+    if (lazy_prefetch_ready_tail) {
+        lazy_prefetch_ready_tail->next_ready = prefetch;
+    } else {
+        lazy_prefetch_ready_head = prefetch;
+    }
+    lazy_prefetch_ready_tail = prefetch;
+}
+
+// The lock has to be held.
+static void lazy_prefetch_remove_ready(lz_prefetch prefetch) {
+    struct lazy_prefetch_s * previous = 0;
+    struct lazy_prefetch_s * ready = lazy_prefetch_ready_head;
+    while (ready && ready != prefetch) {
+        previous = ready;
+        ready = ready->next_ready;
+    }
+    if (ready) {
+        if (previous) {
+            previous->next_ready = prefetch->next_ready;
+        } else {
+            lazy_prefetch_ready_head = prefetch->next_ready;
+        }
+        if (lazy_prefetch_ready_tail == prefetch) {
+            lazy_prefetch_ready_tail = previous;
+        }
+    }
+    prefetch->ready = 0;
+    prefetch->next_ready = 0;
+}
+
+// Charges the estimated size of a read, if it fits into the remaining
+// bytes of the prefetch.
+static int lazy_prefetch_charge(lz_prefetch prefetch, int64_t size) {
+    int64_t remaining;
+    do {
+        remaining = prefetch->remaining_bytes;
+        if (remaining <= 0 || remaining < size) {
+            return 0;
+        }
+    } while (!OSAtomicCompareAndSwap64Barrier(remaining, remaining - size, &(prefetch->remaining_bytes)));
+    return 1;
+}
+
+// Releases a pending read, which is not started.
+static void lazy_prefetch_drop(lz_prefetch prefetch, struct lazy_prefetch_item_s * item) {
+    lz_release(item->obj);
+    free(item);
+    dispatch_group_leave(prefetch->group);
+    RELEASE(prefetch);
+}
+
+// Starts pending reads, while fewer reads than the limit are running.
+static void lazy_prefetch_schedule() {
+    struct lazy_prefetch_item_s * start = 0;
+    struct lazy_prefetch_item_s * drop = 0;
+    
+    OSSpinLockLock(&lazy_prefetch_lock);
+    while (lazy_prefetch_running < lazy_prefetch_limit && lazy_prefetch_ready_head) {
+        struct lazy_prefetch_s * prefetch = lazy_prefetch_ready_head;
+        struct lazy_prefetch_item_s * item = prefetch->pending_head;
+        prefetch->pending_head = item->next;
+        
+        // the prefetch takes its turn again, if it has more pending reads
+        lazy_prefetch_remove_ready(prefetch);
+        if (prefetch->pending_head) {
+            lazy_prefetch_make_ready(prefetch);
+        } else {
+            prefetch->pending_tail = 0;
+        }
+        
+        // the size of a reference is estimated by the size of its parent
+        item->charge = 0;
+        int read = !prefetch->cancelled;
+        if (read && prefetch->limited && !item->obj->reference_objs[item->index]) {
+            item->charge = item->obj->payload_length + sizeof(object_id_t) * item->obj->num_references;
+            read = lazy_prefetch_charge(prefetch, item->charge);
+        }
+        if (read) {
+            item->next = start;
+            start = item;
+            lazy_prefetch_running++;
+        } else {
+            item->next = drop;
+            drop = item;
+        }
+    }
+    OSSpinLockUnlock(&lazy_prefetch_lock);
+    
+    while (drop) {
+        struct lazy_prefetch_item_s * item = drop;
+        drop = item->next;
+        lazy_prefetch_drop(item->prefetch, item);
+    }
+    while (start) {
+        struct lazy_prefetch_item_s * item = start;
+        start = item->next;
+        lazy_prefetch_read(item->prefetch, item);
+    }
+}
+
+void lz_prefetch_set_limit(long num_reads) {
+    OSSpinLockLock(&lazy_prefetch_lock);
+    lazy_prefetch_limit = num_reads > 0 ? num_reads : 1;
+    OSSpinLockUnlock(&lazy_prefetch_lock);
+    lazy_prefetch_schedule();
+}
+
+#pragma mark -
+#pragma mark Prefetch Livecycle
+
+static void lazy_prefetch_dealloc(void * ptr) {
+    struct lazy_prefetch_s * prefetch = ptr;
+    dispatch_release(prefetch->group);
+    free(prefetch);
+}
+
+// The pending reads of a cancelled prefetch are released immediately.
+void lz_prefetch_cancel(lz_prefetch prefetch) {
+    DBG("<%i> Cancel prefetch.", prefetch);
+    OSAtomicCompareAndSwap32Barrier(0, 1, &(prefetch->cancelled));
+    
+    OSSpinLockLock(&lazy_prefetch_lock);
+    struct lazy_prefetch_item_s * drop = prefetch->pending_head;
+    prefetch->pending_head = 0;
+    prefetch->pending_tail = 0;
+    if (prefetch->ready) {
+        lazy_prefetch_remove_ready(prefetch);
+    }
+    OSSpinLockUnlock(&lazy_prefetch_lock);
+    
+    while (drop) {
+        struct lazy_prefetch_item_s * item = drop;
+        drop = item->next;
+        lazy_prefetch_drop(prefetch, item);
+    }
+}
+
+void lz_prefetch_wait(lz_prefetch prefetch) {
+    dispatch_group_wait(prefetch->group, DISPATCH_TIME_FOREVER);
+}
+
+#pragma mark -
+#pragma mark Prefetch References
+
+static int lazy_prefetch_is_done(lz_prefetch prefetch) {
+    return prefetch->cancelled || prefetch->remaining_bytes <= 0;
+}
+
+// Adds the references of the object to the pending reads of the prefetch,
+// which continue with the references of these objects, until 'depth'
+// reaches 0.
+static void lazy_prefetch_references(lz_prefetch prefetch, lz_obj obj, uint16_t depth) {
+    if (obj->num_references == 0 || lazy_prefetch_is_done(prefetch)) {
+        return;
+    }
+    struct lazy_prefetch_item_s * head = 0;
+    struct lazy_prefetch_item_s * tail = 0;
+    for (uint16_t loop = 0; loop < obj->num_references; loop++) {
+        struct lazy_prefetch_item_s * item = malloc(sizeof(struct lazy_prefetch_item_s));
+        if (!item) {
+            ERR("<%i> Could not allocate memory to prefetch a reference.", prefetch);
+            break;
+        }
+        RETAIN(prefetch);
+        dispatch_group_enter(prefetch->group);
+        item->prefetch = prefetch;
+        item->obj = lz_retain(obj);
+        item->index = loop;
+        item->depth = depth;
+        item->next = 0;
+        if (tail) {
+            tail->next = item;
+        } else {
+            head = item;
+        }
+        tail = item;
+    }
+    if (!head) {
+        return;
+    }
+    
+    OSSpinLockLock(&lazy_prefetch_lock);
+    if (prefetch->pending_tail) {
+        prefetch->pending_tail->next = head;
+    } else {
+        prefetch->pending_head = head;
+    }
+    prefetch->pending_tail = tail;
+    if (!prefetch->ready) {
+        lazy_prefetch_make_ready(prefetch);
+    }
+    OSSpinLockUnlock(&lazy_prefetch_lock);
+    
+    lazy_prefetch_schedule();
+}
+
+// Reads a reference in the background. The estimated size, which has been
+// charged, is replaced by the size of the object.
+static void lazy_prefetch_read(lz_prefetch prefetch, struct lazy_prefetch_item_s * item) {
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
+    dispatch_group_async(lazy_object_get_dispatch_group(), queue, ^{
+        lz_obj child = 0;
+        if (!prefetch->cancelled) {
+            child = lz_obj_ref(item->obj, item->index);
+        }
+        if (item->charge) {
+            int64_t size = child ? child->payload_length + sizeof(object_id_t) * child->num_references : 0;
+            OSAtomicAdd64Barrier(item->charge - size, &(prefetch->remaining_bytes));
+        }
+        if (child && item->depth > 1) {
+            lazy_prefetch_references(prefetch, child, item->depth - 1);
+        }
+        lz_release(child);
+        
+        OSSpinLockLock(&lazy_prefetch_lock);
+        lazy_prefetch_running--;
+        OSSpinLockUnlock(&lazy_prefetch_lock);
+        lazy_prefetch_drop(prefetch, item);
+        lazy_prefetch_schedule();
+    });
+}
+
+lz_prefetch lz_obj_prefetch(lz_obj obj, uint16_t depth, uint64_t max_bytes) {
+    struct lazy_prefetch_s * prefetch = malloc(sizeof(struct lazy_prefetch_s));
+    if (prefetch) {
+        LAZY_BASE_INIT(prefetch, lazy_prefetch_dealloc);
+        prefetch->cancelled = 0;
+        prefetch->limited = (max_bytes > 0 && max_bytes < INT64_MAX);
+        prefetch->remaining_bytes = prefetch->limited ? max_bytes : INT64_MAX;
+        prefetch->group = dispatch_group_create();
+        prefetch->pending_head = 0;
+        prefetch->pending_tail = 0;
+        prefetch->next_ready = 0;
+        prefetch->ready = 0;
+        
+        DBG("<%i> Prefetch references of <%i> (depth: %i).", prefetch, obj, depth);
+        if (depth > 0) {
+            lazy_prefetch_references(prefetch, obj, depth);
+        }
+    } else {
+        ERR("Could not allocate memory to create a new prefetch handle.");
+    }
+    return prefetch;
+}
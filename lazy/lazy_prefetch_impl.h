@@ -0,0 +1,60 @@
+/*
+ *  lazy_prefetch_impl.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 19.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAZY_PREFETCH_IMPL_H_
+#define _LAZY_PREFETCH_IMPL_H_
+
+#include <lazy.h>
+
+#include <stdint.h>
+#include <dispatch/dispatch.h>
+
+#include "lazy_base_impl.h"
+
+// A reference of 'obj', which waits to be read.
+struct lazy_prefetch_item_s {
+    struct lazy_prefetch_s * prefetch;
+    struct lazy_object_s * obj;
+    uint16_t index;
+    uint16_t depth;
+    int64_t charge;
+    struct lazy_prefetch_item_s * next;
+};
+
+struct lazy_prefetch_s {
+    LAZY_BASE_HEAD
+    
+    volatile int32_t cancelled;
+    volatile int64_t remaining_bytes;
+    int limited;
+    dispatch_group_t group;
+    
+    // the pending reads of the prefetch and the next prefetch with pending
+    // reads (guarded by the lock of all prefetches)
+    struct lazy_prefetch_item_s * pending_head;
+    struct lazy_prefetch_item_s * pending_tail;
+    struct lazy_prefetch_s * next_ready;
+    int ready;
+};
+
+#endif // _LAZY_PREFETCH_IMPL_H_
@@ -59,58 +59,161 @@ void lz_root_get_async(lz_root root, void(^result_handler)(lz_obj)) {
     });
 }
 
-void _set(lz_root root, lz_obj obj, void(^handler)()) {
+// Stores the id in the root table of the database. Depending on the
+// durability of the database, the data file and the journal of the root
+// table are synced before the handler is called. The handler is called
+// with 0, if they could not be synced.
+void _write(lz_root root, object_id_t oid, void(^handler)(int synced)) {
+    lz_db db = root->database;
+    int synced = 1;
+    
+    switch (db->durability) {
+        case LZ_DURABILITY_SYNC:
+            // the root must not point to data which is not on the disk
+            synced = lazy_database_sync_data(db);
+            if (synced) {
+                lazy_root_table_set(db->roots, root->digest, oid);
+                synced = lazy_root_table_sync(db->roots);
+            }
+            break;
+        
+        case LZ_DURABILITY_GROUP:
+            // the root is stored by the sync worker
+            lazy_database_sync_root(db, root, oid, handler);
+            Block_release(handler);
+            return;
+            
+        default:
+            // LZ_DURABILITY_FLUSH: the records have been written already
+            lazy_root_table_set(db->roots, root->digest, oid);
+            break;
+    }
+    handler(synced);
+    Block_release(handler);
+}
+
+void _set(lz_root root, lz_obj obj, object_id_t oid, void(^handler)(int synced)) {
     if (!lz_obj_same(obj, root->root_obj)) {
         lz_release(root->root_obj);
         
         root->root_obj = lz_retain(obj);
-        root->root_obj_id = lazy_database_write_object(root->database, obj);
+        root->root_obj_id = oid;
         root->root_is_bound = 1;
-        int objects_written = fwrite(&(root->root_obj_id), sizeof(object_id_t), 1, root->file);
-        assert(objects_written == 1);
-        fflush(root->file);
+        _write(root, root->root_obj_id, handler);
+    } else {
+        handler(1);
+        Block_release(handler);
     }
-    handler();
-    Block_release(handler);
 }
 
-void lz_root_set_sync(lz_root root, lz_obj obj, void(^result_handler)()) {
-    void(^handler)() = Block_copy(result_handler);
-    dispatch_sync(root->queue, ^{
-        _set(root, obj, handler);
-    });   
+// A root update passes three stages: the temporary objects are serialized
+// (concurrently with other updates), their records are written by the group
+// commit of the database (waited for on its commit queue) and the root is
+// published on the queue of the root. The queue is suspended until the
+// records of the update have been written, the roots are therefore
+// published in the order of the calls. The update is then published on the
+// target of the queue, before the queue is resumed.
+static void lazy_root_set(lz_root root, lz_obj obj, void(^handler)(int synced)) {
+    lz_db db = root->database;
+    dispatch_group_t group = lazy_object_get_dispatch_group();
+    dispatch_group_t written = dispatch_group_create();
+    __block object_id_t oid = OBJECT_ID_UNKNOWN;
+    
+    lz_retain(root);
+    lz_retain(obj);
+    dispatch_group_enter(written);
+    dispatch_async(dispatch_get_global_queue(0, 0), ^{
+        oid = lazy_database_write_graph(db, obj);
+        dispatch_group_async(written, db->commit_queue, ^{
+            lazy_database_commit(db);
+        });
+        dispatch_group_leave(written);
+    });
+    
+    void(^publish)() = ^{
+        _set(root, obj, oid, handler);
+        lz_release(obj);
+        dispatch_release(written);
+    };
+    dispatch_group_async(group, root->queue, ^{
+        if (dispatch_group_wait(written, DISPATCH_TIME_NOW) == 0) {
+            publish();
+            lz_release(root);
+        } else {
+            dispatch_suspend(root->queue);
+            dispatch_group_enter(group);
+            dispatch_group_notify(written, root->publish_queue, ^{
+                publish();
+                dispatch_resume(root->queue);
+                lz_release(root);
+                dispatch_group_leave(group);
+            });
+        }
+    });
+}
+
+// The handler of an update is only called, if the update has been synced
+// (as required by the durability of the database).
+static void(^lazy_root_handler(void(^result_handler)()))(int) {
+    return Block_copy(^(int synced){
+        if (synced) {
+            result_handler();
+        }
+    });
+}
+
+// In LZ_DURABILITY_GROUP, the handler is called after the sync worker of
+// the database. The synchronous functions wait for it outside of the root
+// queue.
+static void(^lazy_root_sync_handler(dispatch_semaphore_t done, int * result, void(^result_handler)()))(int) {
+    return Block_copy(^(int synced){
+        if (synced) {
+            result_handler();
+        }
+        *result = synced;
+        dispatch_semaphore_signal(done);
+    });
+}
+
+int lz_root_set_sync(lz_root root, lz_obj obj, void(^result_handler)()) {
+    int synced = 0;
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    lazy_root_set(root, obj, lazy_root_sync_handler(done, &synced, result_handler));
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+    dispatch_release(done);
+    return synced;
 }
 
 void lz_root_set_async(lz_root root, lz_obj obj, void(^result_handler)()) {
-    void(^handler)() = Block_copy(result_handler);
-    dispatch_group_async(lazy_object_get_dispatch_group(), root->queue, ^{
-        _set(root, obj, handler);
-    });    
+    lazy_root_set(root, obj, lazy_root_handler(result_handler));
 }
 
-void _del(lz_root root, void(^handler)()) {
+void _del(lz_root root, void(^handler)(int synced)) {
     if (root->root_is_bound) {
         lz_release(root->root_obj);
         root->root_obj = 0;
         root->root_is_bound = 0;
-        object_id_t o = OBJECT_ID_UNKNOWN;
-        int objects_written = fwrite(&o, sizeof(object_id_t), 1, root->file);
-        assert(objects_written == 1);
-        fflush(root->file);
+        _write(root, OBJECT_ID_UNKNOWN, handler);
+    } else {
+        handler(1);
+        Block_release(handler);
     }
-    handler();
-    Block_release(handler);
 }
 
-void lz_root_del_sync(lz_root root, void(^result_handler)()) {
-    void(^handler)() = Block_copy(result_handler);
+int lz_root_del_sync(lz_root root, void(^result_handler)()) {
+    int synced = 0;
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    void(^handler)(int) = lazy_root_sync_handler(done, &synced, result_handler);
     dispatch_sync(root->queue, ^{
         _del(root, handler);
-    }); 
+    });
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+    dispatch_release(done);
+    return synced;
 }
 
 void lz_root_del_async(lz_root root, void(^result_handler)()) {
-    void(^handler)() = Block_copy(result_handler);
+    void(^handler)(int) = lazy_root_handler(result_handler);
     dispatch_group_async(lazy_object_get_dispatch_group(), root->queue, ^{
         _del(root, handler);
     }); 
@@ -37,8 +37,12 @@
 struct lazy_root_s {
     LAZY_BASE_HEAD
     
-    char filename[MAXPATHLEN];
-    FILE * file;
+    dispatch_queue_t queue;
+    
+    // the target of the queue, an update is published on it while the
+    // queue is suspended (see lazy_root_set)
+    dispatch_queue_t publish_queue;
+    unsigned char digest[LAZY_ROOT_DIGEST_LENGTH];
     int root_is_bound;
     object_id_t root_obj_id;
     lz_db database;
@@ -0,0 +1,662 @@
+/*
+ *  lazy_root_table_impl.c
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 28.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lazy_root_table_impl.h"
+#include "lazy_database_impl.h"
+#include "lazy_logging_impl.h"
+#include "lazy_crc32c_impl.h"
+#include "lazy_object_dispatch_group.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// entries of the journal read at once
+#define LAZY_ROOT_JOURNAL_READ_COUNT 2048
+
+static inline size_t lazy_root_table_length(uint32_t capacity) {
+    return sizeof(struct lazy_root_table_header_s) + sizeof(struct lazy_root_slot_s) * (size_t)capacity;
+}
+
+// The digest is a hash already.
+static inline uint64_t lazy_root_hash(const unsigned char * digest) {
+    uint64_t hash;
+    memcpy(&hash, digest, sizeof(uint64_t));
+    return hash;
+}
+
+static uint32_t lazy_root_journal_checksum(const struct lazy_root_journal_entry_s * entry) {
+    uint32_t crc = lazy_crc32c(0, entry->digest, LAZY_ROOT_DIGEST_LENGTH);
+    return lazy_crc32c(crc, &(entry->oid), sizeof(object_id_t));
+}
+
+#pragma mark -
+#pragma mark Table File
+
+// Creates an empty table file and returns its descriptor (or -1).
+static int lazy_root_table_create(const char * filename, uint32_t capacity) {
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        char msg[1024];
+        strerror_r(errno, msg, 1024);
+        ERR("Could not create the root table '%s': %s", filename, msg);
+        return -1;
+    }
+    struct lazy_root_table_header_s header;
+    memset(&header, 0, sizeof(struct lazy_root_table_header_s));
+    header.magic = LAZY_ROOT_TABLE_MAGIC;
+    header.capacity = capacity;
+    if (ftruncate(fd, lazy_root_table_length(capacity)) != 0 ||
+        pwrite(fd, &header, sizeof(struct lazy_root_table_header_s), 0) != sizeof(struct lazy_root_table_header_s)) {
+        ERR("Could not create the root table '%s'.", filename);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Maps the table file. Returns 0, if the file is not a valid table.
+static int lazy_root_table_map(struct lazy_root_table_s * table, int fd) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < sizeof(struct lazy_root_table_header_s)) {
+        return 0;
+    }
+    void * data = mmap(0, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    struct lazy_root_table_header_s * header = data;
+    if (header->magic != LAZY_ROOT_TABLE_MAGIC ||
+        header->capacity == 0 ||
+        (header->capacity & (header->capacity - 1)) != 0 ||
+        lazy_root_table_length(header->capacity) != file_stat.st_size) {
+        munmap(data, file_stat.st_size);
+        return 0;
+    }
+    table->fd = fd;
+    table->header = header;
+    table->slots = (struct lazy_root_slot_s *)(header + 1);
+    table->length = file_stat.st_size;
+    return 1;
+}
+
+static void lazy_root_table_unmap(struct lazy_root_table_s * table) {
+    munmap(table->header, table->length);
+    close(table->fd);
+    table->header = 0;
+    table->slots = 0;
+}
+
+// A clean table has to be on the disk completely, the header is written
+// last. The table is marked as not clean before it is changed.
+static void lazy_root_table_mark(struct lazy_root_table_s * table, int clean) {
+    if (clean) {
+        msync(table->header, table->length, MS_SYNC);
+    }
+    table->header->journal_length = table->journal_length;
+    table->header->clean = clean;
+    msync(table->header, sizeof(struct lazy_root_table_header_s), MS_SYNC);
+}
+
+#pragma mark -
+#pragma mark Hash Table (Linear Probing)
+
+static struct lazy_root_slot_s * lazy_root_table_find(struct lazy_root_slot_s * slots, uint32_t capacity, const unsigned char * digest) {
+    size_t mask = capacity - 1;
+    size_t pos = lazy_root_hash(digest) & mask;
+    while (slots[pos].used && memcmp(slots[pos].digest, digest, LAZY_ROOT_DIGEST_LENGTH) != 0) {
+        pos = (pos + 1) & mask;
+    }
+    return &(slots[pos]);
+}
+
+// Moves the slots into a new table file with twice the capacity, which
+// replaces the table file.
+static void lazy_root_table_grow(struct lazy_root_table_s * table) {
+    char filename[MAXPATHLEN];
+    char new_filename[MAXPATHLEN];
+    snprintf(filename, MAXPATHLEN, "%s/roots", table->path);
+    snprintf(new_filename, MAXPATHLEN, "%s/roots.new", table->path);
+    
+    uint32_t capacity = table->header->capacity * 2;
+    struct lazy_root_table_s grown;
+    int fd = lazy_root_table_create(new_filename, capacity);
+    assert(fd >= 0);
+    int mapped = lazy_root_table_map(&grown, fd);
+    assert(mapped);
+    
+    for (size_t loop = 0; loop < table->header->capacity; loop++) {
+        struct lazy_root_slot_s * slot = &(table->slots[loop]);
+        if (slot->used) {
+            *lazy_root_table_find(grown.slots, capacity, slot->digest) = *slot;
+        }
+    }
+    grown.header->count = table->header->count;
+    
+    if (rename(new_filename, filename) != 0) {
+        char msg[1024];
+        strerror_r(errno, msg, 1024);
+        ERR("Could not replace the root table '%s': %s", filename, msg);
+        assert(0);
+    }
+    lazy_root_table_unmap(table);
+    table->fd = grown.fd;
+    table->header = grown.header;
+    table->slots = grown.slots;
+    table->length = grown.length;
+    DBG("Root table '%s' has grown to %u slots.", filename, capacity);
+}
+
+// Returns the slot of the root, which is added, if 'create' is set. The
+// lock has to be held.
+static struct lazy_root_slot_s * lazy_root_table_slot(struct lazy_root_table_s * table, const unsigned char * digest, int create) {
+    struct lazy_root_slot_s * slot = lazy_root_table_find(table->slots, table->header->capacity, digest);
+    if (slot->used || !create) {
+        return slot->used ? slot : 0;
+    }
+    if ((table->header->count + 1) * 4 > table->header->capacity * 3) {
+        lazy_root_table_grow(table);
+        slot = lazy_root_table_find(table->slots, table->header->capacity, digest);
+    }
+    memcpy(slot->digest, digest, LAZY_ROOT_DIGEST_LENGTH);
+    slot->oid = OBJECT_ID_UNKNOWN;
+    slot->used = 1;
+    table->header->count++;
+    return slot;
+}
+
+#pragma mark -
+#pragma mark Journal
+
+// Applies the journal to the table. An incomplete entry at the end of the
+// journal is removed.
+static void lazy_root_table_replay(struct lazy_root_table_s * table) {
+    struct lazy_root_journal_entry_s * entries = malloc(sizeof(struct lazy_root_journal_entry_s) * LAZY_ROOT_JOURNAL_READ_COUNT);
+    assert(entries);
+    off_t offset = 0;
+    size_t num_entries = 0;
+    int valid = 1;
+    while (valid) {
+        ssize_t bytes_read = pread(table->journal_fd, entries, sizeof(struct lazy_root_journal_entry_s) * LAZY_ROOT_JOURNAL_READ_COUNT, offset);
+        if (bytes_read <= 0) {
+            break;
+        }
+        size_t count = bytes_read / sizeof(struct lazy_root_journal_entry_s);
+        valid = (count * sizeof(struct lazy_root_journal_entry_s) == bytes_read);
+        for (size_t loop = 0; loop < count; loop++) {
+            if (entries[loop].checksum != lazy_root_journal_checksum(&(entries[loop]))) {
+                valid = 0;
+                break;
+            }
+            lazy_root_table_slot(table, entries[loop].digest, 1)->oid = entries[loop].oid;
+            offset += sizeof(struct lazy_root_journal_entry_s);
+            num_entries++;
+        }
+    }
+    free(entries);
+    if (!valid) {
+        WARNING("Removing an incomplete entry at %lld of the root journal of '%s'.", (long long)offset, table->path);
+        ftruncate(table->journal_fd, offset);
+    }
+    table->journal_length = offset;
+    DBG("Replayed %lu entries of the root journal of '%s'.", num_entries, table->path);
+}
+
+static void lazy_root_journal_append(struct lazy_root_table_s * table, const struct lazy_root_journal_entry_s * entry) {
+    while (write(table->journal_fd, entry, sizeof(struct lazy_root_journal_entry_s)) != sizeof(struct lazy_root_journal_entry_s)) {
+        if (errno == EINTR) {
+            continue;
+        }
+        char msg[1024];
+        strerror_r(errno, msg, 1024);
+        ERR("Could not append to the root journal of '%s': %s", table->path, msg);
+        assert(0);
+        return;
+    }
+    table->journal_length += sizeof(struct lazy_root_journal_entry_s);
+}
+
+// Syncs the folder of the database, after a file has been renamed.
+static void lazy_root_table_sync_folder(struct lazy_root_table_s * table) {
+    int dir_fd = open(table->path, O_RDONLY);
+    if (dir_fd >= 0) {
+        lazy_fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+// Writes the last id of each root file in 'index/' into a new journal,
+// which replaces the journal, and applies it to the (empty) table. The
+// folder is renamed afterwards, until then the migration is started again
+// on the next open. Returns 0, if the roots could not be migrated.
+static int lazy_root_table_migrate(struct lazy_root_table_s * table) {
+    char filename[MAXPATHLEN];
+    char new_filename[MAXPATHLEN];
+    char msg[1024];
+    
+    snprintf(filename, MAXPATHLEN, "%s/index", table->path);
+    DIR * dir = opendir(filename);
+    if (!dir) {
+        strerror_r(errno, msg, 1024);
+        ERR("Could not read the root files of '%s': %s", table->path, msg);
+        return 0;
+    }
+    snprintf(new_filename, MAXPATHLEN, "%s/roots.journal.new", table->path);
+    int journal_fd = open(new_filename, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR);
+    if (journal_fd < 0) {
+        strerror_r(errno, msg, 1024);
+        ERR("Could not create the root journal '%s': %s", new_filename, msg);
+        closedir(dir);
+        return 0;
+    }
+    
+    size_t num_roots = 0;
+    int written = 1;
+    struct dirent * file;
+    while (written && (file = readdir(dir))) {
+        struct lazy_root_journal_entry_s entry;
+        if (strlen(file->d_name) != LAZY_ROOT_DIGEST_LENGTH * 2) {
+            continue;
+        }
+        int valid = 1;
+        for (int loop = 0; loop < LAZY_ROOT_DIGEST_LENGTH && valid; loop++) {
+            valid = (sscanf(file->d_name + loop * 2, "%2hhx", &(entry.digest[loop])) == 1);
+        }
+        if (!valid) {
+            continue;
+        }
+        
+        snprintf(filename, MAXPATHLEN, "%s/index/%s", table->path, file->d_name);
+        int fd = open(filename, O_RDONLY);
+        struct stat file_stat;
+        if (fd >= 0 && fstat(fd, &file_stat) == 0 && file_stat.st_size >= sizeof(object_id_t) &&
+            pread(fd, &(entry.oid), sizeof(object_id_t), file_stat.st_size - sizeof(object_id_t)) == sizeof(object_id_t)) {
+            if (entry.oid != OBJECT_ID_UNKNOWN) {
+                entry.checksum = lazy_root_journal_checksum(&entry);
+                written = (write(journal_fd, &entry, sizeof(struct lazy_root_journal_entry_s)) == sizeof(struct lazy_root_journal_entry_s));
+                num_roots++;
+            }
+        } else {
+            WARNING("Could not migrate the root file '%s'.", filename);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    closedir(dir);
+    
+    // the journal is on the disk, before the root files are renamed
+    snprintf(filename, MAXPATHLEN, "%s/roots.journal", table->path);
+    if (!written || !lazy_fsync(journal_fd) || rename(new_filename, filename) != 0) {
+        ERR("Could not write the migrated roots of '%s'.", table->path);
+        close(journal_fd);
+        unlink(new_filename);
+        return 0;
+    }
+    lazy_root_table_sync_folder(table);
+    close(table->journal_fd);
+    table->journal_fd = journal_fd;
+    lazy_root_table_replay(table);
+    
+    snprintf(filename, MAXPATHLEN, "%s/index", table->path);
+    snprintf(new_filename, MAXPATHLEN, "%s/index.migrated", table->path);
+    if (rename(filename, new_filename) != 0) {
+        strerror_r(errno, msg, 1024);
+        ERR("Could not rename the folder '%s' after the migration: %s", filename, msg);
+        return 0;
+    }
+    lazy_root_table_sync_folder(table);
+    INFO("Migrated %lu roots of '%s' into the root table.", num_roots, table->path);
+    return 1;
+}
+
+#pragma mark -
+#pragma mark Compaction
+
+// Number of entries a root has kept during a compaction.
+struct lazy_root_kept_s {
+    unsigned char digest[LAZY_ROOT_DIGEST_LENGTH];
+    uint32_t used;
+    uint32_t num_kept;
+};
+
+// Collects the latest entries of each root in the first 'length' bytes of
+// the journal, starting at the end. 'count' is the number of roots in this
+// part of the journal. Returns the number of entries, which are stored in
+// reverse order.
+static size_t lazy_root_table_collect(int fd, off_t length, uint32_t count, uint32_t history, struct lazy_root_journal_entry_s * result) {
+    uint32_t capacity = LAZY_ROOT_TABLE_MIN_CAPACITY;
+    while (capacity < (size_t)count * 2) {
+        capacity *= 2;
+    }
+    size_t mask = capacity - 1;
+    struct lazy_root_journal_entry_s * entries = malloc(sizeof(struct lazy_root_journal_entry_s) * LAZY_ROOT_JOURNAL_READ_COUNT);
+    struct lazy_root_kept_s * kept = calloc(capacity, sizeof(struct lazy_root_kept_s));
+    assert(entries && kept);
+    
+    size_t num_result = 0;
+    off_t end = length;
+    while (end > 0) {
+        size_t num_entries = LAZY_ROOT_JOURNAL_READ_COUNT;
+        if (end < sizeof(struct lazy_root_journal_entry_s) * num_entries) {
+            num_entries = end / sizeof(struct lazy_root_journal_entry_s);
+        }
+        off_t offset = end - sizeof(struct lazy_root_journal_entry_s) * num_entries;
+        ssize_t bytes_read = pread(fd, entries, sizeof(struct lazy_root_journal_entry_s) * num_entries, offset);
+        if (bytes_read != sizeof(struct lazy_root_journal_entry_s) * num_entries) {
+            num_result = SIZE_MAX;
+            break;
+        }
+        for (size_t loop = num_entries; loop > 0; loop--) {
+            struct lazy_root_journal_entry_s * entry = &(entries[loop - 1]);
+            size_t pos = lazy_root_hash(entry->digest) & mask;
+            while (kept[pos].used && memcmp(kept[pos].digest, entry->digest, LAZY_ROOT_DIGEST_LENGTH) != 0) {
+                pos = (pos + 1) & mask;
+            }
+            if (!kept[pos].used) {
+                memcpy(kept[pos].digest, entry->digest, LAZY_ROOT_DIGEST_LENGTH);
+                kept[pos].used = 1;
+            }
+            // a deleted root is dropped, if no history is kept
+            if (kept[pos].num_kept == 0 && entry->oid == OBJECT_ID_UNKNOWN && history == 0) {
+                kept[pos].num_kept = 1;
+            } else if (kept[pos].num_kept <= history) {
+                result[num_result++] = *entry;
+                kept[pos].num_kept++;
+            }
+        }
+        end = offset;
+    }
+    free(kept);
+    free(entries);
+    return num_result;
+}
+
+// Appends the entries between 'start' and 'end' of the journal to the new
+// journal. Returns 0, if they could not be copied.
+static int lazy_root_journal_copy(int fd, off_t start, off_t end, int new_fd) {
+    struct lazy_root_journal_entry_s entries[128];
+    while (start < end) {
+        size_t length = sizeof(entries);
+        if (end - start < length) {
+            length = end - start;
+        }
+        if (pread(fd, entries, length, start) != length || write(new_fd, entries, length) != length) {
+            return 0;
+        }
+        start += length;
+    }
+    return 1;
+}
+
+// The lock has to be held.
+static inline int lazy_root_table_needs_compaction(struct lazy_root_table_s * table) {
+    return table->journal_length >= LAZY_ROOT_JOURNAL_COMPACT_LENGTH &&
+           table->journal_length >= table->compacted_length * 2;
+}
+
+// Writes the latest entries of each root into a new journal, which replaces
+// the journal. The journal is read without holding the lock; the entries
+// appended in the meantime are copied to the new journal, the last ones
+// under the lock, which is held while the journal is replaced. Runs on the
+// compaction queue.
+static int lazy_root_table_compact_journal(struct lazy_root_table_s * table) {
+    char filename[MAXPATHLEN];
+    char new_filename[MAXPATHLEN];
+    char msg[1024];
+    snprintf(filename, MAXPATHLEN, "%s/roots.journal", table->path);
+    snprintf(new_filename, MAXPATHLEN, "%s/roots.journal.new", table->path);
+    
+    // only the compaction replaces the journal
+    pthread_mutex_lock(&(table->lock));
+    int journal_fd = table->journal_fd;
+    off_t journal_length = table->journal_length;
+    uint32_t count = table->header->count;
+    uint32_t history = table->history;
+    pthread_mutex_unlock(&(table->lock));
+    
+    size_t max_entries = (size_t)count * (history + 1);
+    size_t num_entries = journal_length / sizeof(struct lazy_root_journal_entry_s);
+    if (max_entries < num_entries) {
+        num_entries = max_entries;
+    }
+    struct lazy_root_journal_entry_s * entries = malloc(sizeof(struct lazy_root_journal_entry_s) * (num_entries + 1));
+    assert(entries);
+    num_entries = lazy_root_table_collect(journal_fd, journal_length, count, history, entries);
+    if (num_entries == SIZE_MAX) {
+        ERR("Could not read the root journal '%s'.", filename);
+        free(entries);
+        return 0;
+    }
+    for (size_t loop = 0; loop < num_entries / 2; loop++) {
+        struct lazy_root_journal_entry_s entry = entries[loop];
+        entries[loop] = entries[num_entries - loop - 1];
+        entries[num_entries - loop - 1] = entry;
+    }
+    
+    // the new journal is on the disk, before it replaces the journal
+    size_t length = sizeof(struct lazy_root_journal_entry_s) * num_entries;
+    int fd = open(new_filename, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR);
+    int written = (fd >= 0 && write(fd, entries, length) == length);
+    free(entries);
+    
+    off_t copied = journal_length;
+    if (written) {
+        pthread_mutex_lock(&(table->lock));
+        off_t end = table->journal_length;
+        pthread_mutex_unlock(&(table->lock));
+        written = lazy_root_journal_copy(journal_fd, copied, end, fd) && lazy_fsync(fd);
+        copied = end;
+    }
+    if (written) {
+        pthread_mutex_lock(&(table->lock));
+        written = lazy_root_journal_copy(journal_fd, copied, table->journal_length, fd) && lazy_fsync(fd);
+        if (written && rename(new_filename, filename) == 0) {
+            lazy_root_table_sync_folder(table);
+            DBG("Compacted the root journal of '%s' from %lld to %lu bytes.", table->path, (long long)journal_length, length);
+            close(table->journal_fd);
+            table->journal_fd = fd;
+            table->journal_length = length + (table->journal_length - journal_length);
+            table->compacted_length = length;
+            pthread_mutex_unlock(&(table->lock));
+            return 1;
+        } else if (written) {
+            strerror_r(errno, msg, 1024);
+            ERR("Could not replace the root journal '%s': %s", filename, msg);
+            pthread_mutex_unlock(&(table->lock));
+            close(fd);
+            unlink(new_filename);
+            return 0;
+        }
+        pthread_mutex_unlock(&(table->lock));
+    }
+    strerror_r(errno, msg, 1024);
+    ERR("Could not write the root journal '%s': %s", new_filename, msg);
+    if (fd >= 0) {
+        close(fd);
+        unlink(new_filename);
+    }
+    return 0;
+}
+
+// Compacts the journal on the compaction queue. The lock has to be held.
+static void lazy_root_table_compact_async(struct lazy_root_table_s * table) {
+    table->compacting = 1;
+    dispatch_group_async(lazy_object_get_dispatch_group(), table->compact_queue, ^{
+        int compacted = lazy_root_table_compact_journal(table);
+        
+        // the journal can have reached the limit again in the meantime
+        pthread_mutex_lock(&(table->lock));
+        table->compacting = 0;
+        if (compacted && lazy_root_table_needs_compaction(table)) {
+            lazy_root_table_compact_async(table);
+        }
+        pthread_mutex_unlock(&(table->lock));
+    });
+}
+
+#pragma mark -
+#pragma mark Root Table
+
+struct lazy_root_table_s * lazy_root_table_open(const char * path) {
+    char filename[MAXPATHLEN];
+    char msg[1024];
+    
+    snprintf(filename, MAXPATHLEN, "%s/roots.journal", path);
+    int journal_fd = open(filename, O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+    if (journal_fd < 0) {
+        strerror_r(errno, msg, 1024);
+        ERR("Could not open the root journal '%s': %s", filename, msg);
+        return 0;
+    }
+    struct stat journal_stat;
+    fstat(journal_fd, &journal_stat);
+    
+    struct lazy_root_table_s * table = malloc(sizeof(struct lazy_root_table_s));
+    assert(table);
+    pthread_mutex_init(&(table->lock), 0);
+    strcpy(table->path, path);
+    table->journal_fd = journal_fd;
+    table->journal_length = journal_stat.st_size;
+    table->compacted_length = 0;
+    table->history = LAZY_ROOT_HISTORY_DEFAULT;
+    table->sync_failed = 0;
+    table->compacting = 0;
+    table->compact_queue = dispatch_queue_create(NULL, NULL);
+    
+    // the roots of older databases are migrated, until the root files have
+    // been renamed
+    struct stat index_stat;
+    snprintf(filename, MAXPATHLEN, "%s/index", path);
+    int migrate = (stat(filename, &index_stat) == 0 && S_ISDIR(index_stat.st_mode));
+    
+    // a clean table is used without reading the journal
+    snprintf(filename, MAXPATHLEN, "%s/roots", path);
+    int fd = open(filename, O_RDWR);
+    if (fd >= 0 && lazy_root_table_map(table, fd)) {
+        if (!migrate && table->header->clean && table->header->journal_length == journal_stat.st_size) {
+            lazy_root_table_mark(table, 0);
+            return table;
+        }
+        INFO("Root table '%s' has not been closed, building it again.", filename);
+        lazy_root_table_unmap(table);
+    } else if (fd >= 0) {
+        WARNING("Root table '%s' is not valid, building it again.", filename);
+        close(fd);
+    }
+    
+    fd = lazy_root_table_create(filename, LAZY_ROOT_TABLE_MIN_CAPACITY);
+    if (fd < 0 || !lazy_root_table_map(table, fd)) {
+        ERR("Could not open the root table '%s'.", filename);
+        if (fd >= 0) {
+            close(fd);
+        }
+        close(table->journal_fd);
+        dispatch_release(table->compact_queue);
+        pthread_mutex_destroy(&(table->lock));
+        free(table);
+        return 0;
+    }
+    if (migrate) {
+        if (!lazy_root_table_migrate(table)) {
+            lazy_root_table_unmap(table);
+            close(table->journal_fd);
+            dispatch_release(table->compact_queue);
+            pthread_mutex_destroy(&(table->lock));
+            free(table);
+            return 0;
+        }
+    } else {
+        lazy_root_table_replay(table);
+    }
+    lazy_root_table_mark(table, 0);
+    return table;
+}
+
+void lazy_root_table_close(struct lazy_root_table_s * table) {
+    // waits for a running compaction
+    dispatch_sync(table->compact_queue, ^{});
+    dispatch_release(table->compact_queue);
+    lazy_fsync(table->journal_fd);
+    lazy_root_table_mark(table, 1);
+    lazy_root_table_unmap(table);
+    close(table->journal_fd);
+    pthread_mutex_destroy(&(table->lock));
+    free(table);
+}
+
+int lazy_root_table_get(struct lazy_root_table_s * table, const unsigned char * digest, object_id_t * oid) {
+    pthread_mutex_lock(&(table->lock));
+    struct lazy_root_slot_s * slot = lazy_root_table_slot(table, digest, 0);
+    *oid = slot ? slot->oid : OBJECT_ID_UNKNOWN;
+    pthread_mutex_unlock(&(table->lock));
+    return *oid != OBJECT_ID_UNKNOWN;
+}
+
+void lazy_root_table_set(struct lazy_root_table_s * table, const unsigned char * digest, object_id_t oid) {
+    struct lazy_root_journal_entry_s entry;
+    memcpy(entry.digest, digest, LAZY_ROOT_DIGEST_LENGTH);
+    entry.oid = oid;
+    entry.checksum = lazy_root_journal_checksum(&entry);
+    
+    // the journal has the order of the slot updates
+    pthread_mutex_lock(&(table->lock));
+    lazy_root_table_slot(table, digest, 1)->oid = oid;
+    lazy_root_journal_append(table, &entry);
+    if (!table->compacting && lazy_root_table_needs_compaction(table)) {
+        lazy_root_table_compact_async(table);
+    }
+    pthread_mutex_unlock(&(table->lock));
+}
+
+int lazy_root_table_sync(struct lazy_root_table_s * table) {
+    // the journal can be replaced by a compaction in the meantime
+    pthread_mutex_lock(&(table->lock));
+    int fd = dup(table->journal_fd);
+    pthread_mutex_unlock(&(table->lock));
+    int synced = lazy_fsync(fd);
+    close(fd);
+    
+    pthread_mutex_lock(&(table->lock));
+    if (!synced) {
+        table->sync_failed = 1;
+    }
+    synced = !table->sync_failed;
+    pthread_mutex_unlock(&(table->lock));
+    return synced;
+}
+
+int lazy_root_table_compact(struct lazy_root_table_s * table) {
+    __block int result = 0;
+    dispatch_sync(table->compact_queue, ^{
+        result = lazy_root_table_compact_journal(table);
+    });
+    return result;
+}
@@ -0,0 +1,132 @@
+/*
+ *  lazy_root_table_impl.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 28.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAZY_ROOT_TABLE_IMPL_H_
+#define _LAZY_ROOT_TABLE_IMPL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <dispatch/dispatch.h>
+
+#include "lazy_object_impl.h"
+
+// The roots of a database are kept in a hash table (linear probing) in the
+// file 'roots', which is mapped into memory. The key of a root is the SHA1
+// of its name. A root update stores the new id in the slot of the root (an
+// aligned 8 byte store) and appends it to the journal 'roots.journal'.
+//
+// Only the journal is synced, the table is a cache of the journal. The
+// table is marked as clean, when it is closed, and used without reading the
+// journal, if it is still clean and matches the journal on the next open.
+// Otherwise (e.g., after a crash) it is built again from the journal. The
+// roots of older databases (one file per root in 'index/') are written into
+// a new journal, which replaces the journal. The folder is renamed to
+// 'index.migrated' afterwards; until then, the migration is started again.
+//
+// The journal is compacted, when it has grown to twice its size after the
+// last compaction (and at least LAZY_ROOT_JOURNAL_COMPACT_LENGTH). Only the
+// latest ids of each root (the current id and 'history' previous ids) are
+// written to a new journal, which replaces the old one. The compaction runs
+// on a serial queue of the table, updates only check the limit; the lock is
+// held just to copy the last entries and to replace the journal.
+
+#define LAZY_ROOT_DIGEST_LENGTH 20
+#define LAZY_ROOT_TABLE_MAGIC 0x54524c5a
+#define LAZY_ROOT_TABLE_MIN_CAPACITY 1024
+#define LAZY_ROOT_JOURNAL_COMPACT_LENGTH (1024 * 1024)
+#define LAZY_ROOT_HISTORY_DEFAULT 8
+
+struct lazy_root_table_header_s {
+    uint32_t magic;
+    uint32_t capacity;
+    uint32_t count;
+    
+    // the table contains the first 'journal_length' bytes of the journal,
+    // if it is clean
+    uint32_t clean;
+    uint64_t journal_length;
+    uint32_t reserved[2];
+};
+
+// A deleted root keeps its slot (with OBJECT_ID_UNKNOWN).
+struct lazy_root_slot_s {
+    unsigned char digest[LAZY_ROOT_DIGEST_LENGTH];
+    uint32_t used;
+    volatile object_id_t oid;
+};
+
+// The checksum (CRC32C of digest and id) detects an entry at the end of the
+// journal, which has not been written completely.
+struct lazy_root_journal_entry_s {
+    unsigned char digest[LAZY_ROOT_DIGEST_LENGTH];
+    uint32_t checksum;
+    object_id_t oid;
+};
+
+struct lazy_root_table_s {
+    pthread_mutex_t lock;
+    char path[MAXPATHLEN];
+    
+    // mapping of the table file
+    int fd;
+    struct lazy_root_table_header_s * header;
+    struct lazy_root_slot_s * slots;
+    size_t length;
+    
+    int journal_fd;
+    off_t journal_length;
+    off_t compacted_length;
+    
+    // number of previous ids of a root kept by the compaction
+    uint32_t history;
+    
+    int sync_failed;
+    
+    // a compaction is running or has been started
+    int compacting;
+    dispatch_queue_t compact_queue;
+};
+
+// Opens (or creates) the table of the database in the folder 'path'.
+// Returns 0, if the table could not be opened.
+struct lazy_root_table_s * lazy_root_table_open(const char * path);
+void lazy_root_table_close(struct lazy_root_table_s * table);
+
+// Returns 1 and sets 'oid', if the root is bound.
+int lazy_root_table_get(struct lazy_root_table_s * table, const unsigned char * digest, object_id_t * oid);
+
+// Binds the root to 'oid' (OBJECT_ID_UNKNOWN to delete it). The update has
+// been handed over to the operating system, when the function returns.
+void lazy_root_table_set(struct lazy_root_table_s * table, const unsigned char * digest, object_id_t oid);
+
+// Syncs the journal to the disk. Returns 0, if a sync of the journal has
+// failed.
+int lazy_root_table_sync(struct lazy_root_table_s * table);
+
+// Replaces the journal with a journal, which contains only the latest ids
+// of each root, after a running compaction has finished. Returns 0, if the
+// journal could not be replaced.
+int lazy_root_table_compact(struct lazy_root_table_s * table);
+
+#endif // _LAZY_ROOT_TABLE_IMPL_H_
@@ -0,0 +1,351 @@
+/*
+ *  lazy_slab_impl.c
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 19.04.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lazy_slab_impl.h"
+#include "lazy_logging_impl.h"
+
+#include <lazy.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+#include <libkern/OSAtomic.h>
+
+// Each slab is aligned to LAZY_SLAB_SIZE, thus the slab of a block is found
+// by masking the address of the block. The slab header is followed by the
+// blocks of one size class.
+//
+// The thread which created a slab (the owner) pushes and pops blocks on the
+// local free list without any synchronization. Other threads push freed
+// blocks onto the remote free list of the slab. If this list was empty,
+// the slab is pushed onto the remote list of the owning cache. The owner
+// collects these blocks if it runs out of local blocks.
+//
+// A cache is never freed. If a thread exits, its cache is put aside and
+// adopted by the next new thread.
+
+#define LAZY_SLAB_NUM_CLASSES 10
+
+static const uint32_t lazy_slab_classes[LAZY_SLAB_NUM_CLASSES] = {
+    64, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+struct lazy_slab_cache_s;
+
+struct lazy_block_s {
+    struct lazy_block_s * next;
+};
+
+struct lazy_slab_s {
+    struct lazy_slab_cache_s * cache;
+    
+    // owner only
+    struct lazy_block_s * free_list;
+    struct lazy_slab_s * prev;
+    struct lazy_slab_s * next;
+    uint32_t num_carved;
+    uint32_t num_blocks;
+    uint32_t block_size;
+    int cls;
+    int is_listed;
+    
+    // shared with other threads
+    struct lazy_block_s * volatile remote_free;
+    struct lazy_slab_s * remote_next;
+    volatile int32_t used;
+};
+
+struct lazy_slab_cache_s {
+    // slab used for allocations
+    struct lazy_slab_s * current[LAZY_SLAB_NUM_CLASSES];
+    
+    // other slabs with free blocks
+    struct lazy_slab_s * available[LAZY_SLAB_NUM_CLASSES];
+    
+    // slabs with blocks freed by other threads
+    struct lazy_slab_s * volatile remote_slabs;
+    
+    struct lazy_slab_cache_s * next_orphan;
+};
+
+static void lazy_slab_collect(struct lazy_slab_cache_s * cache);
+
+static pthread_key_t lazy_slab_key;
+static pthread_once_t lazy_slab_once = PTHREAD_ONCE_INIT;
+
+static OSSpinLock lazy_slab_orphans_lock = OS_SPINLOCK_INIT;
+static struct lazy_slab_cache_s * lazy_slab_orphans = 0;
+
+static volatile int64_t lazy_slab_live = 0;
+
+#pragma mark -
+#pragma mark Thread Cache
+
+static void lazy_slab_cache_orphan(void * ptr) {
+    struct lazy_slab_cache_s * cache = ptr;
+    
+    // release the empty slabs before the cache is put aside
+    lazy_slab_collect(cache);
+    
+    OSSpinLockLock(&lazy_slab_orphans_lock);
+    cache->next_orphan = lazy_slab_orphans;
+    lazy_slab_orphans = cache;
+    OSSpinLockUnlock(&lazy_slab_orphans_lock);
+}
+
+static void lazy_slab_init() {
+    int err = pthread_key_create(&lazy_slab_key, lazy_slab_cache_orphan);
+    assert(err == 0);
+}
+
+static struct lazy_slab_cache_s * lazy_slab_get_cache() {
+    pthread_once(&lazy_slab_once, lazy_slab_init);
+    struct lazy_slab_cache_s * cache = pthread_getspecific(lazy_slab_key);
+    if (!cache) {
+        OSSpinLockLock(&lazy_slab_orphans_lock);
+        cache = lazy_slab_orphans;
+        if (cache) {
+            lazy_slab_orphans = cache->next_orphan;
+        }
+        OSSpinLockUnlock(&lazy_slab_orphans_lock);
+        
+        if (!cache) {
+            cache = calloc(1, sizeof(struct lazy_slab_cache_s));
+            assert(cache);
+        }
+        pthread_setspecific(lazy_slab_key, cache);
+    }
+    return cache;
+}
+
+#pragma mark -
+#pragma mark Slabs
+
+static void lazy_slab_list_add(struct lazy_slab_cache_s * cache, struct lazy_slab_s * slab) {
+    slab->prev = 0;
+    slab->next = cache->available[slab->cls];
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+    cache->available[slab->cls] = slab;
+    slab->is_listed = 1;
+}
+
+static void lazy_slab_list_remove(struct lazy_slab_cache_s * cache, struct lazy_slab_s * slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        cache->available[slab->cls] = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->is_listed = 0;
+}
+
+static struct lazy_slab_s * lazy_slab_create(struct lazy_slab_cache_s * cache, int cls) {
+    struct lazy_slab_s * slab;
+    if (posix_memalign((void **)&slab, LAZY_SLAB_SIZE, LAZY_SLAB_SIZE)) {
+        ERR("Could not allocate memory for a new slab.");
+        return 0;
+    }
+    
+    uint32_t header_size = (sizeof(struct lazy_slab_s) + 63) & ~63;
+    
+    slab->cache = cache;
+    slab->free_list = 0;
+    slab->prev = 0;
+    slab->next = 0;
+    slab->num_carved = 0;
+    slab->block_size = lazy_slab_classes[cls];
+    slab->num_blocks = (LAZY_SLAB_SIZE - header_size) / slab->block_size;
+    slab->cls = cls;
+    slab->is_listed = 0;
+    slab->remote_free = 0;
+    slab->remote_next = 0;
+    slab->used = 0;
+    
+    OSAtomicIncrement64(&lazy_slab_live);
+    return slab;
+}
+
+static void lazy_slab_destroy(struct lazy_slab_cache_s * cache, struct lazy_slab_s * slab) {
+    if (slab->is_listed) {
+        lazy_slab_list_remove(cache, slab);
+    }
+    free(slab);
+    OSAtomicDecrement64(&lazy_slab_live);
+}
+
+static void * lazy_slab_pop(struct lazy_slab_s * slab) {
+    struct lazy_block_s * block = slab->free_list;
+    if (block) {
+        slab->free_list = block->next;
+    } else if (slab->num_carved < slab->num_blocks) {
+        uint32_t header_size = (sizeof(struct lazy_slab_s) + 63) & ~63;
+        block = (struct lazy_block_s *)((char *)slab + header_size + slab->num_carved * slab->block_size);
+        slab->num_carved++;
+    } else {
+        return 0;
+    }
+    OSAtomicIncrement32(&(slab->used));
+    return block;
+}
+
+// Moves the blocks freed by other threads to the local free lists.
+static void lazy_slab_collect(struct lazy_slab_cache_s * cache) {
+    struct lazy_slab_s * slab;
+    do {
+        slab = cache->remote_slabs;
+    } while (!OSAtomicCompareAndSwapPtrBarrier(slab, 0, (void * volatile *)&(cache->remote_slabs)));
+    
+    while (slab) {
+        // read the link before the remote list is taken,
+        // the slab can be pushed again afterwards
+        struct lazy_slab_s * next = slab->remote_next;
+        
+        struct lazy_block_s * blocks;
+        do {
+            blocks = slab->remote_free;
+        } while (!OSAtomicCompareAndSwapPtrBarrier(blocks, 0, (void * volatile *)&(slab->remote_free)));
+        
+        while (blocks) {
+            struct lazy_block_s * b = blocks;
+            blocks = blocks->next;
+            b->next = slab->free_list;
+            slab->free_list = b;
+        }
+        
+        if (slab->used == 0 && slab->remote_free == 0 && slab != cache->current[slab->cls]) {
+            lazy_slab_destroy(cache, slab);
+        } else if (!slab->is_listed && slab != cache->current[slab->cls]) {
+            lazy_slab_list_add(cache, slab);
+        }
+        slab = next;
+    }
+}
+
+#pragma mark -
+#pragma mark Allocate & Free
+
+static int lazy_slab_class(size_t size) {
+    for (int cls = 0; cls < LAZY_SLAB_NUM_CLASSES; cls++) {
+        if (size <= lazy_slab_classes[cls]) {
+            return cls;
+        }
+    }
+    return -1;
+}
+
+void * lazy_slab_alloc(size_t size) {
+    int cls = lazy_slab_class(size);
+    if (cls < 0) {
+        return malloc(size);
+    }
+    
+    struct lazy_slab_cache_s * cache = lazy_slab_get_cache();
+    struct lazy_slab_s * slab = cache->current[cls];
+    void * block = slab ? lazy_slab_pop(slab) : 0;
+    if (block) {
+        return block;
+    }
+    
+    // the current slab is exhausted, take the next slab with free blocks
+    if (!cache->available[cls] && cache->remote_slabs) {
+        lazy_slab_collect(cache);
+    }
+    slab = cache->available[cls];
+    if (slab) {
+        lazy_slab_list_remove(cache, slab);
+    } else {
+        slab = lazy_slab_create(cache, cls);
+        if (!slab) {
+            return 0;
+        }
+    }
+    
+    // the previous slab is listed again, as soon as a block is freed
+    cache->current[cls] = slab;
+    return lazy_slab_pop(slab);
+}
+
+void lazy_slab_free(void * ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    
+    if (lazy_slab_class(size) < 0) {
+        free(ptr);
+        return;
+    }
+    
+    struct lazy_block_s * block = ptr;
+    struct lazy_slab_s * slab = (struct lazy_slab_s *)((uintptr_t)ptr & ~((uintptr_t)LAZY_SLAB_SIZE - 1));
+    struct lazy_slab_cache_s * cache = lazy_slab_get_cache();
+    
+    if (slab->cache == cache) {
+        block->next = slab->free_list;
+        slab->free_list = block;
+        int32_t used = OSAtomicDecrement32(&(slab->used));
+        if (slab != cache->current[slab->cls]) {
+            if (used == 0 && slab->remote_free == 0) {
+                lazy_slab_destroy(cache, slab);
+            } else if (!slab->is_listed) {
+                lazy_slab_list_add(cache, slab);
+            }
+        }
+    } else {
+        struct lazy_block_s * head;
+        do {
+            head = slab->remote_free;
+            block->next = head;
+        } while (!OSAtomicCompareAndSwapPtrBarrier(head, block, (void * volatile *)&(slab->remote_free)));
+        
+        if (head == 0) {
+            // first remote block, let the owner know about this slab
+            struct lazy_slab_cache_s * owner = slab->cache;
+            struct lazy_slab_s * slabs;
+            do {
+                slabs = owner->remote_slabs;
+                slab->remote_next = slabs;
+            } while (!OSAtomicCompareAndSwapPtrBarrier(slabs, slab, (void * volatile *)&(owner->remote_slabs)));
+        }
+        
+        // decrease at last, the owner may free the slab if it reaches 0
+        OSAtomicDecrement32Barrier(&(slab->used));
+    }
+}
+
+#pragma mark -
+#pragma mark Statistics
+
+void lz_slab_stats(uint64_t * live_slabs, uint64_t * retained_bytes) {
+    int64_t live = lazy_slab_live;
+    if (live_slabs) {
+        *live_slabs = live;
+    }
+    if (retained_bytes) {
+        *retained_bytes = live * LAZY_SLAB_SIZE;
+    }
+}
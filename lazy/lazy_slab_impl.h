@@ -0,0 +1,43 @@
+/*
+ *  lazy_slab_impl.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 19.04.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAZY_SLAB_IMPL_H_
+#define _LAZY_SLAB_IMPL_H_
+
+#include <stddef.h>
+
+// Allocator for the handles (objects and roots). Blocks are carved out of
+// 64 KB slabs. Each thread allocates from slabs of its own. A block can be
+// freed on any thread; the size given to lazy_slab_free() has to be the
+// size given to lazy_slab_alloc(). Sizes larger than the biggest size class
+// are passed through to malloc() and free().
+
+#define LAZY_SLAB_SIZE (64 * 1024)
+
+#pragma mark -
+#pragma mark Allocate & Free
+
+void * lazy_slab_alloc(size_t size);
+void lazy_slab_free(void * ptr, size_t size);
+
+#endif // _LAZY_SLAB_IMPL_H_
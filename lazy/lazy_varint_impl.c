@@ -0,0 +1,116 @@
+/*
+ *  lazy_varint_impl.c
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 21.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lazy_varint_impl.h"
+
+#include <string.h>
+
+static inline uint64_t lazy_zigzag_encode(uint64_t id, uint64_t ref) {
+    int64_t delta = (int64_t)(id - ref);
+    return ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+}
+
+static inline uint64_t lazy_zigzag_decode(uint64_t id, uint64_t value) {
+    return id - ((value >> 1) ^ -(value & 1));
+}
+
+static inline size_t lazy_varint_length(uint64_t value) {
+    return (64 - __builtin_clzll(value | 1) + 6) / 7;
+}
+
+size_t lazy_refs_encoded_length(uint64_t id, const uint64_t * refs, uint16_t num_ref) {
+    size_t length = 0;
+    for (int loop = 0; loop < num_ref; loop++) {
+        length += lazy_varint_length(lazy_zigzag_encode(id, refs[loop]));
+    }
+    return length;
+}
+
+size_t lazy_refs_encode(uint64_t id, const uint64_t * refs, uint16_t num_ref, char * bytes) {
+    unsigned char * pos = (unsigned char *)bytes;
+    for (int loop = 0; loop < num_ref; loop++) {
+        uint64_t value = lazy_zigzag_encode(id, refs[loop]);
+        while (value >= 0x80) {
+            *pos++ = (value & 0x7f) | 0x80;
+            value >>= 7;
+        }
+        *pos++ = value;
+    }
+    return pos - (unsigned char *)bytes;
+}
+
+#pragma mark -
+#pragma mark Decode
+
+// Decodes a varint of up to 8 bytes from the (little endian) word. The
+// 7 bit groups are packed in three steps, doubling their width each time.
+// Returns the length of the varint or 0, if it is longer than 8 bytes.
+static inline size_t lazy_varint_decode_word(uint64_t word, uint64_t * value) {
+    uint64_t stops = ~word & 0x8080808080808080ULL;
+    if (stops == 0) {
+        return 0;
+    }
+    size_t length = __builtin_ctzll(stops) / 8 + 1;
+    uint64_t x = length < 8 ? word & ((1ULL << (8 * length)) - 1) : word;
+    x &= 0x7f7f7f7f7f7f7f7fULL;
+    x = ((x & 0x7f007f007f007f00ULL) >> 1) | (x & 0x007f007f007f007fULL);
+    x = ((x & 0x3fff00003fff0000ULL) >> 2) | (x & 0x00003fff00003fffULL);
+    x = ((x & 0x0fffffff00000000ULL) >> 4) | (x & 0x000000000fffffffULL);
+    *value = x;
+    return length;
+}
+
+int lazy_refs_decode(uint64_t id, const char * bytes, size_t length, uint64_t * refs, uint16_t num_ref) {
+    const unsigned char * pos = (const unsigned char *)bytes;
+    const unsigned char * end = pos + length;
+    for (int loop = 0; loop < num_ref; loop++) {
+        uint64_t value = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if (end - pos >= 8) {
+            uint64_t word;
+            memcpy(&word, pos, sizeof(uint64_t));
+            size_t n = lazy_varint_decode_word(word, &value);
+            if (n) {
+                pos += n;
+                refs[loop] = lazy_zigzag_decode(id, value);
+                continue;
+            }
+        }
+#endif
+        // at the end of the bytes and for long varints
+        int shift = 0;
+        while (1) {
+            if (pos == end || shift > 63) {
+                return 0;
+            }
+            unsigned char byte = *pos++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+            shift += 7;
+        }
+        refs[loop] = lazy_zigzag_decode(id, value);
+    }
+    return pos == end;
+}
@@ -0,0 +1,49 @@
+/*
+ *  lazy_varint_impl.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 21.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAZY_VARINT_IMPL_H_
+#define _LAZY_VARINT_IMPL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// References of records (since version 3) are stored as varints (7 bits
+// per byte, least significant group first, the high bit is set in all but
+// the last byte). Each varint is the zigzag encoded distance from the
+// record 'id' to the referenced record (id - ref), which is small, because
+// children are usually written in front of their parent.
+
+#define LAZY_VARINT_MAX_LENGTH 10
+
+// Returns the number of bytes of the encoded references.
+size_t lazy_refs_encoded_length(uint64_t id, const uint64_t * refs, uint16_t num_ref);
+
+// Encodes the references into 'bytes' and returns the number of bytes.
+size_t lazy_refs_encode(uint64_t id, const uint64_t * refs, uint16_t num_ref, char * bytes);
+
+// Decodes 'num_ref' references, which have to fill exactly 'length' bytes.
+// Returns 0, if the bytes are not valid. Varints of up to 8 bytes are
+// decoded from a single 64 bit word without branching on each byte.
+int lazy_refs_decode(uint64_t id, const char * bytes, size_t length, uint64_t * refs, uint16_t num_ref);
+
+#endif // _LAZY_VARINT_IMPL_H_
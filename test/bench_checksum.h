@@ -0,0 +1,89 @@
+/*
+ *  bench_checksum.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 07.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_CHECKSUM_H_
+#define _BENCH_CHECKSUM_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "lazy_crc32c_impl.h"
+#include "bench_timer.h"
+
+START_TEST (bench_checksum) {
+    
+    // throughput of the checksum
+    size_t length = 64 * 1024 * 1024;
+    char * buffer = malloc(length);
+    fail_if(buffer == 0);
+    for (size_t loop = 0; loop < length; loop++) {
+        buffer[loop] = loop * 31;
+    }
+    double start = bench_now();
+    volatile uint32_t crc = lazy_crc32c(0, buffer, length);
+    (void)crc;
+    BENCH_REPORT("crc32c: %8.1f MB/s", length / (bench_now() - start) / 1024 / 1024);
+    free(buffer);
+    
+    // writing and (warm) faulting of records with 4 KB payloads
+    int num_obj = 20000;
+    object_id_t * oids = calloc(sizeof(object_id_t), num_obj);
+    void * payload = calloc(1, 4096);
+    fail_if(oids == 0 || payload == 0);
+    for (int checksums = 0; checksums < 2; checksums++) {
+        char path[MAXPATHLEN];
+        snprintf(path, MAXPATHLEN, "./tmp/bench_checksum_%d.db", checksums);
+        lz_db db = lz_db_open(path);
+        fail_if(db == 0);
+        lz_db_set_checksums(db, checksums);
+        start = bench_now();
+        for (int loop = 0; loop < num_obj; loop++) {
+            lz_obj obj = lz_obj_new(payload, 4096, ^{}, 0);
+            oids[loop] = lazy_database_write_object(db, obj);
+            lz_release(obj);
+        }
+        double write = bench_now() - start;
+        lz_release(db);
+        lz_wait_for_completion();
+        
+        db = lz_db_open(path);
+        start = bench_now();
+        for (int loop = 0; loop < num_obj; loop++) {
+            lz_obj obj = lazy_database_read_object(db, oids[loop]);
+            fail_if(obj == 0);
+            lz_release(obj);
+        }
+        double read = bench_now() - start;
+        lz_release(db);
+        lz_wait_for_completion();
+        
+        BENCH_REPORT("checksums %s: %8.2f us/write, %8.2f us/fault",
+                     checksums ? "on " : "off", write * 1000000 / num_obj, read * 1000000 / num_obj);
+    }
+    free(oids);
+    free(payload);
+    
+} END_TEST
+
+#endif // _BENCH_CHECKSUM_H_
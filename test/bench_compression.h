@@ -0,0 +1,86 @@
+/*
+ *  bench_compression.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 02.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_COMPRESSION_H_
+#define _BENCH_COMPRESSION_H_
+
+#include <check.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "test_compression.h"
+#include "bench_fault.h"
+#include "bench_timer.h"
+
+START_TEST (bench_compression) {
+    
+    int num_obj = 20000;
+    uint32_t length = 4096;
+    object_id_t * oids = calloc(sizeof(object_id_t), num_obj);
+    fail_if(oids == 0);
+    
+    for (int compression = 0; compression < 2; compression++) {
+        char path[MAXPATHLEN];
+        snprintf(path, MAXPATHLEN, "./tmp/bench_compression_%d.db", compression);
+        
+        // JSON like payloads
+        lz_db db = lz_db_open(path);
+        fail_if(db == 0);
+        lz_db_set_compression(db, compression, LAZY_COMPRESSION_DEFAULT_THRESHOLD);
+        for (int loop = 0; loop < num_obj; loop++) {
+            char * data = malloc(length);
+            test_compression_text(data, length, loop);
+            lz_obj obj = lz_obj_new(data, length, ^{ free(data); }, 0);
+            oids[loop] = lazy_database_write_object(db, obj);
+            lz_release(obj);
+        }
+        lz_release(db);
+        lz_wait_for_completion();
+        
+        char filename[MAXPATHLEN];
+        snprintf(filename, MAXPATHLEN, "%s/data", path);
+        struct stat data_stat;
+        fail_if(stat(filename, &data_stat) != 0);
+        double ratio = (double)num_obj * length / data_stat.st_size;
+        
+        // random order
+        for (int loop = num_obj - 1; loop > 0; loop--) {
+            int other = random() % (loop + 1);
+            object_id_t oid = oids[loop];
+            oids[loop] = oids[other];
+            oids[other] = oid;
+        }
+        
+        double cold = bench_fault_objects(path, oids, num_obj, 1);
+        double warm = bench_fault_objects(path, oids, num_obj, 0);
+        BENCH_REPORT("compression %s (4 KB text): ratio %5.2f, %8.2f us/fault cold, %8.2f us/fault warm",
+                     compression ? "on " : "off", ratio, 1000000 / cold, 1000000 / warm);
+    }
+    
+    free(oids);
+    
+} END_TEST
+
+#endif // _BENCH_COMPRESSION_H_
@@ -0,0 +1,87 @@
+/*
+ *  bench_dedup.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 04.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_DEDUP_H_
+#define _BENCH_DEDUP_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "bench_timer.h"
+
+// Versions of a tree with 1000 x 100 leaves, 1% of the leaves change
+// between two versions.
+START_TEST (bench_dedup) {
+    
+    int num_versions = 10;
+    int num_inner = 1000;
+    int num_leaves = 100;
+    
+    for (int dedup = 0; dedup < 2; dedup++) {
+        char path[MAXPATHLEN];
+        snprintf(path, MAXPATHLEN, "./tmp/bench_dedup_%d.db", dedup);
+        lz_db db = lz_db_open(path);
+        fail_if(db == 0);
+        lz_db_set_dedup(db, dedup);
+        lz_root root = lz_db_root(db, "root");
+        object_id_t start = db->end_offset;
+        
+        double elapsed = 0;
+        for (int version = 0; version < num_versions; version++) {
+            lz_obj inner[num_inner];
+            for (int i = 0; i < num_inner; i++) {
+                lz_obj leaves[num_leaves];
+                for (int loop = 0; loop < num_leaves; loop++) {
+                    int * data = calloc(16, sizeof(int));
+                    data[0] = i;
+                    data[1] = loop;
+                    data[2] = (i * num_leaves + loop) % 100 == 0 ? version : 0;
+                    leaves[loop] = lz_obj_new(data, 16 * sizeof(int), ^{ free(data); }, 0);
+                }
+                inner[i] = lz_obj_new_v("i", 2, ^{}, num_leaves, leaves);
+                for (int loop = 0; loop < num_leaves; loop++) {
+                    lz_release(leaves[loop]);
+                }
+            }
+            lz_obj tree = lz_obj_new_v("t", 2, ^{}, num_inner, inner);
+            for (int i = 0; i < num_inner; i++) {
+                lz_release(inner[i]);
+            }
+            
+            double t = bench_now();
+            lz_root_set_sync(root, tree, ^{});
+            elapsed += bench_now() - t;
+            lz_release_sync(tree);
+        }
+        
+        BENCH_REPORT("dedup %s (%d versions of 100k objects): %8.1f MB written, %8.3f s per version",
+                     dedup ? "on " : "off", num_versions, (double)(db->end_offset - start) / 1024 / 1024, elapsed / num_versions);
+        lz_release(root);
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    
+} END_TEST
+
+#endif // _BENCH_DEDUP_H_
@@ -0,0 +1,90 @@
+/*
+ *  bench_durability.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 28.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_DURABILITY_H_
+#define _BENCH_DURABILITY_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "bench_timer.h"
+
+START_TEST (bench_durability) {
+    
+    int num_updates = 256;
+    int num_roots = 16;
+    lz_durability modes[] = {LZ_DURABILITY_FLUSH, LZ_DURABILITY_SYNC, LZ_DURABILITY_GROUP};
+    const char * names[] = {"flush", "sync", "group"};
+    
+    for (int m = 0; m < sizeof(modes) / sizeof(lz_durability); m++) {
+        char path[MAXPATHLEN];
+        snprintf(path, MAXPATHLEN, "./tmp/bench_durability_%d.db", m);
+        lz_db db = lz_db_open(path);
+        fail_if(db == 0);
+        lz_db_set_durability(db, modes[m]);
+        
+        lz_root roots[num_roots];
+        for (int r = 0; r < num_roots; r++) {
+            char name[16];
+            snprintf(name, 16, "root %d", r);
+            roots[r] = lz_db_root(db, name);
+        }
+        
+        // latency of a single synchronous update
+        double start = bench_now();
+        for (int loop = 0; loop < num_updates; loop++) {
+            lz_obj obj = lz_obj_new("Foo", 4, ^{}, 0);
+            lz_root_set_sync(roots[0], obj, ^{});
+            lz_release(obj);
+        }
+        double sync_latency = (bench_now() - start) / num_updates;
+        
+        // concurrent asynchronous updates of several roots
+        dispatch_group_t group = dispatch_group_create();
+        start = bench_now();
+        for (int loop = 0; loop < num_updates; loop++) {
+            lz_obj obj = lz_obj_new("Foo", 4, ^{}, 0);
+            dispatch_group_enter(group);
+            lz_root_set_async(roots[loop % num_roots], obj, ^{
+                dispatch_group_leave(group);
+            });
+            lz_release(obj);
+        }
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        double async_latency = (bench_now() - start) / num_updates;
+        dispatch_release(group);
+        
+        BENCH_REPORT("durability %-5s: %8.3f ms per sync update, %8.3f ms per async update",
+                     names[m], sync_latency * 1000, async_latency * 1000);
+        
+        for (int r = 0; r < num_roots; r++) {
+            lz_release(roots[r]);
+        }
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    
+} END_TEST
+
+#endif // _BENCH_DURABILITY_H_
@@ -0,0 +1,105 @@
+/*
+ *  bench_fault.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 10.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_FAULT_H_
+#define _BENCH_FAULT_H_
+
+#include <check.h>
+#include <stdlib.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "test_read_v1_db.h"
+#include "bench_timer.h"
+
+// Faults objects in random order, returns faults per second.
+double bench_fault_objects(const char * path, object_id_t * oids, int num_obj) {
+    lz_db db = lz_db_open(path);
+    
+    double start = bench_now();
+    for (int loop = 0; loop < num_obj; loop++) {
+        lz_obj obj = lazy_database_read_object(db, oids[loop]);
+        fail_if(obj == 0);
+        lz_release(obj);
+    }
+    double elapsed = bench_now() - start;
+    
+    lz_release(db);
+    lz_wait_for_completion();
+    return num_obj / elapsed;
+}
+
+START_TEST (bench_fault) {
+    
+    int num_obj = 100000;
+    object_id_t * oids = calloc(sizeof(object_id_t), num_obj);
+    fail_if(oids == 0);
+    
+    for (int version = 1; version <= LAZY_DATABASE_VERSION; version++) {
+        char path[MAXPATHLEN];
+        snprintf(path, MAXPATHLEN, "./tmp/fault_v%d.db", version);
+        create_db_with_version(path, version);
+        
+        // objects with a payload of 256 bytes and up to 4 references
+        lz_db db = lz_db_open(path);
+        lz_obj prev[4] = {0, 0, 0, 0};
+        for (int loop = 0; loop < num_obj; loop++) {
+            void * data = calloc(1, 256);
+            lz_obj obj = lz_obj_new(data, 256, ^{
+                free(data);
+            }, loop % 5, prev[0], prev[1], prev[2], prev[3]);
+            oids[loop] = lazy_database_write_object(db, obj);
+            lz_release(prev[loop % 4]);
+            prev[loop % 4] = obj;
+        }
+        for (int i = 0; i < 4; i++) {
+            lz_release(prev[i]);
+        }
+        lz_release(db);
+        lz_wait_for_completion();
+        
+        // random order
+        for (int loop = num_obj - 1; loop > 0; loop--) {
+            int other = random() % (loop + 1);
+            object_id_t oid = oids[loop];
+            oids[loop] = oids[other];
+            oids[other] = oid;
+        }
+        
+        // the cold run needs an empty file system cache, purge fails
+        // without root privileges
+        if (system("purge > /dev/null 2>&1") == 0) {
+            double cold = bench_fault_objects(path, oids, num_obj);
+            BENCH_REPORT("faults (format version %d): %10.0f/s cold", version, cold);
+        } else {
+            BENCH_REPORT("faults (format version %d): cold run skipped, the cache could not be purged", version);
+        }
+        double warm = bench_fault_objects(path, oids, num_obj);
+        BENCH_REPORT("faults (format version %d): %10.0f/s warm", version, warm);
+    }
+    
+    free(oids);
+    
+} END_TEST
+
+#endif // _BENCH_FAULT_H_
@@ -0,0 +1,85 @@
+/*
+ *  bench_group_commit.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 24.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_GROUP_COMMIT_H_
+#define _BENCH_GROUP_COMMIT_H_
+
+#include <check.h>
+#include <pthread.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "bench_timer.h"
+
+struct bench_group_commit_s {
+    lz_db db;
+    int iterations;
+};
+
+void * bench_group_commit_thread(void * arg) {
+    struct bench_group_commit_s * b = arg;
+    static char payload[256];
+    for (int loop = 0; loop < b->iterations; loop++) {
+        lz_obj obj = lz_obj_new(payload, sizeof(payload), ^{}, 0);
+        lazy_database_write_object(b->db, obj);
+        lz_release(obj);
+    }
+    return 0;
+}
+
+START_TEST (bench_group_commit) {
+    
+    int num_obj = 64 * 1024;
+    int thread_counts[] = {1, 4, 16, 64};
+    
+    for (int t = 0; t < sizeof(thread_counts) / sizeof(int); t++) {
+        int num_threads = thread_counts[t];
+        pthread_t threads[num_threads];
+        struct bench_group_commit_s args[num_threads];
+        
+        char path[MAXPATHLEN];
+        snprintf(path, MAXPATHLEN, "./tmp/bench_group_commit_%d.db", num_threads);
+        lz_db db = lz_db_open(path);
+        fail_if(db == 0);
+        for (int i = 0; i < num_threads; i++) {
+            args[i].db = db;
+            args[i].iterations = num_obj / num_threads;
+        }
+        
+        double start = bench_now();
+        for (int i = 0; i < num_threads; i++) {
+            pthread_create(&threads[i], 0, bench_group_commit_thread, &args[i]);
+        }
+        for (int i = 0; i < num_threads; i++) {
+            pthread_join(threads[i], 0);
+        }
+        double elapsed = bench_now() - start;
+        
+        BENCH_REPORT("group commit (%2d writers): %10.0f objects/s", num_threads, num_obj / elapsed);
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    
+} END_TEST
+
+#endif // _BENCH_GROUP_COMMIT_H_
@@ -0,0 +1,87 @@
+/*
+ *  bench_import.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 29.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_IMPORT_H_
+#define _BENCH_IMPORT_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "bench_timer.h"
+
+static lz_obj bench_import_tree(int num_inner, int num_leaves, void * payload, uint32_t length) {
+    lz_obj inner[num_inner];
+    for (int i = 0; i < num_inner; i++) {
+        lz_obj leaves[num_leaves];
+        for (int loop = 0; loop < num_leaves; loop++) {
+            leaves[loop] = lz_obj_new(payload, length, ^{}, 0);
+        }
+        inner[i] = lz_obj_new_v(payload, length, ^{}, num_leaves, leaves);
+        for (int loop = 0; loop < num_leaves; loop++) {
+            lz_release(leaves[loop]);
+        }
+    }
+    lz_obj tree = lz_obj_new_v(payload, length, ^{}, num_inner, inner);
+    for (int i = 0; i < num_inner; i++) {
+        lz_release(inner[i]);
+    }
+    return tree;
+}
+
+START_TEST (bench_import) {
+    
+    int num_inner = 1000;
+    int num_leaves = 1000;
+    uint32_t length = 256;
+    void * payload = calloc(1, length);
+    fail_if(payload == 0);
+    double total = (double)num_inner * (num_leaves + 1) * length / 1024 / 1024;
+    
+    for (int import = 0; import < 2; import++) {
+        lz_db db = lz_db_open("./tmp/bench_import.db");
+        fail_if(db == 0);
+        lz_obj tree = bench_import_tree(num_inner, num_leaves, payload, length);
+        lz_root root = lz_db_root(db, "tree");
+        
+        double start = bench_now();
+        if (import) {
+            lz_db_import(db, tree);
+        }
+        lz_root_set_sync(root, tree, ^{});
+        double elapsed = bench_now() - start;
+        
+        BENCH_REPORT("%s (1M objects, %u bytes payload): %8.1f MB/s",
+                     import ? "import     " : "root set   ", length, total / elapsed);
+        
+        lz_release(root);
+        lz_release_sync(tree);
+        lz_release(db);
+        lz_wait_for_completion();
+        system("rm -rf ./tmp/bench_import.db");
+    }
+    free(payload);
+    
+} END_TEST
+
+#endif // _BENCH_IMPORT_H_
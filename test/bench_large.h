@@ -0,0 +1,95 @@
+/*
+ *  bench_large.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 14.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_LARGE_H_
+#define _BENCH_LARGE_H_
+
+#include <check.h>
+#include <stdlib.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "bench_timer.h"
+
+START_TEST (bench_large) {
+    
+    const char * path = "./tmp/bench_large.db";
+    size_t length = 128 * 1024 * 1024;
+    size_t piece = 64 * 1024;
+    char * content = malloc(length);
+    fail_if(content == 0);
+    for (size_t loop = 0; loop < length; loop++) {
+        content[loop] = random();
+    }
+    
+    // streaming in pieces of 64 KB
+    lz_db db = lz_db_open(path);
+    fail_if(db == 0);
+    double start = bench_now();
+    lz_writer writer = lz_writer_new(db);
+    for (size_t pos = 0; pos < length; pos += piece) {
+        lz_writer_write(writer, content + pos, piece);
+    }
+    lz_obj large = lz_writer_finish(writer);
+    double write = bench_now() - start;
+    object_id_t large_oid = large->oid;
+    lz_release(large);
+    
+    // the same content as one (16 MB) object
+    uint32_t small_length = 16 * 1024 * 1024;
+    lz_obj obj = lz_obj_new(content, small_length, ^{}, 0);
+    object_id_t oid = lazy_database_write_object(db, obj);
+    lz_release(obj);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // 4 KB at random offsets of a faulted object
+    int num_reads = 1000;
+    db = lz_db_open(path);
+    start = bench_now();
+    for (int loop = 0; loop < num_reads; loop++) {
+        lz_obj obj = lazy_database_read_object(db, oid);
+        uint64_t offset = random() % (small_length - 4096);
+        lz_obj_read_range(obj, offset, 4096, ^(void * data, size_t l){});
+        lz_release_sync(obj);
+    }
+    double whole = bench_now() - start;
+    
+    large = lazy_database_read_object(db, large_oid);
+    start = bench_now();
+    for (int loop = 0; loop < num_reads; loop++) {
+        uint64_t offset = random() % (length - 4096);
+        lz_obj_read_range(large, offset, 4096, ^(void * data, size_t l){});
+    }
+    double ranged = bench_now() - start;
+    lz_release(large);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    BENCH_REPORT("large objects: %8.1f MB/s written, 4 KB read %8.2f us (ranged), %8.2f us (16 MB object faulted)",
+                 length / write / 1024 / 1024, ranged * 1000000 / num_reads, whole * 1000000 / num_reads);
+    free(content);
+    
+} END_TEST
+
+#endif // _BENCH_LARGE_H_
@@ -0,0 +1,100 @@
+/*
+ *  bench_parallel_append.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 25.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_PARALLEL_APPEND_H_
+#define _BENCH_PARALLEL_APPEND_H_
+
+#include <check.h>
+#include <pthread.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "bench_timer.h"
+
+struct bench_parallel_append_s {
+    lz_db db;
+    void * payload;
+    uint32_t length;
+    int iterations;
+};
+
+void * bench_parallel_append_thread(void * arg) {
+    struct bench_parallel_append_s * b = arg;
+    for (int loop = 0; loop < b->iterations; loop++) {
+        lz_obj obj = lz_obj_new(b->payload, b->length, ^{}, 0);
+        lazy_database_write_object(b->db, obj);
+        lz_release(obj);
+    }
+    return 0;
+}
+
+START_TEST (bench_parallel_append) {
+    
+    uint64_t total = 256 * 1024 * 1024;
+    uint32_t lengths[] = {64 * 1024, 1024 * 1024};
+    int thread_counts[] = {1, 4, 16};
+    
+    for (int l = 0; l < sizeof(lengths) / sizeof(uint32_t); l++) {
+        void * payload = calloc(1, lengths[l]);
+        fail_if(payload == 0);
+        
+        for (int t = 0; t < sizeof(thread_counts) / sizeof(int); t++) {
+            int num_threads = thread_counts[t];
+            pthread_t threads[num_threads];
+            struct bench_parallel_append_s args[num_threads];
+            
+            char path[MAXPATHLEN];
+            snprintf(path, MAXPATHLEN, "./tmp/bench_parallel_append_%d_%d.db", l, num_threads);
+            lz_db db = lz_db_open(path);
+            fail_if(db == 0);
+            for (int i = 0; i < num_threads; i++) {
+                args[i].db = db;
+                args[i].payload = payload;
+                args[i].length = lengths[l];
+                args[i].iterations = total / lengths[l] / num_threads;
+            }
+            
+            double start = bench_now();
+            for (int i = 0; i < num_threads; i++) {
+                pthread_create(&threads[i], 0, bench_parallel_append_thread, &args[i]);
+            }
+            for (int i = 0; i < num_threads; i++) {
+                pthread_join(threads[i], 0);
+            }
+            double elapsed = bench_now() - start;
+            
+            BENCH_REPORT("append (%4u KB payload, %2d writers): %8.1f MB/s",
+                         lengths[l] / 1024, num_threads, total / elapsed / 1024 / 1024);
+            lz_release(db);
+            lz_wait_for_completion();
+            
+            // keep the size of the temporary folder bounded
+            snprintf(path, MAXPATHLEN, "rm -rf ./tmp/bench_parallel_append_%d_%d.db", l, num_threads);
+            system(path);
+        }
+        free(payload);
+    }
+    
+} END_TEST
+
+#endif // _BENCH_PARALLEL_APPEND_H_
@@ -0,0 +1,91 @@
+/*
+ *  bench_retain_release.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 12.04.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_RETAIN_RELEASE_H_
+#define _BENCH_RETAIN_RELEASE_H_
+
+#include <check.h>
+#include <pthread.h>
+#include <lazy.h>
+
+#include "bench_timer.h"
+
+struct bench_retain_release_s {
+    lz_obj obj;
+    int iterations;
+};
+
+void * bench_retain_release_thread(void * arg) {
+    struct bench_retain_release_s * b = arg;
+    for (int loop = 0; loop < b->iterations; loop++) {
+        lz_retain(b->obj);
+        lz_release(b->obj);
+    }
+    return 0;
+}
+
+START_TEST (bench_retain_release) {
+    
+    int iterations = 1000000;
+    int thread_counts[] = {1, 2, 4, 8, 16};
+    
+    // first all threads work on the same object (contended),
+    // then every thread works on an object of its own
+    for (int shared = 1; shared >= 0; shared--) {
+        for (int t = 0; t < sizeof(thread_counts) / sizeof(int); t++) {
+            int num_threads = thread_counts[t];
+            pthread_t threads[num_threads];
+            struct bench_retain_release_s args[num_threads];
+            
+            lz_obj obj = lz_obj_new("Foo", 4, ^{}, 0);
+            for (int i = 0; i < num_threads; i++) {
+                args[i].obj = shared ? lz_retain(obj) : lz_obj_new("Foo", 4, ^{}, 0);
+                args[i].iterations = iterations;
+            }
+            
+            double start = bench_now();
+            for (int i = 0; i < num_threads; i++) {
+                pthread_create(&threads[i], 0, bench_retain_release_thread, &args[i]);
+            }
+            for (int i = 0; i < num_threads; i++) {
+                pthread_join(threads[i], 0);
+            }
+            double elapsed = bench_now() - start;
+            
+            fail_unless(lz_rc(obj) == (shared ? num_threads + 1 : 1));
+            for (int i = 0; i < num_threads; i++) {
+                lz_release(args[i].obj);
+            }
+            lz_release(obj);
+            
+            BENCH_REPORT("retain/release (%s, %2d threads): %8.2f M pairs/s",
+                         shared ? "shared object" : "own object",
+                         num_threads,
+                         num_threads * iterations / elapsed / 1e6);
+        }
+    }
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _BENCH_RETAIN_RELEASE_H_
@@ -0,0 +1,67 @@
+/*
+ *  bench_root_compaction.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 05.07.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_ROOT_COMPACTION_H_
+#define _BENCH_ROOT_COMPACTION_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "bench_timer.h"
+
+START_TEST (bench_root_compaction) {
+    
+    const char * path = "./tmp/bench_root_compaction.db";
+    int num_updates = 1000000;
+    
+    // one root, which is updated very often
+    lz_db db = lz_db_open(path);
+    fail_if(db == 0);
+    lz_obj obj = lz_obj_new("Foo", 4, ^{}, 0);
+    lz_root root = lz_db_root(db, "counter");
+    double start = bench_now();
+    for (int loop = 0; loop < num_updates; loop++) {
+        lz_root_set_sync(root, obj, ^{});
+    }
+    double set = bench_now() - start;
+    off_t journal_length = db->roots->journal_length;
+    lz_release(root);
+    lz_release(obj);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    start = bench_now();
+    db = lz_db_open(path);
+    root = lz_db_root(db, "counter");
+    double open = bench_now() - start;
+    lz_release(root);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    BENCH_REPORT("root compaction: %8.2f us per update, journal %lld KB after %d updates, open %8.2f ms",
+                 set * 1000000 / num_updates, (long long)journal_length / 1024, num_updates, open * 1000);
+    
+} END_TEST
+
+#endif // _BENCH_ROOT_COMPACTION_H_
@@ -0,0 +1,75 @@
+/*
+ *  bench_roots.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 28.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_ROOTS_H_
+#define _BENCH_ROOTS_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "bench_timer.h"
+
+START_TEST (bench_roots) {
+    
+    const char * path = "./tmp/bench_roots.db";
+    int num_roots = 100000;
+    char name[64];
+    
+    lz_db db = lz_db_open(path);
+    fail_if(db == 0);
+    lz_db_set_durability(db, LZ_DURABILITY_FLUSH);
+    lz_obj obj = lz_obj_new("Foo", 4, ^{}, 0);
+    
+    double start = bench_now();
+    for (int loop = 0; loop < num_roots; loop++) {
+        snprintf(name, 64, "root %d", loop);
+        lz_root root = lz_db_root(db, name);
+        lz_root_set_sync(root, obj, ^{});
+        lz_release(root);
+    }
+    double set = bench_now() - start;
+    lz_release(obj);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    start = bench_now();
+    db = lz_db_open(path);
+    double open = bench_now() - start;
+    
+    start = bench_now();
+    for (int loop = 0; loop < num_roots; loop++) {
+        snprintf(name, 64, "root %d", loop);
+        lz_root root = lz_db_root(db, name);
+        lz_release(root);
+    }
+    double lookup = bench_now() - start;
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    BENCH_REPORT("roots: %8.2f us per update, %8.2f us per lookup, %8.2f ms to open %d roots",
+                 set * 1000000 / num_roots, lookup * 1000000 / num_roots, open * 1000, num_roots);
+    
+} END_TEST
+
+#endif // _BENCH_ROOTS_H_
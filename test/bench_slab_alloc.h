@@ -0,0 +1,89 @@
+/*
+ *  bench_slab_alloc.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 19.04.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_SLAB_ALLOC_H_
+#define _BENCH_SLAB_ALLOC_H_
+
+#include <check.h>
+#include <stdlib.h>
+#include <lazy.h>
+
+#include "lazy_object_impl.h"
+#include "lazy_slab_impl.h"
+#include "bench_timer.h"
+
+// Same pattern as in test_chunk_swapping: handles are created concurrently
+// on the global queue and released in a different order (and therefore
+// mostly on different threads).
+
+START_TEST (bench_slab_alloc) {
+    
+    int num_obj = 1000000;
+    int rounds = 5;
+    size_t size = sizeof(struct lazy_object_s);
+    void ** ptrs = calloc(num_obj, sizeof(void *));
+    fail_if(ptrs == 0);
+    
+    for (int use_slab = 0; use_slab < 2; use_slab++) {
+        double start = bench_now();
+        for (int round = 0; round < rounds; round++) {
+            dispatch_apply(num_obj, dispatch_get_global_queue(0, 0), ^(size_t loop){
+                ptrs[loop] = use_slab ? lazy_slab_alloc(size) : malloc(size);
+                fail_if(ptrs[loop] == 0);
+            });
+            dispatch_apply(num_obj, dispatch_get_global_queue(0, 0), ^(size_t loop){
+                void * ptr = ptrs[num_obj - loop - 1];
+                if (use_slab) {
+                    lazy_slab_free(ptr, size);
+                } else {
+                    free(ptr);
+                }
+            });
+        }
+        double elapsed = bench_now() - start;
+        
+        BENCH_REPORT("%s (%lu bytes): %8.2f M alloc/free pairs/s",
+                     use_slab ? "lazy_slab_alloc" : "malloc",
+                     size,
+                     (double)num_obj * rounds / elapsed / 1e6);
+    }
+    free(ptrs);
+    
+    // whole object handles
+    double start = bench_now();
+    dispatch_apply(num_obj, dispatch_get_global_queue(0, 0), ^(size_t loop){
+        lz_obj obj = lz_obj_new("Foo", 4, ^{}, 0);
+        fail_if(obj == 0);
+        lz_release(obj);
+    });
+    lz_wait_for_completion();
+    double elapsed = bench_now() - start;
+    BENCH_REPORT("lz_obj_new/lz_release: %8.2f M objects/s", num_obj / elapsed / 1e6);
+    
+    uint64_t live_slabs, retained_bytes;
+    lz_slab_stats(&live_slabs, &retained_bytes);
+    BENCH_REPORT("live slabs: %llu, retained bytes: %llu", live_slabs, retained_bytes);
+    
+} END_TEST
+
+#endif // _BENCH_SLAB_ALLOC_H_
@@ -0,0 +1,41 @@
+/*
+ *  bench_timer.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 12.04.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BENCH_TIMER_H_
+#define _BENCH_TIMER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <mach/mach_time.h>
+
+#define BENCH_REPORT(...) {printf(__VA_ARGS__); printf("\n");}
+
+double bench_now() {
+    static mach_timebase_info_data_t info;
+    if (info.denom == 0) {
+        mach_timebase_info(&info);
+    }
+    return (double)mach_absolute_time() * info.numer / info.denom / 1e9;
+}
+
+#endif // _BENCH_TIMER_H_
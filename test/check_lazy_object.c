@@ -33,6 +33,41 @@
 #include "test_create_open_db.h"
 #include "test_chunk_write.h"
 #include "test_chunk_swapping.h"
+#include "test_release_graph.h"
+#include "test_mmap_read.h"
+#include "test_read_v1_db.h"
+#include "test_identity_map.h"
+#include "test_concurrent_fault.h"
+#include "test_prefetch.h"
+#include "test_cache_limit.h"
+#include "test_ref_async.h"
+#include "test_group_commit.h"
+#include "test_parallel_append.h"
+#include "test_write_large_graph.h"
+#include "test_durability.h"
+#include "test_import.h"
+#include "test_root_pipeline.h"
+#include "test_compression.h"
+#include "test_dedup.h"
+#include "test_checksum.h"
+#include "test_large.h"
+#include "test_ref_encoding.h"
+#include "test_root_table.h"
+#include "test_root_compaction.h"
+
+#include "bench_retain_release.h"
+#include "bench_slab_alloc.h"
+#include "bench_fault.h"
+#include "bench_group_commit.h"
+#include "bench_parallel_append.h"
+#include "bench_durability.h"
+#include "bench_import.h"
+#include "bench_compression.h"
+#include "bench_dedup.h"
+#include "bench_checksum.h"
+#include "bench_large.h"
+#include "bench_roots.h"
+#include "bench_root_compaction.h"
 
 #pragma mark -
 #pragma mark Fixtures
@@ -62,12 +97,64 @@ Suite * lazy_object_suite(void) {
     tcase_add_test(tc_core, test_create_open_db);
     tcase_add_test(tc_core, test_chunk_write);
     tcase_add_test(tc_core, test_chunk_swapping);
+    tcase_add_test(tc_core, test_release_graph);
+    tcase_add_test(tc_core, test_mmap_read);
+    tcase_add_test(tc_core, test_read_v1_db);
+    tcase_add_test(tc_core, test_identity_map);
+    tcase_add_test(tc_core, test_concurrent_fault);
+    tcase_add_test(tc_core, test_prefetch);
+    tcase_add_test(tc_core, test_cache_limit);
+    tcase_add_test(tc_core, test_ref_async);
+    tcase_add_test(tc_core, test_group_commit);
+    tcase_add_test(tc_core, test_parallel_append);
+    tcase_add_test(tc_core, test_write_large_graph);
+    tcase_add_test(tc_core, test_durability);
+    tcase_add_test(tc_core, test_import);
+    tcase_add_test(tc_core, test_root_pipeline);
+    tcase_add_test(tc_core, test_compression);
+    tcase_add_test(tc_core, test_dedup);
+    tcase_add_test(tc_core, test_checksum);
+    tcase_add_test(tc_core, test_large);
+    tcase_add_test(tc_core, test_ref_encoding);
+    tcase_add_test(tc_core, test_root_table);
+    tcase_add_test(tc_core, test_root_table_migration);
+    tcase_add_test(tc_core, test_root_compaction);
 	
     suite_add_tcase(s, tc_core);
     
     return s;
 }
 
+#pragma mark -
+#pragma mark Benchmark Suites
+
+Suite * lazy_object_benchmark_suite(void) {
+    
+    Suite *s = suite_create("Lazy Object Benchmarks");
+    
+    TCase *tc_bench = tcase_create("Benchmarks");
+    tcase_add_checked_fixture (tc_bench, setup, teardown);
+    tcase_set_timeout(tc_bench, 600);
+    
+    tcase_add_test(tc_bench, bench_retain_release);
+    tcase_add_test(tc_bench, bench_slab_alloc);
+    tcase_add_test(tc_bench, bench_fault);
+    tcase_add_test(tc_bench, bench_group_commit);
+    tcase_add_test(tc_bench, bench_parallel_append);
+    tcase_add_test(tc_bench, bench_durability);
+    tcase_add_test(tc_bench, bench_import);
+    tcase_add_test(tc_bench, bench_compression);
+    tcase_add_test(tc_bench, bench_dedup);
+    tcase_add_test(tc_bench, bench_checksum);
+    tcase_add_test(tc_bench, bench_large);
+    tcase_add_test(tc_bench, bench_roots);
+    tcase_add_test(tc_bench, bench_root_compaction);
+    
+    suite_add_tcase(s, tc_bench);
+    
+    return s;
+}
+
 #pragma mark -
 #pragma mark Main Suite
 
@@ -92,6 +179,11 @@ int main(int argc, char ** argv) {
     // add the suites to the main suite
     srunner_add_suite(sr, lazy_object_suite());
     
+    // benchmarks take a while, run them only on request
+    if (getenv("LAZY_BENCHMARK")) {
+        srunner_add_suite(sr, lazy_object_benchmark_suite());
+    }
+    
     srunner_run_all(sr, CK_NORMAL);
     number_failed = srunner_ntests_failed (sr);
     srunner_free (sr);
@@ -0,0 +1,121 @@
+/*
+ *  test_cache_limit.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 21.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_CACHE_LIMIT_H_
+#define _TEST_CACHE_LIMIT_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_cache_limit) {
+    
+    int num_obj = 1000;
+    uint64_t limit = 64 * 1024;
+    
+    struct data_s {
+        uint64_t i;
+        int8_t foo[1024];
+    };
+    
+    // a list of objects with a payload of 1 KB each
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    lz_obj list = 0;
+    for (int loop = 0; loop < num_obj; loop++) {
+        struct data_s * data = malloc(sizeof(struct data_s));
+        fail_if(data == 0);
+        data->i = loop;
+        lz_obj obj = list ? lz_obj_new(data, sizeof(struct data_s), ^{ free(data); }, 1, list)
+                          : lz_obj_new(data, sizeof(struct data_s), ^{ free(data); }, 0);
+        lz_release(list);
+        list = obj;
+    }
+    object_id_t oid = lazy_database_write_object(db, list);
+    lz_release(list);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    lz_db_set_cache_limit(db, limit);
+    
+    // walk through the whole list while holding the head
+    for (int round = 0; round < 2; round++) {
+        lz_obj head = lazy_database_read_object(db, oid);
+        lz_obj obj = lz_retain(head);
+        for (int loop = num_obj - 1; loop >= 0; loop--) {
+            lz_obj_sync(obj, ^(void * d, uint32_t s){
+                fail_unless(sizeof(struct data_s) == s);
+                fail_unless(((struct data_s *)d)->i == loop);
+            });
+            lz_obj next = loop > 0 ? lz_obj_ref(obj, 0) : 0;
+            lz_release(obj);
+            obj = next;
+        }
+        lz_wait_for_completion();
+        
+        // the payloads have been evicted in the background, except those
+        // in use at that time, which are evicted now
+        lazy_database_trim_cache(db);
+        fail_unless(lz_db_cache_size(db) <= limit);
+        lz_release(head);
+    }
+    
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // the payloads of new objects are not evicted, after they are written
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    lz_db_set_cache_limit(db, sizeof(struct data_s));
+    __block volatile int32_t num_dealloc = 0;
+    lz_obj objs[16];
+    for (int loop = 0; loop < 16; loop++) {
+        struct data_s * data = malloc(sizeof(struct data_s));
+        fail_if(data == 0);
+        data->i = loop;
+        objs[loop] = lz_obj_new(data, sizeof(struct data_s), ^{
+            OSAtomicIncrement32Barrier(&num_dealloc);
+            free(data);
+        }, 0);
+        lazy_database_write_object(db, objs[loop]);
+    }
+    lz_wait_for_completion();
+    fail_unless(lz_db_cache_size(db) == 0);
+    fail_unless(num_dealloc == 0);
+    for (int loop = 0; loop < 16; loop++) {
+        lz_obj_sync(objs[loop], ^(void * d, uint32_t s){
+            fail_unless(((struct data_s *)d)->i == loop);
+        });
+        lz_release_sync(objs[loop]);
+    }
+    lz_release(db);
+    lz_wait_for_completion();
+    fail_unless(num_dealloc == 16);
+    
+} END_TEST
+
+#endif // _TEST_CACHE_LIMIT_H_
@@ -0,0 +1,131 @@
+/*
+ *  test_checksum.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 07.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_CHECKSUM_H_
+#define _TEST_CHECKSUM_H_
+
+#include <check.h>
+#include <fcntl.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "lazy_crc32c_impl.h"
+
+// Overwrites a byte of the data file.
+static void test_checksum_corrupt(const char * path, uint64_t offset, char value) {
+    char filename[MAXPATHLEN];
+    snprintf(filename, MAXPATHLEN, "%s/data", path);
+    int fd = open(filename, O_WRONLY);
+    fail_if(fd < 0);
+    fail_unless(pwrite(fd, &value, 1, offset) == 1);
+    close(fd);
+}
+
+START_TEST (test_checksum) {
+    
+    // check value of CRC32C
+    fail_unless(lazy_crc32c(0, "123456789", 9) == 0xE3069283);
+    fail_unless(lazy_crc32c(lazy_crc32c(0, "1234", 4), "56789", 5) == 0xE3069283);
+    
+    const char * path = "./tmp/test_checksum.db";
+    lz_db db = lz_db_open(path);
+    fail_if(db == 0);
+    lz_db_set_checksums(db, 1);
+    
+    size_t length = 8192;
+    char * text = calloc(1, length);
+    fail_if(text == 0);
+    lz_obj a = lz_obj_new("a", 2, ^{}, 0);
+    lz_obj b = lz_obj_new(text, length, ^{}, 1, a);
+    lz_obj_set_compression(b, 1);
+    lz_obj c = lz_obj_new("c", 2, ^{}, 2, a, b);
+    object_id_t oid_c = lazy_database_write_object(db, c);
+    object_id_t oid_a = a->oid;
+    object_id_t oid_b = b->oid;
+    lz_release(a);
+    lz_release(b);
+    lz_release(c);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // valid records
+    for (int mmap = 0; mmap < 2; mmap++) {
+        db = lz_db_open(path);
+        lz_db_set_mmap(db, mmap);
+        object_id_t oids[] = {oid_a, oid_b, oid_c};
+        for (int loop = 0; loop < 3; loop++) {
+            lz_obj obj = lazy_database_read_object(db, oids[loop]);
+            fail_if(obj == 0);
+            lz_release(obj);
+        }
+        fail_unless(lz_db_scrub(db, 0) == 0);
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    
+    // a flipped bit in the payload of 'a'
+    test_checksum_corrupt(path, oid_a + sizeof(struct lazy_record_header_s) + sizeof(uint32_t), 'x');
+    for (int mmap = 0; mmap < 2; mmap++) {
+        db = lz_db_open(path);
+        lz_db_set_mmap(db, mmap);
+        fail_unless(lazy_database_read_object(db, oid_a) == 0);
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    
+    // trusted reads skip the verification
+    db = lz_db_open(path);
+    lz_db_set_verify(db, 0);
+    lz_obj obj = lazy_database_read_object(db, oid_a);
+    fail_if(obj == 0);
+    lz_obj_sync(obj, ^(void * data, uint32_t l){
+        fail_unless(((char *)data)[0] == 'x');
+    });
+    lz_release(obj);
+    
+    __block uint64_t invalid = 0;
+    fail_unless(lz_db_scrub(db, ^(uint64_t offset){ invalid = offset; }) == 1);
+    fail_unless(invalid == oid_a);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // an invalid length is not trusted, the checksum of a mapped record is
+    // only computed in front of the end of the file
+    uint32_t huge = UINT32_MAX;
+    for (int loop = 0; loop < sizeof(uint32_t); loop++) {
+        test_checksum_corrupt(path, oid_b + offsetof(struct lazy_record_header_s, payload_length) + loop, ((char *)&huge)[loop]);
+    }
+    for (int mmap = 0; mmap < 2; mmap++) {
+        db = lz_db_open(path);
+        lz_db_set_mmap(db, mmap);
+        fail_unless(lazy_database_read_object(db, oid_b) == 0);
+        fail_unless(lz_db_scrub(db, 0) >= 2);
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    
+    free(text);
+    
+} END_TEST
+
+#endif // _TEST_CHECKSUM_H_
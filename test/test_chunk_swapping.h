@@ -59,6 +59,7 @@ START_TEST (test_chunk_swapping) {
     lz_wait_for_completion();
     
     db = lz_db_open("./tmp/test.db");
+    lz_db_set_cache_limit(db, 1024 * 1024);
     dispatch_apply(num_obj, dispatch_get_global_queue(0, 0), ^(size_t loop){
         lz_obj obj = lazy_database_read_object(db, oids[loop]);
         fail_if(obj == 0);
@@ -0,0 +1,148 @@
+/*
+ *  test_compression.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 02.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_COMPRESSION_H_
+#define _TEST_COMPRESSION_H_
+
+#include <check.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "lazy_compress_impl.h"
+
+// Fills the buffer with JSON like text.
+static void test_compression_text(char * buffer, size_t length, unsigned int seed) {
+    const char * words[] = {"{\"name\": ", "\"lazy\", ", "\"value\": ", "42, ", "\"items\": [", "], ", "\"object\"}, "};
+    size_t pos = 0;
+    while (pos < length) {
+        const char * word = words[rand_r(&seed) % 7];
+        size_t n = strlen(word);
+        if (n > length - pos) {
+            n = length - pos;
+        }
+        memcpy(buffer + pos, word, n);
+        pos += n;
+    }
+}
+
+// Reads the flags of a record from the data file.
+static uint16_t test_compression_record_flags(const char * path, object_id_t oid) {
+    char filename[MAXPATHLEN];
+    snprintf(filename, MAXPATHLEN, "%s/data", path);
+    int fd = open(filename, O_RDONLY);
+    fail_if(fd < 0);
+    struct lazy_record_header_s header;
+    fail_unless(pread(fd, &header, sizeof(struct lazy_record_header_s), oid) == sizeof(struct lazy_record_header_s));
+    close(fd);
+    return header.flags;
+}
+
+START_TEST (test_compression) {
+    
+    // the codec
+    size_t length = 100000;
+    char * text = malloc(length);
+    char * random_data = malloc(length);
+    char * compressed = malloc(lazy_compress_bound(length));
+    char * decompressed = malloc(length);
+    fail_if(!text || !random_data || !compressed || !decompressed);
+    test_compression_text(text, length, 1);
+    for (size_t loop = 0; loop < length; loop++) {
+        random_data[loop] = random();
+    }
+    
+    size_t compressed_length = lazy_compress(text, length, compressed, lazy_compress_bound(length));
+    fail_unless(compressed_length > 0 && compressed_length < length / 3);
+    fail_unless(lazy_decompress(compressed, compressed_length, decompressed, length) == 0);
+    fail_unless(memcmp(text, decompressed, length) == 0);
+    
+    compressed_length = lazy_compress(random_data, length, compressed, lazy_compress_bound(length));
+    fail_unless(compressed_length > 0);
+    fail_unless(lazy_decompress(compressed, compressed_length, decompressed, length) == 0);
+    fail_unless(memcmp(random_data, decompressed, length) == 0);
+    
+    // the output is too small or the data is corrupt
+    fail_unless(lazy_compress(random_data, length, compressed, length / 2) == 0);
+    fail_unless(lazy_decompress(compressed, compressed_length / 2, decompressed, length) == -1);
+    free(compressed);
+    free(decompressed);
+    
+    // records
+    lz_db db = lz_db_open("./tmp/test_compression.db");
+    fail_if(db == 0);
+    lz_db_set_compression(db, 1, 1024);
+    
+    lz_obj objs[5];
+    objs[0] = lz_obj_new(text, length, ^{}, 0);
+    objs[1] = lz_obj_new(random_data, length, ^{}, 0);
+    objs[2] = lz_obj_new(text, 1000, ^{}, 0);
+    objs[3] = lz_obj_new(text, 2000, ^{}, 0);
+    lz_obj_set_compression(objs[3], 0);
+    objs[4] = lz_obj_new(text + 1, 2000, ^{}, 4, objs[0], objs[1], objs[2], objs[3]);
+    uint16_t expected[] = {LAZY_RECORD_COMPRESSED, 0, 0, 0, LAZY_RECORD_COMPRESSED};
+    
+    lz_root root = lz_db_root(db, "root");
+    lz_root_set_sync(root, objs[4], ^{});
+    lz_release(root);
+    object_id_t oids[5];
+    for (int loop = 0; loop < 5; loop++) {
+        oids[loop] = objs[loop]->oid;
+        lz_release(objs[loop]);
+    }
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    for (int loop = 0; loop < 5; loop++) {
+        fail_unless(test_compression_record_flags("./tmp/test_compression.db", oids[loop]) == expected[loop]);
+    }
+    
+    // read with pread() and from the mapping
+    const void * payloads[] = {text, random_data, text, text, text + 1};
+    uint32_t lengths[] = {length, length, 1000, 2000, 2000};
+    for (int mmap = 0; mmap < 2; mmap++) {
+        db = lz_db_open("./tmp/test_compression.db");
+        fail_if(db == 0);
+        lz_db_set_mmap(db, mmap);
+        for (int loop = 0; loop < 5; loop++) {
+            const void * payload = payloads[loop];
+            uint32_t payload_length = lengths[loop];
+            lz_obj obj = lazy_database_read_object(db, oids[loop]);
+            fail_if(obj == 0);
+            lz_obj_sync(obj, ^(void * data, uint32_t l){
+                fail_unless(l == payload_length);
+                fail_unless(memcmp(data, payload, l) == 0);
+            });
+            lz_release(obj);
+        }
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    
+    free(text);
+    free(random_data);
+    
+} END_TEST
+
+#endif // _TEST_COMPRESSION_H_
@@ -0,0 +1,89 @@
+/*
+ *  test_concurrent_fault.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 18.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_CONCURRENT_FAULT_H_
+#define _TEST_CONCURRENT_FAULT_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_concurrent_fault) {
+    
+    int num_children = 256;
+    object_id_t oid;
+    
+    // all children reference the same object
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    lz_obj shared = lz_obj_new("shared", 7, ^{}, 0);
+    lz_obj children[num_children];
+    for (int loop = 0; loop < num_children; loop++) {
+        children[loop] = lz_obj_new("child", 6, ^{}, 1, shared);
+    }
+    lz_obj parent = lz_obj_new_v("parent", 7, ^{}, num_children, children);
+    for (int loop = 0; loop < num_children; loop++) {
+        lz_release(children[loop]);
+    }
+    lz_release(shared);
+    
+    oid = lazy_database_write_object(db, parent);
+    lz_release(parent);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // fault the same slots from many threads
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    parent = lazy_database_read_object(db, oid);
+    fail_if(parent == 0);
+    
+    lz_obj * results = calloc(16 * num_children, sizeof(lz_obj));
+    dispatch_apply(16, dispatch_get_global_queue(0, 0), ^(size_t i) {
+        for (int loop = 0; loop < num_children; loop++) {
+            lz_obj child = lz_obj_weak_ref(parent, loop);
+            results[i * num_children + loop] = lz_obj_weak_ref(child, 0);
+        }
+    });
+    
+    // one handle per object, each only retained by its slots
+    lz_obj s = lz_obj_weak_ref(lz_obj_weak_ref(parent, 0), 0);
+    fail_unless(lz_rc(s) == num_children);
+    for (int loop = 0; loop < num_children; loop++) {
+        fail_unless(lz_rc(lz_obj_weak_ref(parent, loop)) == 1);
+        for (int i = 0; i < 16; i++) {
+            fail_unless(results[i * num_children + loop] == s);
+        }
+    }
+    free(results);
+    
+    lz_release(parent);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_CONCURRENT_FAULT_H_
@@ -32,12 +32,12 @@ START_TEST (test_create_open_db) {
 	lz_db db;
 	
 	db = lz_db_open("./tmp/test.db");
-	fail_unless(lz_db_version(db) == 1);
+	fail_unless(lz_db_version(db) == 3);
 	lz_release(db);
 	lz_wait_for_completion();
 	
 	db = lz_db_open("./tmp/test.db");
-	fail_unless(lz_db_version(db) == 1);
+	fail_unless(lz_db_version(db) == 3);
 	lz_release(db);
 	lz_wait_for_completion();
 	
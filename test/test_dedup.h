@@ -0,0 +1,139 @@
+/*
+ *  test_dedup.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 04.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_DEDUP_H_
+#define _TEST_DEDUP_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "lazy_dedup_impl.h"
+
+// A snapshot with 100 inner objects and 10 leaves each. Only 10 of the
+// leaves and 10 of the inner objects are different.
+static lz_obj test_dedup_snapshot(const char * name) {
+    lz_obj inner[100];
+    for (int i = 0; i < 100; i++) {
+        lz_obj leaves[10];
+        for (int loop = 0; loop < 10; loop++) {
+            char * data = calloc(1, 16);
+            snprintf(data, 16, "leaf %d", loop);
+            leaves[loop] = lz_obj_new(data, 16, ^{ free(data); }, 0);
+        }
+        char * data = calloc(1, 16);
+        snprintf(data, 16, "inner %d", i % 10);
+        inner[i] = lz_obj_new_v(data, 16, ^{ free(data); }, 10, leaves);
+        for (int loop = 0; loop < 10; loop++) {
+            lz_release(leaves[loop]);
+        }
+    }
+    lz_obj snapshot = lz_obj_new_v((void *)name, strlen(name) + 1, ^{}, 100, inner);
+    for (int i = 0; i < 100; i++) {
+        lz_release(inner[i]);
+    }
+    return snapshot;
+}
+
+START_TEST (test_dedup) {
+    
+    lz_db db = lz_db_open("./tmp/test_dedup.db");
+    fail_if(db == 0);
+    lz_db_set_dedup(db, 1);
+    
+    // equal objects of a graph are stored once
+    object_id_t start = db->end_offset;
+    lz_obj v1 = test_dedup_snapshot("v1");
+    lz_root root = lz_db_root(db, "v1");
+    lz_root_set_sync(root, v1, ^{});
+    lz_release(root);
+    fail_unless(lz_obj_weak_ref(v1, 0)->oid == lz_obj_weak_ref(v1, 10)->oid);
+    fail_unless(lz_obj_weak_ref(v1, 0)->oid != lz_obj_weak_ref(v1, 1)->oid);
+    fail_unless(lz_obj_weak_ref(lz_obj_weak_ref(v1, 0), 3)->oid == lz_obj_weak_ref(lz_obj_weak_ref(v1, 1), 3)->oid);
+    object_id_t size = db->end_offset - start;
+    
+    // an equal snapshot only adds the (different) root object
+    lz_obj v2 = test_dedup_snapshot("v2");
+    root = lz_db_root(db, "v2");
+    lz_root_set_sync(root, v2, ^{});
+    lz_release(root);
+    fail_unless(lz_obj_same(lz_obj_weak_ref(v1, 5), lz_obj_weak_ref(v2, 5)));
+    fail_if(lz_obj_same(v1, v2));
+    fail_unless(db->end_offset - start < size * 2 - size / 2);
+    lz_release_sync(v1);
+    lz_release_sync(v2);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // the index is persistent, imports are deduplicated as well
+    db = lz_db_open("./tmp/test_dedup.db");
+    fail_if(db == 0);
+    lz_db_set_dedup(db, 1);
+    object_id_t end = db->end_offset;
+    lz_obj v3 = test_dedup_snapshot("v1");
+    lz_db_import(db, v3);
+    fail_unless(db->end_offset == end);
+    
+    root = lz_db_root(db, "v1");
+    lz_root_get_sync(root, ^(lz_obj obj){
+        fail_unless(lz_obj_same(obj, v3));
+        lz_release(obj);
+    });
+    lz_release(root);
+    object_id_t v3_oid = v3->oid;
+    lz_release_sync(v3);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // entries, whose records have not been written or have an other digest
+    // (e.g., after a crash), are ignored (the digest is checked, when an
+    // entry is found for the first time)
+    lz_obj orphan = lz_obj_new("orphan", 7, ^{}, 0);
+    unsigned char entries[2][LAZY_DEDUP_DIGEST_LENGTH + sizeof(object_id_t)];
+    object_id_t oids[2] = {v3_oid, end + 1024 * 1024};
+    for (int loop = 0; loop < 2; loop++) {
+        lazy_dedup_digest(orphan, entries[loop]);
+        memcpy(entries[loop] + LAZY_DEDUP_DIGEST_LENGTH, &(oids[loop]), sizeof(object_id_t));
+    }
+    FILE * file = fopen("./tmp/test_dedup.db/dedup", "a");
+    fail_if(file == 0);
+    fail_unless(fwrite(entries, sizeof(entries), 1, file) == 1);
+    fclose(file);
+    
+    db = lz_db_open("./tmp/test_dedup.db");
+    lz_db_set_dedup(db, 1);
+    end = db->end_offset;
+    object_id_t oid = lazy_database_write_object(db, orphan);
+    fail_unless(oid == end);
+    lz_release_sync(orphan);
+    
+    // the new record replaces the invalid entry
+    orphan = lz_obj_new("orphan", 7, ^{}, 0);
+    fail_unless(lazy_database_write_object(db, orphan) == oid);
+    lz_release_sync(orphan);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_DEDUP_H_
@@ -0,0 +1,124 @@
+/*
+ *  test_durability.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 28.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_DURABILITY_H_
+#define _TEST_DURABILITY_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "lazy_root_impl.h"
+
+START_TEST (test_durability) {
+    
+    lz_durability modes[] = {LZ_DURABILITY_FLUSH, LZ_DURABILITY_SYNC, LZ_DURABILITY_GROUP};
+    int num_roots = 4;
+    int num_updates = 32;
+    
+    for (int m = 0; m < sizeof(modes) / sizeof(lz_durability); m++) {
+        char path[MAXPATHLEN];
+        snprintf(path, MAXPATHLEN, "./tmp/test_durability_%d.db", m);
+        
+        lz_db db = lz_db_open(path);
+        fail_if(db == 0);
+        lz_db_set_durability(db, modes[m]);
+        
+        // a synchronous update calls the handler before returning
+        __block int called = 0;
+        lz_root root = lz_db_root(db, "sync");
+        lz_obj obj = lz_obj_new("sync", 5, ^{}, 0);
+        fail_unless(lz_root_set_sync(root, obj, ^{
+            called = 1;
+        }));
+        fail_unless(called == 1);
+        
+        // the root is stored, when the handler is called
+        object_id_t oid;
+        fail_unless(lazy_root_table_get(db->roots, root->digest, &oid));
+        fail_unless(oid == obj->oid);
+        lz_release(obj);
+        
+        // a handler can update a root itself
+        obj = lz_obj_new("nested", 7, ^{}, 0);
+        dispatch_semaphore_t nested = dispatch_semaphore_create(0);
+        lz_root_set_async(root, obj, ^{
+            lz_obj other = lz_obj_new("other", 6, ^{}, 0);
+            lz_root other_root = lz_db_root(db, "other");
+            fail_unless(lz_root_set_sync(other_root, other, ^{}));
+            lz_release(other_root);
+            lz_release(other);
+            dispatch_semaphore_signal(nested);
+        });
+        dispatch_semaphore_wait(nested, DISPATCH_TIME_FOREVER);
+        dispatch_release(nested);
+        lz_release(obj);
+        lz_release(root);
+        
+        // asynchronous updates of several roots
+        __block volatile int32_t num_called = 0;
+        lz_root roots[num_roots];
+        for (int r = 0; r < num_roots; r++) {
+            char name[16];
+            snprintf(name, 16, "root %d", r);
+            roots[r] = lz_db_root(db, name);
+        }
+        for (int loop = 0; loop < num_updates; loop++) {
+            int * data = malloc(sizeof(int));
+            *data = loop;
+            obj = lz_obj_new(data, sizeof(int), ^{ free(data); }, 0);
+            lz_root_set_async(roots[loop % num_roots], obj, ^{
+                OSAtomicIncrement32Barrier(&num_called);
+            });
+            lz_release(obj);
+        }
+        for (int r = 0; r < num_roots; r++) {
+            lz_release(roots[r]);
+        }
+        lz_release(db);
+        lz_wait_for_completion();
+        fail_unless(num_called == num_updates);
+        
+        // the last update of each root is stored
+        db = lz_db_open(path);
+        fail_if(db == 0);
+        for (int r = 0; r < num_roots; r++) {
+            char name[16];
+            snprintf(name, 16, "root %d", r);
+            root = lz_db_root(db, name);
+            lz_root_get_sync(root, ^(lz_obj o){
+                fail_if(o == 0);
+                lz_obj_sync(o, ^(void * data, uint32_t length){
+                    fail_unless(*(int *)data == num_updates - num_roots + r);
+                });
+                lz_release(o);
+            });
+            lz_release(root);
+        }
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    
+} END_TEST
+
+#endif // _TEST_DURABILITY_H_
@@ -0,0 +1,77 @@
+/*
+ *  test_group_commit.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 24.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_GROUP_COMMIT_H_
+#define _TEST_GROUP_COMMIT_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_group_commit) {
+    
+    int num_obj = 2000;
+    object_id_t * oids = calloc(sizeof(object_id_t), num_obj);
+    
+    // concurrent writers share batches of up to 64 KB (waiting at most 1 ms)
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    lz_db_set_group_commit(db, 64 * 1024, NSEC_PER_MSEC);
+    
+    dispatch_apply(num_obj, dispatch_get_global_queue(0, 0), ^(size_t loop){
+        uint64_t * data = malloc(sizeof(uint64_t) * 32);
+        fail_if(data == 0);
+        for (int i = 0; i < 32; i++) {
+            data[i] = loop;
+        }
+        lz_obj obj = lz_obj_new(data, sizeof(uint64_t) * 32, ^{
+            free(data);
+        }, 0);
+        oids[loop] = lazy_database_write_object(db, obj);
+        lz_release(obj);
+        
+        // the record is in the file, as soon as the write returns
+        fail_unless(db->flushed_end > oids[loop]);
+    });
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    for (int loop = 0; loop < num_obj; loop++) {
+        lz_obj obj = lazy_database_read_object(db, oids[loop]);
+        fail_if(obj == 0);
+        lz_obj_sync(obj, ^(void * d, uint32_t s){
+            fail_unless(s == sizeof(uint64_t) * 32);
+            fail_unless(((uint64_t *)d)[0] == loop && ((uint64_t *)d)[31] == loop);
+        });
+        lz_release(obj);
+    }
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    free(oids);
+} END_TEST
+
+#endif // _TEST_GROUP_COMMIT_H_
@@ -0,0 +1,81 @@
+/*
+ *  test_identity_map.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 17.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_IDENTITY_MAP_H_
+#define _TEST_IDENTITY_MAP_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_identity_map) {
+    
+    object_id_t oid;
+    
+    // write a diamond: both children reference the same object
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    lz_obj shared = lz_obj_new("shared", 7, ^{}, 0);
+    lz_obj left = lz_obj_new("left", 5, ^{}, 1, shared);
+    lz_obj right = lz_obj_new("right", 6, ^{}, 1, shared);
+    lz_obj top = lz_obj_new("top", 4, ^{}, 2, left, right);
+    lz_release(shared);
+    lz_release(left);
+    lz_release(right);
+    
+    oid = lazy_database_write_object(db, top);
+    
+    // written objects are resident
+    lz_obj resident = lazy_database_read_object(db, oid);
+    fail_unless(resident == top);
+    lz_release(resident);
+    lz_release(top);
+    
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // read the diamond from the data file
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    top = lazy_database_read_object(db, oid);
+    fail_if(top == 0);
+    
+    lz_obj s1 = lz_obj_weak_ref(lz_obj_weak_ref(top, 0), 0);
+    lz_obj s2 = lz_obj_weak_ref(lz_obj_weak_ref(top, 1), 0);
+    fail_unless(s1 == s2);
+    
+    // the same id results in the same handle
+    lz_obj other = lazy_database_read_object(db, oid);
+    fail_unless(other == top);
+    lz_release(other);
+    
+    lz_release(top);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_IDENTITY_MAP_H_
@@ -0,0 +1,121 @@
+/*
+ *  test_import.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 29.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_IMPORT_H_
+#define _TEST_IMPORT_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_import) {
+    
+    int num_obj = 100000;
+    
+    lz_db db = lz_db_open("./tmp/test_import.db");
+    fail_if(db == 0);
+    
+    // a prebuilt tree with a shared leaf and a large payload
+    size_t large_length = LAZY_IMPORT_CHUNK_SIZE + 1;
+    char * large = calloc(1, large_length);
+    fail_if(large == 0);
+    large[large_length - 1] = 'x';
+    lz_obj shared = lz_obj_new("s", 2, ^{}, 0);
+    lz_obj big = lz_obj_new(large, large_length, ^{ free(large); }, 1, shared);
+    lz_obj tree = lz_obj_new("t", 2, ^{}, 2, big, shared);
+    lz_release(big);
+    lz_release(shared);
+    
+    lz_db_import(db, tree);
+    fail_unless(tree->is_temp == 0);
+    fail_unless(lz_obj_weak_ref(tree, 0)->is_temp == 0);
+    fail_unless(lz_obj_weak_ref(tree, 0)->oid < tree->oid);
+    
+    // a list emitted by a producer (children first)
+    __block lz_obj list = 0;
+    lz_db_import_stream(db, ^(void(^emit)(lz_obj obj)){
+        list = lz_obj_new("0", 2, ^{}, 0);
+        emit(list);
+        for (int loop = 1; loop < num_obj; loop++) {
+            lz_obj obj = lz_obj_new("n", 2, ^{}, 1, list);
+            lz_release(list);
+            list = obj;
+            emit(obj);
+        }
+        // objects emitted twice are written once
+        emit(list);
+    });
+    fail_unless(list->is_temp == 0);
+    
+    // the objects are persisted, setting the roots does not write them again
+    lz_root root = lz_db_root(db, "tree");
+    lz_root_set_sync(root, tree, ^{});
+    lz_release(root);
+    root = lz_db_root(db, "list");
+    lz_root_set_sync(root, list, ^{});
+    lz_release(root);
+    lz_release_sync(tree);
+    lz_release_sync(list);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // read both graphs
+    db = lz_db_open("./tmp/test_import.db");
+    fail_if(db == 0);
+    
+    root = lz_db_root(db, "tree");
+    lz_root_get_sync(root, ^(lz_obj obj){
+        fail_unless(lz_obj_num_ref(obj) == 2);
+        lz_obj b = lz_obj_weak_ref(obj, 0);
+        fail_unless(lz_obj_same(lz_obj_weak_ref(b, 0), lz_obj_weak_ref(obj, 1)));
+        lz_obj_sync(b, ^(void * data, uint32_t length){
+            fail_unless(length == large_length);
+            fail_unless(((char *)data)[length - 1] == 'x');
+        });
+        lz_release(obj);
+    });
+    lz_release(root);
+    
+    root = lz_db_root(db, "list");
+    lz_root_get_sync(root, ^(lz_obj obj){
+        int count = 1;
+        lz_obj o = obj;
+        while (lz_obj_num_ref(o) > 0) {
+            o = lz_obj_weak_ref(o, 0);
+            count++;
+        }
+        fail_unless(count == num_obj);
+        lz_obj_sync(o, ^(void * data, uint32_t length){
+            fail_unless(strcmp(data, "0") == 0);
+        });
+        lz_release_sync(obj);
+    });
+    lz_release(root);
+    
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_IMPORT_H_
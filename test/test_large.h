@@ -0,0 +1,154 @@
+/*
+ *  test_large.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 14.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_LARGE_H_
+#define _TEST_LARGE_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "test_read_v1_db.h"
+
+static inline char test_large_byte(uint64_t pos) {
+    return (pos * 7 + pos / 4093) & 0xff;
+}
+
+// Checks a range of the content written by test_large.
+static void test_large_range(lz_obj obj, uint64_t offset, size_t length, size_t expected) {
+    int64_t result = lz_obj_read_range(obj, offset, length, ^(void * data, size_t l){
+        fail_unless(l == expected);
+        for (size_t loop = 0; loop < l; loop++) {
+            fail_unless(((char *)data)[loop] == test_large_byte(offset + loop));
+        }
+    });
+    fail_unless(result == expected);
+}
+
+START_TEST (test_large) {
+    
+    const char * path = "./tmp/test_large.db";
+    uint64_t length = 5 * LAZY_LARGE_CHUNK_SIZE + 1234;
+    char * content = malloc(length);
+    fail_if(content == 0);
+    for (uint64_t loop = 0; loop < length; loop++) {
+        content[loop] = test_large_byte(loop);
+    }
+    
+    for (int checksums = 0; checksums < 2; checksums++) {
+        lz_db db = lz_db_open(path);
+        fail_if(db == 0);
+        lz_db_set_checksums(db, checksums);
+        lz_db_set_compression(db, 1, LAZY_COMPRESSION_DEFAULT_THRESHOLD);
+        
+        // small and large pieces
+        lz_writer writer = lz_writer_new(db);
+        fail_if(writer == 0);
+        uint64_t pos = 0;
+        size_t pieces[] = {1, 1000, LAZY_LARGE_CHUNK_SIZE - 1001, 3 * LAZY_LARGE_CHUNK_SIZE + 17};
+        for (int loop = 0; loop < 4; loop++) {
+            lz_writer_write(writer, content + pos, pieces[loop]);
+            pos += pieces[loop];
+        }
+        lz_writer_write(writer, content + pos, length - pos);
+        lz_obj large = lz_writer_finish(writer);
+        fail_if(large == 0);
+        fail_unless(lz_obj_length(large) == length);
+        
+        // the content is not passed as payload
+        lz_obj_sync(large, ^(void * data, uint32_t l){
+            fail_unless(data == 0);
+            fail_unless(l == 0);
+        });
+        
+        // the large object is part of the graph of a root
+        lz_obj parent = lz_obj_new("parent", 7, ^{}, 1, large);
+        lz_root root = lz_db_root(db, "large");
+        lz_root_set_sync(root, parent, ^{});
+        lz_release(root);
+        lz_release(parent);
+        lz_release(large);
+        lz_release(db);
+        lz_wait_for_completion();
+        
+        for (int mmap = 0; mmap < 2; mmap++) {
+            db = lz_db_open(path);
+            lz_db_set_mmap(db, mmap);
+            root = lz_db_root(db, "large");
+            __block lz_obj obj = 0;
+            lz_root_get_sync(root, ^(lz_obj o){
+                obj = o;
+            });
+            fail_if(obj == 0);
+            large = lz_obj_ref(obj, 0);
+            fail_if(large == 0);
+            fail_unless(lz_obj_length(large) == length);
+            
+            // within a chunk, across chunks, at the end and behind the end
+            test_large_range(large, 0, 100, 100);
+            test_large_range(large, LAZY_LARGE_CHUNK_SIZE - 10, 20, 20);
+            test_large_range(large, 1000, 3 * LAZY_LARGE_CHUNK_SIZE, 3 * LAZY_LARGE_CHUNK_SIZE);
+            test_large_range(large, length - 100, 1000, 100);
+            test_large_range(large, length + 1, 10, 0);
+            
+            // the payload of small objects
+            fail_unless(lz_obj_read_range(obj, 2, 100, ^(void * data, size_t l){
+                fail_unless(l == 5);
+                fail_unless(memcmp(data, "rent", 5) == 0);
+            }) == 5);
+            
+            fail_unless(lz_db_scrub(db, 0) == 0);
+            lz_release(large);
+            lz_release(obj);
+            lz_release(root);
+            lz_release(db);
+            lz_wait_for_completion();
+        }
+    }
+    
+    free(content);
+    
+    // databases of version 1 don't store large objects
+    const char * v1_path = "./tmp/test_large_v1.db";
+    create_db_with_version(v1_path, 1);
+    lz_db db = lz_db_open(v1_path);
+    fail_if(db == 0);
+    lz_writer writer = lz_writer_new(db);
+    fail_unless(writer == 0);
+    lz_writer_write(writer, "data", 5);
+    fail_unless(lz_writer_finish(writer) == 0);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // a description, whose chunks don't match the length, is not read
+    struct lazy_large_s forged = {3 * LAZY_LARGE_CHUNK_SIZE, LAZY_LARGE_CHUNK_SIZE, 0};
+    lz_obj obj = lz_obj_new(&forged, sizeof(struct lazy_large_s), ^{}, 0);
+    obj->flags |= LAZY_OBJECT_LARGE;
+    fail_unless(lz_obj_read_range(obj, 0, 100, ^(void * data, size_t l){
+        fail("The forged large object has been read.");
+    }) == -1);
+    lz_release(obj);
+    
+} END_TEST
+
+#endif // _TEST_LARGE_H_
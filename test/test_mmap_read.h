@@ -0,0 +1,85 @@
+/*
+ *  test_mmap_read.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 03.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_MMAP_READ_H_
+#define _TEST_MMAP_READ_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_mmap_read) {
+    
+    int num_obj = 4000;
+    
+    struct data_s {
+        uint64_t i;
+        int8_t foo[1024];
+    };
+    
+    lz_db db = lz_db_open("./tmp/test.db");
+    lz_db_set_mmap(db, 1);
+    
+    lz_obj * objs = calloc(sizeof(lz_obj), num_obj);
+    
+    // read each object right after it has been written, the data file
+    // grows beyond the size of the first mappings
+    for (int loop = 0; loop < num_obj; loop++) {
+        struct data_s * data = malloc(sizeof(struct data_s));
+        fail_if(data == 0);
+        data->i = loop;
+        lz_obj obj = lz_obj_new(data, sizeof(struct data_s), ^{
+            free(data);
+        }, 0);
+        object_id_t oid = lazy_database_write_object(db, obj);
+        lz_release(obj);
+        
+        objs[loop] = lazy_database_read_object(db, oid);
+        fail_if(objs[loop] == 0);
+    }
+    
+    // objects read from older mappings are still valid
+    for (int loop = 0; loop < num_obj; loop++) {
+        lz_obj_sync(objs[loop], ^(void * d, uint32_t s){
+            fail_unless(sizeof(struct data_s) == s);
+            fail_unless(((struct data_s *)d)->i == loop);
+        });
+        lz_release(objs[loop]);
+    }
+    free(objs);
+    
+    // reserved space, which has not been written, is not read from the
+    // mapping (the pages behind the end of the file can't be accessed)
+    lazy_database_commit(db);
+    object_id_t end = db->end_offset;
+    db->end_offset = end + 1024 * 1024;
+    fail_unless(lazy_database_read_object(db, end + 64 * 1024) == 0);
+    db->end_offset = end;
+    
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_MMAP_READ_H_
@@ -0,0 +1,78 @@
+/*
+ *  test_parallel_append.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 25.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_PARALLEL_APPEND_H_
+#define _TEST_PARALLEL_APPEND_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_parallel_append) {
+    
+    int num_obj = 256;
+    object_id_t * oids = calloc(sizeof(object_id_t), num_obj);
+    
+    // small (batched) and large (direct) records at the same time
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    dispatch_apply(num_obj, dispatch_get_global_queue(0, 0), ^(size_t loop){
+        size_t length = (loop % 2) ? 16 : LAZY_COMMIT_DIRECT_THRESHOLD + loop * 1024;
+        unsigned char * data = malloc(length);
+        fail_if(data == 0);
+        memset(data, loop & 0xFF, length);
+        lz_obj obj = lz_obj_new(data, length, ^{
+            free(data);
+        }, 0);
+        oids[loop] = lazy_database_write_object(db, obj);
+        lz_release(obj);
+    });
+    
+    // all reserved ranges have been written
+    fail_unless(db->flushed_end == db->end_offset);
+    fail_unless(db->num_written == 0);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    for (int loop = 0; loop < num_obj; loop++) {
+        lz_obj obj = lazy_database_read_object(db, oids[loop]);
+        fail_if(obj == 0);
+        lz_obj_sync(obj, ^(void * d, uint32_t s){
+            size_t length = (loop % 2) ? 16 : LAZY_COMMIT_DIRECT_THRESHOLD + loop * 1024;
+            fail_unless(s == length);
+            fail_unless(((unsigned char *)d)[0] == (loop & 0xFF));
+            fail_unless(((unsigned char *)d)[s - 1] == (loop & 0xFF));
+        });
+        lz_release(obj);
+    }
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    free(oids);
+} END_TEST
+
+#endif // _TEST_PARALLEL_APPEND_H_
@@ -0,0 +1,112 @@
+/*
+ *  test_prefetch.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 19.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_PREFETCH_H_
+#define _TEST_PREFETCH_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+static lz_obj create_prefetch_tree(int depth, int fanout) {
+    lz_obj children[fanout];
+    int num_ref = depth > 0 ? fanout : 0;
+    for (int loop = 0; loop < num_ref; loop++) {
+        children[loop] = create_prefetch_tree(depth - 1, fanout);
+    }
+    lz_obj obj = lz_obj_new_v("node", 5, ^{}, num_ref, children);
+    for (int loop = 0; loop < num_ref; loop++) {
+        lz_release(children[loop]);
+    }
+    return obj;
+}
+
+static int count_resident(lz_obj obj, int depth) {
+    int result = 0;
+    for (int loop = 0; loop < obj->num_references; loop++) {
+        lz_obj child = obj->reference_objs[loop];
+        if (child) {
+            result += 1 + (depth > 1 ? count_resident(child, depth - 1) : 0);
+        }
+    }
+    return result;
+}
+
+START_TEST (test_prefetch) {
+    
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    lz_obj tree = create_prefetch_tree(3, 8);
+    object_id_t oid = lazy_database_write_object(db, tree);
+    lz_release(tree);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    // prefetch two levels
+    tree = lazy_database_read_object(db, oid);
+    lz_prefetch prefetch = lz_obj_prefetch(tree, 2, 0);
+    lz_prefetch_wait(prefetch);
+    lz_release(prefetch);
+    fail_unless(count_resident(tree, 3) == 8 + 64);
+    lz_release(tree);
+    lz_wait_for_completion();
+    
+    // the byte limit stops the prefetch (each inner node has a payload of 5
+    // bytes and 8 references)
+    uint64_t node_size = 5 + 8 * sizeof(object_id_t);
+    uint64_t max_bytes = 3 * node_size;
+    lz_prefetch_set_limit(4);
+    tree = lazy_database_read_object(db, oid);
+    prefetch = lz_obj_prefetch(tree, 2, max_bytes);
+    lz_prefetch_wait(prefetch);
+    lz_release(prefetch);
+    int num_resident = count_resident(tree, 3);
+    fail_unless(num_resident >= 1);
+    fail_unless(num_resident * node_size <= max_bytes);
+    lz_release(tree);
+    lz_wait_for_completion();
+    
+    // a cancelled prefetch doesn't read any more objects
+    lz_prefetch_set_limit(1);
+    tree = lazy_database_read_object(db, oid);
+    prefetch = lz_obj_prefetch(tree, 3, 0);
+    lz_prefetch_cancel(prefetch);
+    lz_prefetch_wait(prefetch);
+    num_resident = count_resident(tree, 3);
+    lz_wait_for_completion();
+    fail_unless(count_resident(tree, 3) == num_resident);
+    lz_release(prefetch);
+    lz_release(tree);
+    lz_prefetch_set_limit(16);
+    
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_PREFETCH_H_
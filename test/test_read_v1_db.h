@@ -0,0 +1,86 @@
+/*
+ *  test_read_v1_db.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 10.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_READ_V1_DB_H_
+#define _TEST_READ_V1_DB_H_
+
+#include <check.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#include <lazy.h>
+
+// Creates an empty database with the given format version.
+void create_db_with_version(const char * path, int version) {
+    char filename[MAXPATHLEN];
+    mkdir(path, S_IRWXU);
+    snprintf(filename, MAXPATHLEN, "%s/version", path);
+    FILE * fd = fopen(filename, "w+");
+    fprintf(fd, "%d", version);
+    fclose(fd);
+    snprintf(filename, MAXPATHLEN, "%s/index", path);
+    mkdir(filename, S_IRWXU);
+}
+
+START_TEST (test_read_v1_db) {
+    
+    create_db_with_version("./tmp/test.db", 1);
+    
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_unless(lz_db_version(db) == 1);
+    
+    lz_obj leaf = lz_obj_new("Leaf", 5, ^{}, 0);
+    lz_obj obj = lz_obj_new("Foo", 4, ^{}, 2, leaf, leaf);
+    lz_release(leaf);
+    
+    lz_root root = lz_db_root(db, "v1");
+    lz_root_set_sync(root, obj, ^{});
+    lz_release(obj);
+    lz_release(root);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // records of version 1 are still read and written
+    db = lz_db_open("./tmp/test.db");
+    fail_unless(lz_db_version(db) == 1);
+    root = lz_db_root(db, "v1");
+    lz_root_get_sync(root, ^(lz_obj obj){
+        fail_if(obj == 0);
+        lz_obj_sync(obj, ^(void * data, uint32_t size){
+            fail_unless(size == 4);
+            fail_unless(strcmp(data, "Foo") == 0);
+        });
+        fail_unless(lz_obj_num_ref(obj) == 2);
+        lz_obj_sync(lz_obj_weak_ref(obj, 1), ^(void * data, uint32_t size){
+            fail_unless(size == 5);
+            fail_unless(strcmp(data, "Leaf") == 0);
+        });
+        lz_release(obj);
+    });
+    lz_release(root);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_READ_V1_DB_H_
@@ -0,0 +1,99 @@
+/*
+ *  test_ref_async.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 22.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_REF_ASYNC_H_
+#define _TEST_REF_ASYNC_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_ref_async) {
+    
+    int num_children = 8;
+    
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    lz_obj children[num_children];
+    for (int loop = 0; loop < num_children; loop++) {
+        int * i = malloc(sizeof(int));
+        *i = loop;
+        children[loop] = lz_obj_new(i, sizeof(int), ^{ free(i); }, 0);
+    }
+    lz_obj parent = lz_obj_new_v("parent", 7, ^{}, num_children, children);
+    for (int loop = 0; loop < num_children; loop++) {
+        lz_release(children[loop]);
+    }
+    object_id_t oid = lazy_database_write_object(db, parent);
+    lz_release(parent);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    parent = lazy_database_read_object(db, oid);
+    fail_if(parent == 0);
+    
+    // a single reference (read from the file, then resident)
+    for (int round = 0; round < 2; round++) {
+        dispatch_semaphore_t done = dispatch_semaphore_create(0);
+        lz_obj_ref_async(parent, 3, ^(lz_obj ref){
+            fail_if(ref == 0);
+            lz_obj_sync(ref, ^(void * data, uint32_t length){
+                fail_unless(*(int *)data == 3);
+            });
+            lz_release(ref);
+            dispatch_semaphore_signal(done);
+        });
+        dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+        dispatch_release(done);
+    }
+    
+    // all references at once
+    uint16_t positions[num_children];
+    for (int loop = 0; loop < num_children; loop++) {
+        positions[loop] = num_children - 1 - loop;
+    }
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    lz_obj_refs_async(parent, positions, num_children, ^(lz_obj * refs){
+        for (int loop = 0; loop < num_children; loop++) {
+            fail_if(refs[loop] == 0);
+            lz_obj_sync(refs[loop], ^(void * data, uint32_t length){
+                fail_unless(*(int *)data == num_children - 1 - loop);
+            });
+            lz_release(refs[loop]);
+        }
+        dispatch_semaphore_signal(done);
+    });
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+    dispatch_release(done);
+    
+    lz_release(parent);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_REF_ASYNC_H_
@@ -0,0 +1,107 @@
+/*
+ *  test_ref_encoding.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 21.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_REF_ENCODING_H_
+#define _TEST_REF_ENCODING_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+#include "lazy_varint_impl.h"
+#include "test_read_v1_db.h"
+
+// A node with 300 children, which is written with the given format.
+static uint64_t test_ref_encoding_fanout(const char * path, int version) {
+    create_db_with_version(path, version);
+    lz_db db = lz_db_open(path);
+    fail_unless(lz_db_version(db) == version);
+    uint64_t start = db->end_offset;
+    
+    lz_obj children[300];
+    for (int loop = 0; loop < 300; loop++) {
+        int * data = malloc(sizeof(int));
+        *data = loop;
+        children[loop] = lz_obj_new(data, sizeof(int), ^{ free(data); }, 0);
+    }
+    lz_obj node = lz_obj_new_v("node", 5, ^{}, 300, children);
+    for (int loop = 0; loop < 300; loop++) {
+        lz_release(children[loop]);
+    }
+    lz_root root = lz_db_root(db, "node");
+    lz_root_set_sync(root, node, ^{});
+    lz_release(root);
+    lz_release(node);
+    uint64_t size = db->end_offset - start;
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // read with pread() and from the mapping
+    for (int mmap = 0; mmap < 2; mmap++) {
+        db = lz_db_open(path);
+        lz_db_set_mmap(db, mmap);
+        root = lz_db_root(db, "node");
+        lz_root_get_sync(root, ^(lz_obj obj){
+            fail_if(obj == 0);
+            fail_unless(lz_obj_num_ref(obj) == 300);
+            for (int loop = 0; loop < 300; loop++) {
+                lz_obj_sync(lz_obj_weak_ref(obj, loop), ^(void * data, uint32_t length){
+                    fail_unless(*(int *)data == loop);
+                });
+            }
+            lz_release(obj);
+        });
+        fail_unless(lz_db_scrub(db, 0) == 0);
+        lz_release(root);
+        lz_release(db);
+        lz_wait_for_completion();
+    }
+    return size;
+}
+
+START_TEST (test_ref_encoding) {
+    
+    // round trip of near, far and following references (the decoding of a
+    // word is used for varints of up to 8 bytes, not at the end)
+    uint64_t id = 1ULL << 40;
+    uint64_t refs[] = {id - 1, id - 64, id - 65, id - 8192, 0, id + 100, id - (1ULL << 35), UINT64_MAX, 1, id};
+    uint64_t decoded[10];
+    char bytes[10 * LAZY_VARINT_MAX_LENGTH];
+    size_t length = lazy_refs_encode(id, refs, 10, bytes);
+    fail_unless(length == lazy_refs_encoded_length(id, refs, 10));
+    fail_unless(lazy_refs_decode(id, bytes, length, decoded, 10));
+    fail_unless(memcmp(refs, decoded, sizeof(refs)) == 0);
+    fail_unless(lazy_refs_encoded_length(id, refs, 1) == 1);
+    
+    // truncated and trailing bytes
+    fail_if(lazy_refs_decode(id, bytes, length - 1, decoded, 10));
+    fail_if(lazy_refs_decode(id, bytes, length, decoded, 9));
+    
+    // the references of version 3 are smaller, version 2 stays readable
+    uint64_t v2 = test_ref_encoding_fanout("./tmp/test_ref_encoding_v2.db", 2);
+    uint64_t v3 = test_ref_encoding_fanout("./tmp/test_ref_encoding_v3.db", 3);
+    fail_unless(v3 + 300 * 5 < v2);
+    
+} END_TEST
+
+#endif // _TEST_REF_ENCODING_H_
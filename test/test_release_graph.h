@@ -0,0 +1,68 @@
+/*
+ *  test_release_graph.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 26.04.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_RELEASE_GRAPH_H_
+#define _TEST_RELEASE_GRAPH_H_
+
+#include <check.h>
+#include <libkern/OSAtomic.h>
+#include <lazy.h>
+
+START_TEST (test_release_graph) {
+    
+    int num_obj = 100000;
+    __block volatile int32_t dealloc_called = 0;
+    
+    // a long list, each element refers to its predecessor
+    lz_obj list = 0;
+    for (int loop = 0; loop < num_obj; loop++) {
+        lz_obj obj = lz_obj_new("Foo", 4, ^{
+            OSAtomicIncrement32(&dealloc_called);
+        }, list ? 1 : 0, list);
+        lz_release(list);
+        list = obj;
+    }
+    
+    // the whole list is deallocated before lz_release_sync() returns
+    lz_release_sync(list);
+    fail_unless(dealloc_called == num_obj);
+    
+    // the same in batches by the reclaim worker
+    dealloc_called = 0;
+    lz_reclaim_set_limit(1000, 0);
+    list = 0;
+    for (int loop = 0; loop < num_obj; loop++) {
+        lz_obj obj = lz_obj_new("Foo", 4, ^{
+            OSAtomicIncrement32(&dealloc_called);
+        }, list ? 1 : 0, list);
+        lz_release(list);
+        list = obj;
+    }
+    lz_release(list);
+    lz_wait_for_completion();
+    fail_unless(dealloc_called == num_obj);
+    lz_reclaim_set_limit(4096, 0);
+    
+} END_TEST
+
+#endif // _TEST_RELEASE_GRAPH_H_
@@ -0,0 +1,112 @@
+/*
+ *  test_root_compaction.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 05.07.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_ROOT_COMPACTION_H_
+#define _TEST_ROOT_COMPACTION_H_
+
+#include <check.h>
+#include <lazy.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "lazy_database_impl.h"
+#include "lazy_root_impl.h"
+
+static off_t test_root_compaction_journal_length(const char * path) {
+    char filename[MAXPATHLEN];
+    struct stat file_stat;
+    snprintf(filename, MAXPATHLEN, "%s/roots.journal", path);
+    fail_unless(stat(filename, &file_stat) == 0);
+    return file_stat.st_size;
+}
+
+static object_id_t test_root_compaction_oid(const char * path, const char * name) {
+    lz_db db = lz_db_open(path);
+    fail_if(db == 0);
+    lz_root root = lz_db_root(db, name);
+    object_id_t oid = root->root_is_bound ? root->root_obj_id : OBJECT_ID_UNKNOWN;
+    lz_release(root);
+    lz_release(db);
+    lz_wait_for_completion();
+    return oid;
+}
+
+START_TEST (test_root_compaction) {
+    
+    const char * path = "./tmp/test_root_compaction.db";
+    char filename[MAXPATHLEN];
+    int num_updates = 100000;
+    
+    // the journal doesn't grow with the updates of a root
+    lz_db db = lz_db_open(path);
+    fail_if(db == 0);
+    lz_obj foo = lz_obj_new("Foo", 4, ^{}, 0);
+    lz_obj bar = lz_obj_new("Bar", 4, ^{}, 0);
+    lz_root root = lz_db_root(db, "counter");
+    for (int loop = 0; loop < num_updates; loop++) {
+        lz_root_set_sync(root, loop % 2 ? bar : foo, ^{});
+    }
+    
+    // the compaction runs in the background
+    lz_wait_for_completion();
+    fail_unless(db->roots->journal_length < LAZY_ROOT_JOURNAL_COMPACT_LENGTH);
+    fail_unless(test_root_compaction_journal_length(path) == db->roots->journal_length);
+    object_id_t oid = bar->oid;
+    lz_release(foo);
+    lz_release(bar);
+    lz_release(root);
+    
+    // the current id and the history are kept
+    lz_db_set_root_history(db, 3);
+    fail_unless(lazy_root_table_compact(db->roots));
+    fail_unless(test_root_compaction_journal_length(path) == 4 * sizeof(struct lazy_root_journal_entry_s));
+    lz_db_set_root_history(db, 0);
+    fail_unless(lazy_root_table_compact(db->roots));
+    fail_unless(test_root_compaction_journal_length(path) == sizeof(struct lazy_root_journal_entry_s));
+    lz_release(db);
+    lz_wait_for_completion();
+    fail_unless(test_root_compaction_oid(path, "counter") == oid);
+    
+    // a table, which has not been closed, is built again from the journal
+    snprintf(filename, MAXPATHLEN, "%s/roots", path);
+    int fd = open(filename, O_WRONLY);
+    fail_if(fd < 0);
+    uint32_t clean = 0;
+    fail_unless(pwrite(fd, &clean, sizeof(uint32_t), offsetof(struct lazy_root_table_header_s, clean)) == sizeof(uint32_t));
+    close(fd);
+    fail_unless(test_root_compaction_oid(path, "counter") == oid);
+    
+    // a clean table is opened without reading the journal
+    snprintf(filename, MAXPATHLEN, "%s/roots.journal", path);
+    fd = open(filename, O_WRONLY);
+    fail_if(fd < 0);
+    char garbage[sizeof(struct lazy_root_journal_entry_s)];
+    memset(garbage, 0xff, sizeof(garbage));
+    fail_unless(pwrite(fd, garbage, sizeof(garbage), 0) == sizeof(garbage));
+    close(fd);
+    fail_unless(test_root_compaction_oid(path, "counter") == oid);
+    
+} END_TEST
+
+#endif // _TEST_ROOT_COMPACTION_H_
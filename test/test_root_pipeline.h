@@ -0,0 +1,100 @@
+/*
+ *  test_root_pipeline.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 31.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_ROOT_PIPELINE_H_
+#define _TEST_ROOT_PIPELINE_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_root_pipeline) {
+    
+    int num_updates = 64;
+    int num_leaves = 1000;
+    
+    lz_db db = lz_db_open("./tmp/test_root_pipeline.db");
+    fail_if(db == 0);
+    lz_root root = lz_db_root(db, "root");
+    
+    // the updates share a large subgraph and differ in size
+    lz_obj leaves[num_leaves];
+    for (int loop = 0; loop < num_leaves; loop++) {
+        leaves[loop] = lz_obj_new("l", 2, ^{}, 0);
+    }
+    lz_obj shared = lz_obj_new_v("s", 2, ^{}, num_leaves, leaves);
+    for (int loop = 0; loop < num_leaves; loop++) {
+        lz_release(leaves[loop]);
+    }
+    
+    __block volatile int32_t num_published = 0;
+    for (int u = 0; u < num_updates; u++) {
+        lz_obj obj = lz_retain(shared);
+        for (int loop = 0; loop < (num_updates - u) * 100; loop++) {
+            int * data = malloc(sizeof(int));
+            *data = u;
+            lz_obj next = lz_obj_new(data, sizeof(int), ^{ free(data); }, 1, obj);
+            lz_release(obj);
+            obj = next;
+        }
+        
+        // the handlers are called in the order of the updates
+        lz_root_set_async(root, obj, ^{
+            fail_unless(num_published == u);
+            OSAtomicIncrement32Barrier(&num_published);
+        });
+        
+        // a read after an update returns the new root
+        lz_retain(obj);
+        lz_root_get_async(root, ^(lz_obj o){
+            fail_unless(lz_obj_same(o, obj));
+            lz_release(o);
+            lz_release(obj);
+        });
+        lz_release(obj);
+    }
+    lz_release(shared);
+    lz_release(root);
+    lz_release(db);
+    lz_wait_for_completion();
+    fail_unless(num_published == num_updates);
+    
+    // the last update is stored
+    db = lz_db_open("./tmp/test_root_pipeline.db");
+    fail_if(db == 0);
+    root = lz_db_root(db, "root");
+    lz_root_get_sync(root, ^(lz_obj obj){
+        fail_if(obj == 0);
+        lz_obj_sync(obj, ^(void * data, uint32_t length){
+            fail_unless(*(int *)data == num_updates - 1);
+        });
+        lz_release(obj);
+    });
+    lz_release(root);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_ROOT_PIPELINE_H_
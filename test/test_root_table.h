@@ -0,0 +1,193 @@
+/*
+ *  test_root_table.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 28.06.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_ROOT_TABLE_H_
+#define _TEST_ROOT_TABLE_H_
+
+#include <check.h>
+#include <lazy.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <CommonCrypto/CommonDigest.h>
+
+#include "lazy_database_impl.h"
+#include "lazy_root_impl.h"
+#include "lazy_crc32c_impl.h"
+
+// Writes a root file of the old layout ('index/<sha1 of the name>').
+static void test_root_table_write_index(const char * path, const char * name, object_id_t * ids, int num_ids) {
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    char filename[MAXPATHLEN];
+    CC_SHA1(name, strlen(name), digest);
+    
+    int pos = snprintf(filename, MAXPATHLEN, "%s/index/", path);
+    for (int loop = 0; loop < CC_SHA1_DIGEST_LENGTH; loop++) {
+        pos += snprintf(filename + pos, MAXPATHLEN - pos, "%02x", digest[loop]);
+    }
+    FILE * file = fopen(filename, "w");
+    fail_if(file == 0);
+    fail_unless(fwrite(ids, sizeof(object_id_t), num_ids, file) == num_ids);
+    fclose(file);
+}
+
+static object_id_t test_root_table_oid(lz_db db, const char * name) {
+    lz_root root = lz_db_root(db, name);
+    object_id_t oid = root->root_is_bound ? root->root_obj_id : OBJECT_ID_UNKNOWN;
+    lz_release(root);
+    return oid;
+}
+
+START_TEST (test_root_table) {
+    
+    const char * path = "./tmp/test_root_table.db";
+    char filename[MAXPATHLEN];
+    char name[64];
+    int num_roots = 3000;
+    
+    // more roots than the initial capacity of the table, every third is
+    // deleted again
+    lz_db db = lz_db_open(path);
+    fail_if(db == 0);
+    lz_obj obj = lz_obj_new("Foo", 4, ^{}, 0);
+    object_id_t oid = lazy_database_write_object(db, obj);
+    for (int loop = 0; loop < num_roots; loop++) {
+        snprintf(name, 64, "root %d", loop);
+        lz_root root = lz_db_root(db, name);
+        lz_root_set_sync(root, obj, ^{});
+        if (loop % 3 == 0) {
+            lz_root_del_sync(root, ^{});
+        }
+        lz_release(root);
+    }
+    lz_release(obj);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    db = lz_db_open(path);
+    for (int loop = 0; loop < num_roots; loop++) {
+        snprintf(name, 64, "root %d", loop);
+        fail_unless(test_root_table_oid(db, name) == (loop % 3 ? oid : OBJECT_ID_UNKNOWN));
+    }
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // an entry at the end of the journal, which has not been written
+    // completely, is dropped
+    snprintf(filename, MAXPATHLEN, "%s/roots.journal", path);
+    int fd = open(filename, O_WRONLY | O_APPEND);
+    fail_if(fd < 0);
+    fail_unless(write(fd, "torn entry", 10) == 10);
+    close(fd);
+    
+    db = lz_db_open(path);
+    fail_if(db == 0);
+    fail_unless(test_root_table_oid(db, "root 1") == oid);
+    lz_root root = lz_db_root(db, "root 0");
+    obj = lz_obj_new("Bar", 4, ^{}, 0);
+    lz_root_set_sync(root, obj, ^{});
+    object_id_t new_oid = obj->oid;
+    lz_release(obj);
+    lz_release(root);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // the table is built again from the journal
+    snprintf(filename, MAXPATHLEN, "%s/roots", path);
+    fail_unless(unlink(filename) == 0);
+    db = lz_db_open(path);
+    fail_unless(test_root_table_oid(db, "root 0") == new_oid);
+    fail_unless(test_root_table_oid(db, "root 1") == oid);
+    fail_unless(test_root_table_oid(db, "root 3") == OBJECT_ID_UNKNOWN);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+START_TEST (test_root_table_migration) {
+    
+    const char * path = "./tmp/test_root_table_migration.db";
+    char filename[MAXPATHLEN];
+    
+    lz_db db = lz_db_open(path);
+    lz_obj obj = lz_obj_new("Foo", 4, ^{}, 0);
+    object_id_t oid = lazy_database_write_object(db, obj);
+    lz_release(obj);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // replace the roots with the layout of older databases
+    snprintf(filename, MAXPATHLEN, "%s/roots", path);
+    fail_unless(unlink(filename) == 0);
+    snprintf(filename, MAXPATHLEN, "%s/roots.journal", path);
+    fail_unless(unlink(filename) == 0);
+    snprintf(filename, MAXPATHLEN, "%s/index", path);
+    fail_unless(mkdir(filename, S_IRWXU) == 0);
+    
+    object_id_t bound[] = {OBJECT_ID_UNKNOWN, oid};
+    object_id_t deleted[] = {oid, OBJECT_ID_UNKNOWN};
+    test_root_table_write_index(path, "bound", bound, 2);
+    test_root_table_write_index(path, "deleted", deleted, 2);
+    test_root_table_write_index(path, "empty", 0, 0);
+    
+    // a migration, which has not been completed, is started again
+    struct lazy_root_journal_entry_s entry;
+    CC_SHA1("bound", 5, entry.digest);
+    entry.oid = oid + 1;
+    entry.checksum = lazy_crc32c(lazy_crc32c(0, entry.digest, LAZY_ROOT_DIGEST_LENGTH), &(entry.oid), sizeof(object_id_t));
+    snprintf(filename, MAXPATHLEN, "%s/roots.journal", path);
+    int fd = open(filename, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+    fail_if(fd < 0);
+    fail_unless(write(fd, &entry, sizeof(entry)) == sizeof(entry));
+    close(fd);
+    
+    db = lz_db_open(path);
+    fail_if(db == 0);
+    fail_unless(test_root_table_oid(db, "bound") == oid);
+    fail_unless(test_root_table_oid(db, "deleted") == OBJECT_ID_UNKNOWN);
+    fail_unless(test_root_table_oid(db, "empty") == OBJECT_ID_UNKNOWN);
+    lz_root root = lz_db_root(db, "bound");
+    lz_root_get_sync(root, ^(lz_obj obj){
+        fail_if(obj == 0);
+        lz_obj_sync(obj, ^(void * data, uint32_t length){
+            fail_unless(strcmp(data, "Foo") == 0);
+        });
+        lz_release(obj);
+    });
+    lz_release(root);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // the roots are in the journal now
+    struct stat folder_stat;
+    snprintf(filename, MAXPATHLEN, "%s/index", path);
+    fail_unless(stat(filename, &folder_stat) != 0);
+    snprintf(filename, MAXPATHLEN, "%s/index.migrated", path);
+    fail_unless(stat(filename, &folder_stat) == 0);
+    db = lz_db_open(path);
+    fail_unless(test_root_table_oid(db, "bound") == oid);
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_ROOT_TABLE_H_
@@ -0,0 +1,106 @@
+/*
+ *  test_write_large_graph.h
+ *  lazyObject
+ *
+ *  Created by Tobias Kräntzer on 26.05.10.
+ *  Copyright 2010 Fraunhofer Institut für Software- und Systemtechnik ISST.
+ *
+ *  This file is part of lazyObject.
+ *	
+ *	lazyObject is free software: you can redistribute it and/or modify
+ *	it under the terms of the GNU Lesser General Public License as published by
+ *	the Free Software Foundation, either version 3 of the License, or
+ *	(at your option) any later version.
+ *	
+ *	lazyObject is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU Lesser General Public License for more details.
+ *
+ *	You should have received a copy of the GNU Lesser General Public License
+ *	along with lazyObject.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TEST_WRITE_LARGE_GRAPH_H_
+#define _TEST_WRITE_LARGE_GRAPH_H_
+
+#include <check.h>
+#include <lazy.h>
+
+#include "lazy_database_impl.h"
+
+START_TEST (test_write_large_graph) {
+    
+    int num_obj = 1000000;
+    
+    lz_db db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    lz_db_set_write_parallelism(db, 4);
+    
+    // a list (each object references its predecessor)
+    lz_obj list = lz_obj_new("0", 2, ^{}, 0);
+    for (int loop = 1; loop < num_obj; loop++) {
+        lz_obj obj = lz_obj_new("n", 2, ^{}, 1, list);
+        lz_release(list);
+        list = obj;
+    }
+    object_id_t list_oid = lazy_database_write_object(db, list);
+    
+    // the first object has been written first
+    lz_obj obj = list;
+    while (lz_obj_num_ref(obj) > 0) {
+        obj = lz_obj_weak_ref(obj, 0);
+    }
+    fail_unless(obj->oid < list_oid);
+    lz_release_sync(list);
+    
+    // a tree with 1000 inner objects and 1000 leaves each
+    lz_obj inner[1000];
+    for (int i = 0; i < 1000; i++) {
+        lz_obj leaves[1000];
+        for (int loop = 0; loop < 1000; loop++) {
+            leaves[loop] = lz_obj_new("l", 2, ^{}, 0);
+        }
+        inner[i] = lz_obj_new_v("i", 2, ^{}, 1000, leaves);
+        for (int loop = 0; loop < 1000; loop++) {
+            lz_release(leaves[loop]);
+        }
+    }
+    lz_obj tree = lz_obj_new_v("t", 2, ^{}, 1000, inner);
+    for (int i = 0; i < 1000; i++) {
+        lz_release(inner[i]);
+    }
+    object_id_t tree_oid = lazy_database_write_object(db, tree);
+    lz_release_sync(tree);
+    
+    lz_release(db);
+    lz_wait_for_completion();
+    
+    // read both graphs
+    db = lz_db_open("./tmp/test.db");
+    fail_if(db == 0);
+    
+    int count = 1;
+    list = lazy_database_read_object(db, list_oid);
+    obj = list;
+    while (lz_obj_num_ref(obj) > 0) {
+        obj = lz_obj_weak_ref(obj, 0);
+        count++;
+    }
+    fail_unless(count == num_obj);
+    lz_obj_sync(obj, ^(void * data, uint32_t length){
+        fail_unless(strcmp(data, "0") == 0);
+    });
+    lz_release_sync(list);
+    
+    tree = lazy_database_read_object(db, tree_oid);
+    fail_unless(lz_obj_num_ref(tree) == 1000);
+    fail_unless(lz_obj_num_ref(lz_obj_weak_ref(tree, 999)) == 1000);
+    lz_release_sync(tree);
+    
+    lz_release(db);
+    lz_wait_for_completion();
+    
+} END_TEST
+
+#endif // _TEST_WRITE_LARGE_GRAPH_H_